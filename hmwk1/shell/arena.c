@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "util.h"
+
+#define ARENAALIGN 16
+
+static size_t alignUp(size_t n)
+{
+	return (n + ARENAALIGN - 1) & ~(size_t)(ARENAALIGN - 1);
+}
+
+/* chunk headers are padded so the data after them stays aligned */
+#define CHUNKHEADER alignUp(sizeof(struct ArenaChunk))
+
+static struct ArenaChunk *newChunk(struct Arena *arena, size_t size)
+{
+	struct ArenaChunk *chunk = malloc(CHUNKHEADER + size);
+
+	if (chunk == NULL)
+		errMalloc();
+
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	arena->chunkMallocs++;
+
+	return chunk;
+}
+
+/*
+ * Prepares an empty arena whose first chunk will hold chunkSize bytes.
+ */
+void initArena(struct Arena *arena, size_t chunkSize)
+{
+	memset(arena, 0, sizeof(*arena));
+	arena->chunkSize = alignUp(chunkSize);
+}
+
+/*
+ * Returns size bytes of memory aligned for any type.
+ * The memory is valid until the next arenaReset().
+ */
+void *arenaAlloc(struct Arena *arena, size_t size)
+{
+	struct ArenaChunk *chunk = arena->chunks;
+	void *mem;
+
+	size = alignUp(size ? size : 1);
+
+	if (chunk == NULL || chunk->size - chunk->used < size) {
+		/* the chunk is full; start another at least twice as big */
+		size_t chunkSize = chunk ? chunk->size * 2 : arena->chunkSize;
+
+		while (chunkSize < size)
+			chunkSize *= 2;
+		chunk = newChunk(arena, chunkSize);
+	}
+
+	mem = (char *)chunk + CHUNKHEADER + chunk->used;
+	chunk->used += size;
+
+	arena->inUse += size;
+	if (arena->inUse > arena->peak)
+		arena->peak = arena->inUse;
+	arena->allocs++;
+
+	return mem;
+}
+
+/*
+ * Returns a copy of s allocated in the arena.
+ */
+char *arenaStrdup(struct Arena *arena, const char *s)
+{
+	size_t len = strlen(s);
+	char *copy = arenaAlloc(arena, len + 1);
+
+	memcpy(copy, s, len + 1);
+	return copy;
+}
+
+/*
+ * Releases everything allocated from the arena in one step.
+ */
+void arenaReset(struct Arena *arena)
+{
+	struct ArenaChunk *chunk = arena->chunks;
+
+	arena->resets++;
+	arena->inUse = 0;
+
+	if (chunk == NULL)
+		return;
+
+	if (chunk->next != NULL) {
+		/* replace the chain with one chunk that fits all of it */
+		size_t total = 0;
+
+		while (chunk != NULL) {
+			struct ArenaChunk *next = chunk->next;
+
+			total += chunk->size;
+			free(chunk);
+			chunk = next;
+		}
+
+		arena->chunks = NULL;
+		chunk = newChunk(arena, total);
+	}
+
+	chunk->used = 0;
+}
+
+/*
+ * Releases the arena's chunks.
+ */
+void freeArena(struct Arena *arena)
+{
+	struct ArenaChunk *chunk = arena->chunks;
+
+	while (chunk != NULL) {
+		struct ArenaChunk *next = chunk->next;
+
+		free(chunk);
+		chunk = next;
+	}
+
+	arena->chunks = NULL;
+	arena->inUse = 0;
+}
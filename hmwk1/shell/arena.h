@@ -0,0 +1,56 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+/*
+ * A bump allocator. Memory is handed out from large chunks and is all
+ * released at once by arenaReset(). After a reset the arena keeps one
+ * chunk big enough for everything allocated since the previous reset,
+ * so a steady stream of similar commands makes no malloc calls.
+ */
+struct ArenaChunk {
+	struct ArenaChunk *next;
+	size_t size;
+	size_t used;
+};
+
+struct Arena {
+	struct ArenaChunk *chunks;
+	size_t chunkSize;
+	size_t inUse;
+
+	/* counters */
+	unsigned long chunkMallocs;
+	unsigned long allocs;
+	unsigned long resets;
+	size_t peak;
+};
+
+/*
+ * Prepares an empty arena whose first chunk will hold chunkSize bytes.
+ */
+void initArena(struct Arena *arena, size_t chunkSize);
+
+/*
+ * Returns size bytes of memory aligned for any type.
+ * The memory is valid until the next arenaReset().
+ */
+void *arenaAlloc(struct Arena *arena, size_t size);
+
+/*
+ * Returns a copy of s allocated in the arena.
+ */
+char *arenaStrdup(struct Arena *arena, const char *s);
+
+/*
+ * Releases everything allocated from the arena in one step.
+ */
+void arenaReset(struct Arena *arena);
+
+/*
+ * Releases the arena's chunks.
+ */
+void freeArena(struct Arena *arena);
+
+#endif
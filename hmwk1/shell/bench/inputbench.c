@@ -0,0 +1,143 @@
+/*
+ * Measures how fast command lines can be read, in lines per second.
+ *
+ * usage: inputbench [-n lines] [file]
+ *
+ * Without a file, a temporary script of generated command lines is used.
+ * Three readers are compared: the original one-getc()-per-character
+ * reader that mallocs every line, the block-buffered reader from input.c,
+ * and the memory mapped reader from input.c.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "../input.h"
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * The reader the shell used before input.c: one getc() per character
+ * into a heap buffer that doubles in size. Returns NULL at end of file.
+ */
+static char *getcReadLine(FILE *stream)
+{
+	int bufSize = 64;
+	int charCount = 0;
+	int currChar = '\0';
+	char *buffer = malloc(bufSize);
+
+	while (currChar != '\n') {
+		if (charCount == bufSize) {
+			bufSize *= 2;
+			buffer = realloc(buffer, bufSize);
+		}
+
+		currChar = getc(stream);
+		if (currChar == EOF) {
+			if (charCount == 0) {
+				free(buffer);
+				return NULL;
+			}
+			currChar = '\n';
+		}
+		buffer[charCount++] = currChar;
+	}
+
+	buffer[--charCount] = '\0';
+	return buffer;
+}
+
+static void report(const char *name, long lines, size_t bytes, double secs)
+{
+	printf("%-8s %10ld %12.0f %10.1f\n", name, lines, lines / secs,
+			bytes / secs / (1 << 20));
+}
+
+static void benchGetc(const char *file)
+{
+	FILE *stream = fopen(file, "r");
+	size_t bytes = 0;
+	long lines = 0;
+	char *line;
+	double start = now();
+
+	while ((line = getcReadLine(stream)) != NULL) {
+		bytes += strlen(line) + 1;
+		lines++;
+		free(line);
+	}
+
+	report("getc", lines, bytes, now() - start);
+	fclose(stream);
+}
+
+static void benchInput(const char *file, int useMap)
+{
+	struct Input in;
+	int fd = open(file, O_RDONLY);
+	size_t bytes = 0;
+	long lines = 0;
+	char *line;
+	double start = now();
+
+	openInput(&in, fd, useMap);
+	while ((line = readLine(&in)) != NULL) {
+		bytes += strlen(line) + 1;
+		lines++;
+	}
+	closeInput(&in);
+
+	report(useMap ? "mmap" : "block", lines, bytes, now() - start);
+	close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	long numLines = 1000000;
+	char tmpName[] = "/tmp/inputbenchXXXXXX";
+	const char *file = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		if (opt == 'n') {
+			numLines = atol(optarg);
+		} else {
+			fprintf(stderr, "usage: %s [-n lines] [file]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc) {
+		file = argv[optind];
+	} else {
+		int fd = mkstemp(tmpName);
+		FILE *out = fdopen(fd, "w");
+		long i;
+
+		for (i = 0; i < numLines; i++)
+			fprintf(out, "ls -l /usr/share/doc/package-%ld | grep -v "
+					"README > /tmp/out.%ld\n", i, i % 97);
+		fclose(out);
+		file = tmpName;
+	}
+
+	printf("%-8s %10s %12s %10s\n", "reader", "lines", "lines_sec", "mb_sec");
+	benchGetc(file);
+	benchInput(file, 0);
+	benchInput(file, 1);
+
+	if (file == tmpName)
+		unlink(tmpName);
+
+	return 0;
+}
@@ -0,0 +1,966 @@
+/*
+ * Benchmark suite for the shell, run by "make bench".
+ *
+ * usage: shellbench [-s shell] [-q]
+ *
+ * Prints one CSV row per measurement:
+ *	benchmark,variant,iterations,value,unit
+ * so results can be stored and compared between versions. -s gives the
+ * shell binary to drive (default ./w4118_sh) and -q runs fewer
+ * iterations, for a quick check.
+ *
+ * builtins	commands/sec of a script made only of builtins, run by the
+ *		shell binary from start to exit
+ * external	commands/sec of a script of /bin/true, for comparison, and
+ *		of the same script with the zygote's helpers
+ * pipelines	lines/sec of a script of pipelines and fan-outs whose stages
+ *		are forked builtins, which hangs if a stage keeps another
+ *		one's pipe open
+ * serve	batches/sec of 10 builtins, run by a fresh shell per batch and
+ *		sent to one shell running with --serve, a connection per batch
+ * spawn	launch-to-exit rate and latency of spawnProcess() per engine
+ * jobs		jobs/sec of /bin/true started as a job and waited for, with
+ *		no and with 1000 idle children running, reaped through
+ *		their pidfds and, for comparison, by wait4() on any child
+ * copy		GB/s moved by a read()/write() loop, by io_uring (uring.c)
+ *		and by copy_file_range(), for one large file, many small
+ *		files and a pipe (which copy_file_range() cannot read)
+ * lookup	PATH lookup with a path list of large directories: building
+ *		the executable index, then cold (hash table cleared), hot
+ *		(remembered) and for a miss
+ * completion	tab completion with 50k executables in the path list: building
+ *		the trie, completing a command name that many or one of
+ *		them start with, listing candidates, and completing a file
+ *		name in the same directory
+ * tokenizer	tokenize() throughput on quoted command lines
+ * history	appends and random lookups with 100k entries
+ * histsearch	history search with 200k entries: building the trigram
+ *		index, searching for a rare and a common word and for
+ *		part of a common word through it, the first two by
+ *		scanning every entry, and appends kept indexed
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "../arena.h"
+#include "../complete.h"
+#include "../hash.h"
+#include "../histindex.h"
+#include "../history.h"
+#include "../jobs.h"
+#include "../list.h"
+#include "../search.h"
+#include "../serve.h"
+#include "../spawn.h"
+#include "../tokenizer.h"
+#include "../uring.h"
+#include "../trie.h"
+
+#define LOOKUPDIRS 8
+#define LOOKUPFILES 4000
+#define COMPLETIONFILES 50000
+#define SERVEBATCH 10
+#define IDLECHILDREN 1000
+#define COPYLARGEMB 256
+#define COPYSMALLFILES 2000
+#define COPYSMALLSIZE 4096
+
+static int quick;
+
+/* the lines of the builtins and serve benchmarks */
+static const char * const builtins[8] = {
+	"true",
+	"echo hello world > /dev/null",
+	"test 1 -lt 2",
+	"printf '%s %d\\n' x 42 > /dev/null",
+	"cd /",
+	"false",
+	"[ -d / ]",
+	"hash -r",
+};
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void row(const char *benchmark, const char *variant, long iterations,
+		double value, const char *unit)
+{
+	printf("%s,%s,%ld,%.3f,%s\n", benchmark, variant, iterations, value,
+			unit);
+	fflush(stdout);
+}
+
+static int scaled(int iterations)
+{
+	return quick ? iterations / 10 : iterations;
+}
+
+/*
+ * Writes first, unless it is NULL, then numLines lines, cycling through
+ * lines[], to a temporary file.
+ * Returns its name, which the caller unlinks.
+ */
+static char *writeScript(const char *first, const char * const lines[],
+		int numLines)
+{
+	static char name[] = "/tmp/shellbench.XXXXXX";
+	FILE *f;
+	int fd;
+	int i;
+
+	strcpy(name, "/tmp/shellbench.XXXXXX");
+	fd = mkstemp(name);
+	if (fd < 0 || (f = fdopen(fd, "w")) == NULL) {
+		perror("script");
+		exit(EXIT_FAILURE);
+	}
+
+	if (first != NULL)
+		fprintf(f, "%s\n", first);
+	for (i = 0; i < numLines; i++)
+		fprintf(f, "%s\n", lines[i % 8]);
+	fclose(f);
+
+	return name;
+}
+
+/*
+ * Runs shell on script with its output discarded.
+ * Returns the elapsed time in seconds.
+ */
+static double runScript(const char *shell, const char *script)
+{
+	double start = now();
+	int status;
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		execl(shell, shell, script, (char *)NULL);
+		_exit(127);
+	}
+
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+		fprintf(stderr, "shellbench: could not run %s\n", shell);
+		exit(EXIT_FAILURE);
+	}
+
+	return now() - start;
+}
+
+static void benchScripts(const char *shell)
+{
+	static const char * const pipelines[8] = {
+		"echo fan |+ cat |+ cat > /dev/null",
+		"echo a | cat | cat",
+		"history |+ cat > /dev/null",
+		"echo fan |+ /bin/cat |+ cat",
+		"printf 'x\\n' | cat",
+		"echo b | cat > /dev/null",
+		"echo fan |+ cat",
+		"true | cat",
+	};
+	static const char * const external[8] = {
+		"/bin/true", "/bin/true", "/bin/true", "/bin/true",
+		"/bin/true", "/bin/true", "/bin/true", "/bin/true",
+	};
+	int n = scaled(200000);
+	char *script;
+	double secs;
+
+	script = writeScript(NULL, builtins, n);
+	secs = runScript(shell, script);
+	unlink(script);
+	row("builtins", "mixed", n, n / secs, "commands/sec");
+
+	n = scaled(2000);
+	script = writeScript(NULL, external, n);
+	secs = runScript(shell, script);
+	unlink(script);
+	row("external", "/bin/true", n, n / secs, "commands/sec");
+
+	script = writeScript("spawn zygote", external, n);
+	secs = runScript(shell, script);
+	unlink(script);
+	row("external", "zygote", n, n / secs, "commands/sec");
+
+	script = writeScript(NULL, pipelines, n);
+	secs = runScript(shell, script);
+	unlink(script);
+	row("pipelines", "builtins", n, n / secs, "lines/sec");
+}
+
+/*
+ * Sends the numLines lines of batch over a new connection to the server
+ * at addr and reads the output until the connection is closed.
+ * Returns the number of statuses read, or -1 if the server cannot be
+ * reached.
+ */
+static int runBatch(const struct sockaddr_un *addr, const char *batch,
+		size_t len)
+{
+	char buf[4096];
+	int statuses = 0;
+	ssize_t n;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	write(fd, batch, len);
+	shutdown(fd, SHUT_WR);
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		char *p = buf;
+
+		while ((p = memchr(p, SERVESEP, buf + n - p)) != NULL) {
+			statuses++;
+			p++;
+		}
+	}
+	close(fd);
+
+	return statuses;
+}
+
+static void benchServe(const char *shell)
+{
+	struct sockaddr_un addr;
+	char batch[1024] = "";
+	int n = scaled(500);
+	char *script;
+	double start;
+	double secs;
+	pid_t pid;
+	int i;
+
+	for (i = 0; i < SERVEBATCH; i++) {
+		strcat(batch, builtins[i % 8]);
+		strcat(batch, "\n");
+	}
+
+	script = writeScript(NULL, builtins, SERVEBATCH);
+	secs = 0;
+	for (i = 0; i < n; i++)
+		secs += runScript(shell, script);
+	unlink(script);
+	row("serve", "fresh_shell", n, n / secs, "batches/sec");
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path),
+			"/tmp/shellbench.%d.sock", (int)getpid());
+
+	pid = fork();
+	if (pid == 0) {
+		int null = open("/dev/null", O_WRONLY);
+
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		execl(shell, shell, "--serve", addr.sun_path, (char *)NULL);
+		_exit(127);
+	}
+
+	/* wait for the server to listen */
+	for (i = 0; i < 1000 && runBatch(&addr, "", 0) < 0; i++)
+		usleep(1000);
+
+	start = now();
+	for (i = 0; i < n; i++) {
+		if (runBatch(&addr, batch, strlen(batch)) != SERVEBATCH) {
+			fprintf(stderr, "shellbench: %s --serve failed\n", shell);
+			exit(EXIT_FAILURE);
+		}
+	}
+	secs = now() - start;
+	row("serve", "session", n, n / secs, "batches/sec");
+
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+}
+
+static void benchSpawn()
+{
+	char *args[] = { "/bin/true", NULL };
+	int n = scaled(1000);
+	double *samples = malloc(sizeof(double) * n);
+	enum SpawnMode modes[] = { SPAWN_POSIX, SPAWN_FORK, SPAWN_ZYGOTE };
+	char variant[32];
+	double total;
+	int m, i;
+
+	for (m = 0; m < 3; m++) {
+		if (setSpawnMode(modes[m]) < 0) {
+			perror("setSpawnMode");
+			exit(EXIT_FAILURE);
+		}
+
+		for (i = 0; i < n; i++) {
+			double start = now();
+			pid_t pid = spawnProcess(args[0], args, NULL);
+
+			if (pid < 0) {
+				perror("spawn");
+				exit(EXIT_FAILURE);
+			}
+			waitpid(pid, NULL, 0);
+			samples[i] = (now() - start) * 1e6;
+		}
+
+		total = 0;
+		for (i = 0; i < n; i++)
+			total += samples[i];
+		snprintf(variant, sizeof(variant), "%s_rate",
+				spawnModeName(modes[m]));
+		row("spawn", variant, n, n / (total / 1e6), "launches/sec");
+
+		qsort(samples, n, sizeof(*samples), compareDouble);
+		snprintf(variant, sizeof(variant), "%s_p50",
+				spawnModeName(modes[m]));
+		row("spawn", variant, n, samples[n / 2], "us");
+		snprintf(variant, sizeof(variant), "%s_p99",
+				spawnModeName(modes[m]));
+		row("spawn", variant, n, samples[n * 99 / 100], "us");
+	}
+	setSpawnMode(SPAWN_POSIX);
+
+	free(samples);
+}
+
+/*
+ * Starts n processes that do nothing until they are killed.
+ * Returns their pids.
+ */
+static pid_t *startIdle(int n)
+{
+	pid_t *pids = malloc(sizeof(pid_t) * (n + 1));
+	int i;
+
+	for (i = 0; i < n; i++) {
+		pids[i] = fork();
+		if (pids[i] == 0) {
+			while (1)
+				pause();
+		}
+		if (pids[i] < 0) {
+			perror("fork");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return pids;
+}
+
+static void stopIdle(pid_t *pids, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		kill(pids[i], SIGKILL);
+		waitpid(pids[i], NULL, 0);
+	}
+	free(pids);
+}
+
+/*
+ * Runs /bin/true n times as a job, as a command line does, and returns
+ * the jobs/sec. With useJobs unset each one is reaped as the shell used
+ * to, by wait4() on any child until it comes back.
+ */
+static double churnJobs(int n, int useJobs)
+{
+	char *args[] = { "/bin/true", NULL };
+	double start = now();
+	struct rusage usage;
+	int status;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		pid_t pid = spawnProcess(args[0], args, NULL);
+
+		if (pid < 0) {
+			perror("spawn");
+			exit(EXIT_FAILURE);
+		}
+
+		if (useJobs) {
+			struct Job *job = addJob(&pid, 1, args[0], 0);
+
+			waitJob(job);
+			removeJob(job);
+		} else {
+			while (wait4(-1, &status, 0, &usage) != pid)
+				;
+			while (wait4(-1, &status, WNOHANG, &usage) > 0)
+				;
+		}
+	}
+
+	return n / (now() - start);
+}
+
+static void benchJobs()
+{
+	int n = scaled(2000);
+	int idle[] = { 0, IDLECHILDREN };
+	char variant[32];
+	pid_t *pids;
+	int i;
+
+	initJobs();
+
+	for (i = 0; i < 2; i++) {
+		pids = startIdle(idle[i]);
+
+		snprintf(variant, sizeof(variant), "pidfd_idle%d", idle[i]);
+		row("jobs", variant, n, churnJobs(n, 1), "jobs/sec");
+		snprintf(variant, sizeof(variant), "wait4_idle%d", idle[i]);
+		row("jobs", variant, n, churnJobs(n, 0), "jobs/sec");
+
+		stopIdle(pids, idle[i]);
+	}
+}
+
+enum CopyEngine { ENGINE_READWRITE, ENGINE_URING, ENGINE_RANGE };
+
+static const char * const engineNames[] = { "readwrite", "uring", "range" };
+
+/*
+ * Copies everything left in in to out with engine.
+ * Returns 0 on success, -1 on failure.
+ */
+static int copyWith(enum CopyEngine engine, int in, int out)
+{
+	static char buf[URINGBUFSIZE];
+	ssize_t n;
+
+	if (engine == ENGINE_URING)
+		return uringCopy(in, out) == 0 ? 0 : -1;
+
+	do {
+		if (engine == ENGINE_RANGE)
+			n = copy_file_range(in, NULL, out, NULL, 1 << 30, 0);
+		else if ((n = read(in, buf, sizeof(buf))) > 0 &&
+				write(out, buf, n) != n)
+			return -1;
+	} while (n > 0);
+
+	return n < 0 ? -1 : 0;
+}
+
+/*
+ * Writes size bytes that are not all zeros to fd.
+ */
+static void fillFile(int fd, size_t size)
+{
+	static char block[1 << 16];
+	size_t i;
+
+	for (i = 0; i < sizeof(block); i++)
+		block[i] = i * 7;
+	while (size > 0) {
+		size_t n = size < sizeof(block) ? size : sizeof(block);
+
+		if (write(fd, block, n) != (ssize_t)n) {
+			perror("write");
+			exit(EXIT_FAILURE);
+		}
+		size -= n;
+	}
+}
+
+/*
+ * Copies the files in files to a new file with engine, like "cat files
+ * > out", and returns the GB/s.
+ */
+static double copyFiles(enum CopyEngine engine, char * const files[],
+		int numFiles, const char *out, size_t total)
+{
+	double start;
+	int outFd;
+	int i;
+
+	/* the last run's output is not freed on the clock */
+	unlink(out);
+	start = now();
+	outFd = open(out, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	for (i = 0; i < numFiles; i++) {
+		int in = open(files[i], O_RDONLY | O_CLOEXEC);
+
+		if (in < 0 || copyWith(engine, in, outFd) < 0) {
+			perror(engineNames[engine]);
+			exit(EXIT_FAILURE);
+		}
+		close(in);
+	}
+	close(outFd);
+
+	return total / (now() - start) / 1e9;
+}
+
+/*
+ * Copies size bytes written into a pipe by a child to /dev/null with
+ * engine, as "producer | cat" does, and returns the GB/s.
+ */
+static double copyPipe(enum CopyEngine engine, size_t size)
+{
+	int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	double start = now();
+	int fds[2];
+	pid_t pid;
+
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		close(fds[0]);
+		fillFile(fds[1], size);
+		_exit(0);
+	}
+	close(fds[1]);
+
+	if (copyWith(engine, fds[0], devNull) < 0) {
+		perror(engineNames[engine]);
+		exit(EXIT_FAILURE);
+	}
+	close(fds[0]);
+	close(devNull);
+	waitpid(pid, NULL, 0);
+
+	return size / (now() - start) / 1e9;
+}
+
+static void benchCopy()
+{
+	char root[] = "/tmp/shellbench.XXXXXX";
+	size_t large = (size_t)scaled(COPYLARGEMB) << 20;
+	int numSmall = scaled(COPYSMALLFILES);
+	char **small = malloc(sizeof(char *) * numSmall);
+	char *largeFile[1];
+	char out[64];
+	char variant[32];
+	int haveUring;
+	int e, i, fd;
+
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		exit(EXIT_FAILURE);
+	}
+	snprintf(out, sizeof(out), "%s/out", root);
+
+	/* copying nothing tells whether io_uring can be used at all */
+	fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+	haveUring = uringCopy(fd, fd) == 0;
+	close(fd);
+
+	/* the inputs are in the page cache, as files just written are */
+	largeFile[0] = malloc(strlen(root) + 16);
+	sprintf(largeFile[0], "%s/large", root);
+	fd = open(largeFile[0], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	fillFile(fd, large);
+	close(fd);
+
+	for (i = 0; i < numSmall; i++) {
+		small[i] = malloc(strlen(root) + 16);
+		sprintf(small[i], "%s/s%d", root, i);
+		fd = open(small[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		fillFile(fd, COPYSMALLSIZE);
+		close(fd);
+	}
+
+	for (e = ENGINE_READWRITE; e <= ENGINE_RANGE; e++) {
+		if (e == ENGINE_URING && !haveUring)
+			continue;
+		snprintf(variant, sizeof(variant), "large_%s", engineNames[e]);
+		row("copy", variant, large >> 20,
+				copyFiles(e, largeFile, 1, out, large), "GB/s");
+	}
+	for (e = ENGINE_READWRITE; e <= ENGINE_RANGE; e++) {
+		if (e == ENGINE_URING && !haveUring)
+			continue;
+		snprintf(variant, sizeof(variant), "small_%s", engineNames[e]);
+		row("copy", variant, numSmall,
+				copyFiles(e, small, numSmall, out,
+					(size_t)numSmall * COPYSMALLSIZE),
+				"GB/s");
+	}
+	for (e = ENGINE_READWRITE; e <= ENGINE_URING; e++) {
+		if (e == ENGINE_URING && !haveUring)
+			continue;
+		snprintf(variant, sizeof(variant), "pipe_%s", engineNames[e]);
+		row("copy", variant, large >> 20, copyPipe(e, large), "GB/s");
+	}
+
+	for (i = 0; i < numSmall; i++) {
+		unlink(small[i]);
+		free(small[i]);
+	}
+	free(small);
+	unlink(largeFile[0]);
+	free(largeFile[0]);
+	unlink(out);
+	rmdir(root);
+	closeUring();
+}
+
+/*
+ * Times iterations lookups of name, clearing the hash table before
+ * each one if cold is set. Looks up like getFullPath(), without its
+ * error message for a miss.
+ */
+static void timeLookup(const struct List *path, const char *name, int cold,
+		int iterations, const char *variant)
+{
+	double start = now();
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		if (cold)
+			hashClear();
+		if (hashFind(name) == NULL)
+			hashCommand(path, name);
+	}
+
+	row("lookup", variant, iterations,
+			(now() - start) * 1e6 / iterations, "us/lookup");
+}
+
+static void benchLookup()
+{
+	char root[] = "/tmp/shellbench.XXXXXX";
+	char file[256];
+	struct List path;
+	int numFiles = scaled(LOOKUPFILES);
+	double start;
+	int d, f;
+
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		exit(EXIT_FAILURE);
+	}
+
+	/* every directory is full; the target is in the last one */
+	initList(&path);
+	for (d = 0; d < LOOKUPDIRS; d++) {
+		char *dir = malloc(strlen(root) + 16);
+
+		sprintf(dir, "%s/d%d", root, d);
+		mkdir(dir, 0755);
+		addNodeBack(&path, dir);
+
+		for (f = 0; f < numFiles; f++) {
+			snprintf(file, sizeof(file), "%s/cmd%d-%d", dir, d, f);
+			close(open(file, O_CREAT | O_WRONLY, 0755));
+		}
+	}
+	snprintf(file, sizeof(file), "cmd%d-%d", LOOKUPDIRS - 1, numFiles - 1);
+
+	/* the first search opens the directories and builds the index */
+	start = now();
+	hashCommand(&path, file);
+	row("lookup", "index_build", 1, (now() - start) * 1e3, "ms");
+
+	timeLookup(&path, file, 1, scaled(200), "cold_hit");
+	timeLookup(&path, "no-such-command", 1, scaled(200), "cold_miss");
+	timeLookup(&path, file, 0, scaled(2000000), "hot_hit");
+	timeLookup(&path, "no-such-command", 0, scaled(2000000), "hot_miss");
+	searchInvalidate();
+	hashClear();
+
+	for (d = 0; d < LOOKUPDIRS; d++) {
+		for (f = 0; f < numFiles; f++) {
+			snprintf(file, sizeof(file), "%s/d%d/cmd%d-%d", root, d,
+					d, f);
+			unlink(file);
+		}
+		snprintf(file, sizeof(file), "%s/d%d", root, d);
+		rmdir(file);
+	}
+	rmdir(root);
+
+	traverseList(&path, free);
+	removeAllNodes(&path);
+}
+
+/*
+ * Times iterations completions of the end of line.
+ */
+static void timeCompletion(const struct List *path, const char *line,
+		int list, int iterations, const char *variant)
+{
+	struct Completion comp;
+	double start = now();
+	int i;
+
+	for (i = 0; i < iterations; i++)
+		completeLine(path, line, strlen(line), list, &comp);
+
+	row("completion", variant, iterations,
+			(now() - start) * 1e6 / iterations, "us/completion");
+}
+
+static void benchCompletion()
+{
+	char root[] = "/tmp/shellbench.XXXXXX";
+	char file[256];
+	char line[256];
+	struct List path;
+	struct Completion comp;
+	struct Trie trie;
+	int numFiles = scaled(COMPLETIONFILES);
+	double start;
+	int f;
+
+	if (mkdtemp(root) == NULL) {
+		perror("mkdtemp");
+		exit(EXIT_FAILURE);
+	}
+
+	initList(&path);
+	addNodeBack(&path, strdup(root));
+	for (f = 0; f < numFiles; f++) {
+		snprintf(file, sizeof(file), "%s/cmd%05d", root, f);
+		close(open(file, O_CREAT | O_WRONLY, 0755));
+	}
+
+	start = now();
+	initTrie(&trie);
+	for (f = 0; f < numFiles; f++) {
+		snprintf(file, sizeof(file), "cmd%05d", f);
+		trieInsert(&trie, file);
+	}
+	row("completion", "trie_build", numFiles, (now() - start) * 1e3, "ms");
+	freeArena(&trie.arena);
+
+	/* the first completion builds the index and the trie */
+	start = now();
+	completeLine(&path, "cmd", 3, 0, &comp);
+	row("completion", "first", 1, (now() - start) * 1e3, "ms");
+
+	timeCompletion(&path, "cmd", 0, scaled(100000), "command_many");
+	timeCompletion(&path, "cmd04242", 0, scaled(100000), "command_one");
+	timeCompletion(&path, "cmd", 1, scaled(1000), "command_list");
+
+	snprintf(line, sizeof(line), "ls %s/cmd", root);
+	timeCompletion(&path, line, 0, scaled(200), "file_many");
+	snprintf(line, sizeof(line), "ls %s/cmd04242", root);
+	timeCompletion(&path, line, 0, scaled(200), "file_one");
+
+	clearCompletions();
+	searchInvalidate();
+
+	for (f = 0; f < numFiles; f++) {
+		snprintf(file, sizeof(file), "%s/cmd%05d", root, f);
+		unlink(file);
+	}
+	rmdir(root);
+
+	traverseList(&path, free);
+	removeAllNodes(&path);
+}
+
+static void benchTokenizer()
+{
+	static const char line[] =
+		"grep -e 'two words' \"a \\\"quoted\\\" arg\" file\\ name "
+		"| sort -k2 |+ wc -l > out.txt ; ls -la /usr/lib >> log &";
+	int n = scaled(500000);
+	struct Arena arena;
+	struct TokenVector tokens;
+	char buf[sizeof(line)];
+	long numTokens = 0;
+	double start;
+	double secs;
+	int i;
+
+	initArena(&arena, 4096);
+	start = now();
+	for (i = 0; i < n; i++) {
+		arenaReset(&arena);
+		memcpy(buf, line, sizeof(line));
+		tokenize(&arena, buf, &tokens);
+		numTokens += tokens.count;
+	}
+	secs = now() - start;
+	freeArena(&arena);
+
+	row("tokenizer", "lines", n, n / secs, "lines/sec");
+	row("tokenizer", "tokens", numTokens, numTokens / secs, "tokens/sec");
+	row("tokenizer", "bytes", (long)n * (sizeof(line) - 1),
+			n * (sizeof(line) - 1) / secs / (1 << 20), "MB/sec");
+}
+
+static void benchHistory()
+{
+	int entries = 100000;
+	int n = scaled(1000000);
+	char cmd[64];
+	unsigned int r = 1;
+	double start;
+	int i;
+
+	setHistorySize(entries);
+
+	start = now();
+	for (i = 0; i < entries; i++) {
+		snprintf(cmd, sizeof(cmd), "command number %d --flag", i);
+		historyAppend(cmd);
+	}
+	row("history", "fill_100k", entries, entries / (now() - start),
+			"ops/sec");
+
+	/* at capacity every append also evicts the oldest entry */
+	start = now();
+	for (i = 0; i < entries; i++) {
+		snprintf(cmd, sizeof(cmd), "another command %d", i);
+		historyAppend(cmd);
+	}
+	row("history", "append_full", entries, entries / (now() - start),
+			"ops/sec");
+
+	start = now();
+	for (i = 0; i < n; i++) {
+		r = r * 1103515245 + 12345;
+		if (historyEntry(1 + r % historyCount()) == NULL)
+			abort();
+	}
+	row("history", "random_lookup", n, n / (now() - start), "ops/sec");
+
+	clearHistory();
+}
+
+/*
+ * Times iterations searches for query, through the index or by checking
+ * every entry from the newest.
+ */
+static void timeSearch(const char *query, int useIndex, int iterations,
+		const char *variant)
+{
+	int found[64];
+	double start = now();
+	int i, n;
+
+	for (i = 0; i < iterations; i++) {
+		if (useIndex) {
+			searchHistory(query, found, 64);
+			continue;
+		}
+		for (n = historyCount(); n > 0; n--) {
+			if (strstr(historyEntry(n), query) != NULL)
+				break;
+		}
+	}
+
+	row("histsearch", variant, iterations,
+			(now() - start) * 1e6 / iterations, "us/search");
+}
+
+static void benchHistorySearch()
+{
+	static const char * const formats[] = {
+		"git commit -m 'fix issue %d'",
+		"make -j4 target%d",
+		"ssh build%d.example.com uptime",
+		"grep -rn pattern%d src/ | sort | uniq -c",
+	};
+	int entries = scaled(200000);
+	int found[64];
+	char cmd[128];
+	double start;
+	int i;
+
+	setHistorySize(entries);
+	for (i = 0; i < entries; i++) {
+		snprintf(cmd, sizeof(cmd), formats[i % 4], i);
+		historyAppend(cmd);
+	}
+
+	/* the first search indexes every entry */
+	start = now();
+	searchHistory("build", found, 64);
+	row("histsearch", "index_build", entries, (now() - start) * 1e3, "ms");
+
+	/* the rare command is the oldest, so a scan goes through them all */
+	timeSearch("build2.example", 1, scaled(10000), "index_rare");
+	timeSearch("git commit", 1, scaled(1000), "index_common");
+	timeSearch("ssue", 1, scaled(1000), "index_inword");
+	timeSearch("build2.example", 0, scaled(100), "scan_rare");
+	timeSearch("git commit", 0, scaled(10000), "scan_common");
+
+	start = now();
+	for (i = 0; i < entries; i++) {
+		snprintf(cmd, sizeof(cmd), formats[i % 4], entries + i);
+		historyAppend(cmd);
+		indexHistory();
+	}
+	row("histsearch", "append_indexed", entries,
+			entries / (now() - start), "ops/sec");
+
+	clearHistoryIndex();
+	clearHistory();
+}
+
+int main(int argc, char **argv)
+{
+	const char *shell = "./w4118_sh";
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:q")) != -1) {
+		if (opt == 's')
+			shell = optarg;
+		else if (opt == 'q')
+			quick = 1;
+		else {
+			fprintf(stderr, "usage: %s [-s shell] [-q]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("benchmark,variant,iterations,value,unit\n");
+	benchScripts(shell);
+	benchServe(shell);
+	benchSpawn();
+	benchJobs();
+	benchCopy();
+	benchLookup();
+	benchCompletion();
+	benchTokenizer();
+	benchHistory();
+	benchHistorySearch();
+
+	return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Compares the latency of starting a command with the posix_spawn, fork
+ * and zygote engines from spawn.c.
+ *
+ * usage: spawnbench [-n iterations] [-m heap MB] [command [args...]]
+ *
+ * The heap option touches the given amount of memory first, to show how
+ * fork() latency grows with the size of the parent while posix_spawn()
+ * and the zygote's helpers stay flat. The default command is /bin/true.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "../spawn.h"
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Runs args iterations times with the given engine and prints
+ * the mean, median and 99th percentile launch-to-exit latency.
+ */
+static void runMode(enum SpawnMode mode, char * const args[],
+		int iterations, double *samples, int heapMB)
+{
+	int i;
+	double total = 0;
+
+	if (setSpawnMode(mode) < 0) {
+		perror("setSpawnMode");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < iterations; i++) {
+		double start = now();
+		pid_t pid = spawnProcess(args[0], args, NULL);
+
+		if (pid < 0) {
+			perror("spawn");
+			exit(EXIT_FAILURE);
+		}
+		waitpid(pid, NULL, 0);
+
+		samples[i] = now() - start;
+		total += samples[i];
+	}
+
+	qsort(samples, iterations, sizeof(*samples), compareDouble);
+	printf("%-6s %8d %10d %10.1f %10.1f %10.1f\n", spawnModeName(mode),
+			heapMB, iterations, total / iterations,
+			samples[iterations / 2], samples[iterations * 99 / 100]);
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = 1000;
+	int heapMB = 0;
+	char *defaultArgs[] = { "/bin/true", NULL };
+	char **args = defaultArgs;
+	double *samples;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:m:")) != -1) {
+		if (opt == 'n')
+			iterations = atoi(optarg);
+		else if (opt == 'm')
+			heapMB = atoi(optarg);
+		else {
+			fprintf(stderr, "usage: %s [-n iterations] [-m heap MB] "
+					"[command [args...]]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind < argc)
+		args = argv + optind;
+	if (iterations < 1)
+		iterations = 1;
+
+	if (heapMB > 0) {
+		char *ballast = malloc((size_t)heapMB << 20);
+
+		if (ballast == NULL) {
+			perror("malloc");
+			return EXIT_FAILURE;
+		}
+		memset(ballast, 1, (size_t)heapMB << 20);
+	}
+
+	samples = malloc(sizeof(*samples) * iterations);
+	if (samples == NULL) {
+		perror("malloc");
+		return EXIT_FAILURE;
+	}
+
+	printf("%-6s %8s %10s %10s %10s %10s\n", "mode", "heap_mb",
+			"runs", "mean_us", "p50_us", "p99_us");
+	runMode(SPAWN_FORK, args, iterations, samples, heapMB);
+	runMode(SPAWN_POSIX, args, iterations, samples, heapMB);
+	runMode(SPAWN_ZYGOTE, args, iterations, samples, heapMB);
+
+	free(samples);
+	return 0;
+}
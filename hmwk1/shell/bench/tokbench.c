@@ -0,0 +1,144 @@
+/*
+ * Compares the quote-aware tokenizer with the strtok()-based parseLine
+ * it replaced, on long generated command lines.
+ *
+ * usage: tokbench [-n lines] [-w words per line]
+ *
+ * "strtok-malloc" is the original parseLine, which copied the line and
+ * malloc'd every token. "strtok-arena" is the same split done in place
+ * in the per-command arena. Neither limits the number of tokens here,
+ * so all three produce the same number of words.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../arena.h"
+#include "../tokenizer.h"
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int strtokMalloc(const char *inputLine, char *tokens[])
+{
+	char buffer[strlen(inputLine) + 1];
+	int numArgs = 0;
+	char *tok;
+	int i;
+
+	strcpy(buffer, inputLine);
+	for (tok = strtok(buffer, " \t"); tok != NULL; tok = strtok(NULL, " ")) {
+		tokens[numArgs] = malloc(strlen(tok) + 1);
+		strcpy(tokens[numArgs++], tok);
+	}
+
+	for (i = 0; i < numArgs; i++)
+		free(tokens[i]);
+
+	return numArgs;
+}
+
+static int strtokArena(struct Arena *arena, const char *inputLine,
+		int maxTokens)
+{
+	char *buffer = arenaStrdup(arena, inputLine);
+	char **tokens = arenaAlloc(arena, sizeof(char *) * (maxTokens + 1));
+	int numArgs = 0;
+	char *tok;
+
+	for (tok = strtok(buffer, " \t"); tok != NULL; tok = strtok(NULL, " "))
+		tokens[numArgs++] = tok;
+
+	tokens[numArgs] = NULL;
+	return numArgs;
+}
+
+static int tokenizer(struct Arena *arena, const char *inputLine)
+{
+	char *buffer = arenaStrdup(arena, inputLine);
+	struct TokenVector vec;
+
+	tokenize(arena, buffer, &vec);
+	return vec.count;
+}
+
+static void report(const char *name, int lines, long tokens, size_t bytes,
+		double secs)
+{
+	printf("%-14s %8d %12.0f %12.0f %10.1f\n", name, lines, lines / secs,
+			tokens / secs, bytes / secs / (1 << 20));
+}
+
+int main(int argc, char **argv)
+{
+	int numLines = 2000;
+	int numWords = 4096;
+	char **lines;
+	char **scratch;
+	struct Arena arena;
+	size_t bytes = 0;
+	long tokens;
+	double start;
+	int opt;
+	int i, j;
+
+	while ((opt = getopt(argc, argv, "n:w:")) != -1) {
+		if (opt == 'n')
+			numLines = atoi(optarg);
+		else if (opt == 'w')
+			numWords = atoi(optarg);
+		else {
+			fprintf(stderr, "usage: %s [-n lines] [-w words]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* plain words only, so every splitter sees the same tokens */
+	lines = malloc(sizeof(char *) * numLines);
+	for (i = 0; i < numLines; i++) {
+		size_t len = 0;
+
+		lines[i] = malloc(numWords * 24 + 1);
+		for (j = 0; j < numWords; j++)
+			len += sprintf(lines[i] + len, j ? " arg%d-%d" : "cmd%d",
+					j, i % 1000);
+		bytes += len + 1;
+	}
+	scratch = malloc(sizeof(char *) * (numWords + 1));
+	initArena(&arena, 4096);
+
+	printf("%-14s %8s %12s %12s %10s\n", "parser", "lines", "lines_sec",
+			"tokens_sec", "mb_sec");
+
+	tokens = 0;
+	start = now();
+	for (i = 0; i < numLines; i++)
+		tokens += strtokMalloc(lines[i], scratch);
+	report("strtok-malloc", numLines, tokens, bytes, now() - start);
+
+	tokens = 0;
+	start = now();
+	for (i = 0; i < numLines; i++) {
+		arenaReset(&arena);
+		tokens += strtokArena(&arena, lines[i], numWords);
+	}
+	report("strtok-arena", numLines, tokens, bytes, now() - start);
+
+	tokens = 0;
+	start = now();
+	for (i = 0; i < numLines; i++) {
+		arenaReset(&arena);
+		tokens += tokenizer(&arena, lines[i]);
+	}
+	report("tokenizer", numLines, tokens, bytes, now() - start);
+
+	freeArena(&arena);
+	return 0;
+}
@@ -6,35 +6,70 @@
 #include <ctype.h>
 
 #include "builtin.h"
+#include "complete.h"
+#include "coreutils.h"
+#include "dispatch.h"
+#include "events.h"
 #include "list.h"
+#include "hash.h"
+#include "histfile.h"
+#include "histindex.h"
+#include "history.h"
+#include "jobs.h"
+#include "memstat.h"
+#include "parallel.h"
+#include "pathindex.h"
+#include "pathwatch.h"
+#include "profile.h"
+#include "search.h"
+#include "timeout.h"
+#include "trace.h"
+#include "spawn.h"
+#include "uring.h"
+#include "zygote.h"
 
 struct List PATH;
-struct List HISTORY;
+struct Arena CMDARENA;
+int STATUS;
 
+/*
+ * Reports an error in a builtin, which then fails with status 1.
+ */
 void error(const char *err)
 {
 	printf("error: %s\n", err);
+	STATUS = 1;
 }
 
 /*
  * Runs the shell's built in exit function.
+ * The shell exits with status args[1], or with the status of the last
+ * command if none is given.
  */
-int runExit()
+int runExit(int argc, char * const args[])
 {
+	if (args[1] != NULL) {
+		if (args[1][0] == '\0' || !isNumber(args[1])) {
+			error("invalid argument provided");
+			return 1;
+		}
+		STATUS = atoi(args[1]) & 0xff;
+	} else {
+		STATUS = lastStatus();
+	}
+
 	return 0;
 }
 
 /*
- * Change directory to dir.
+ * Change directory to args[1].
  */
-int runCd(const char *dir)
+int runCd(int argc, char * const args[])
 {
-
-	if (dir == NULL)
-		error("Too few arguments given");
-
-	else if (chdir(dir) < 0)
+	if (chdir(args[1]) < 0)
 		error(strerror(errno));
+	else
+		searchChdir(&PATH);
 
 	return 1;
 }
@@ -70,6 +105,34 @@ void addToPath(const char *dir)
 
 	strcpy(temp, dir);
 	addNodeBack(&PATH, temp);
+	watchPathDir(temp);
+
+	/* earlier directories may now shadow remembered locations */
+	searchInvalidate();
+	hashClear();
+}
+
+/*
+ * Adds every directory of value, a colon-separated list in the format
+ * of the PATH environment variable, to the path list. Empty entries
+ * are skipped.
+ */
+void importPath(const char *value)
+{
+	while (value != NULL && *value != '\0') {
+		const char *end = strchr(value, ':');
+		size_t len = end != NULL ? end - value : strlen(value);
+
+		if (len > 0) {
+			char dir[len + 1];
+
+			memcpy(dir, value, len);
+			dir[len] = '\0';
+			addToPath(dir);
+		}
+
+		value = end != NULL ? end + 1 : NULL;
+	}
 }
 
 /*
@@ -91,9 +154,14 @@ void removeFromPath(const char *dir)
 			break;
 
 		char *temp = removeNode(&PATH, remv);
-		if (temp != NULL)
+		if (temp != NULL) {
+			unwatchPathDir(temp);
 			free(temp);
+		}
 	}
+
+	searchInvalidate();
+	hashClear();
 }
 
 /*
@@ -101,8 +169,10 @@ void removeFromPath(const char *dir)
  * If no action is provided, the entire path is printed.
  * If a +/- action is proved, dir is added/deleted from the path list.
  */
-int runPath(const char *action, const char *dir)
+int runPath(int argc, char * const args[])
 {
+	const char *action = args[1];
+	const char *dir = action ? args[2] : NULL;
 
 	if (action == NULL && dir == NULL) {
 		printPath();
@@ -122,26 +192,291 @@ int runPath(const char *action, const char *dir)
 }
 
 /*
- * Adds cmd to the history list.
- * If the number of commands saved is is more than MAXHISTORY,
- * the oldest command is removed.
+ * Runs the builtin hash function.
+ * With no arguments the remembered command locations are printed.
+ * "hash -r" forgets every location, "hash -d name..." forgets the
+ * given names, and "hash name..." looks up and remembers each name.
  */
-int addToHistory(char *cmd)
+int runHash(int argc, char * const args[])
 {
+	int i;
 
-	if (numNodes(&HISTORY) >= MAXHISTORY) {
-		char *temp = (char *)remvNodeFront(&HISTORY);
-		free(temp);
+	if (args[1] == NULL) {
+		hashPrint();
+
+	} else if (strcmp(args[1], "-r") == 0) {
+		searchInvalidate();
+		hashClear();
+
+	} else if (strcmp(args[1], "-d") == 0) {
+		if (args[2] == NULL)
+			error("Too few arguments given");
+
+		for (i = 2; args[i] != NULL; i++) {
+			if (!hashRemove(args[i])) {
+				printf("hash: %s: not found\n", args[i]);
+				STATUS = 1;
+			}
+		}
+
+	} else {
+		for (i = 1; args[i] != NULL; i++) {
+			if (strchr(args[i], '/') != NULL)
+				continue;
+
+			struct HashEntry *entry = hashCommand(&PATH, args[i]);
+
+			if (entry == NULL || entry->path == NULL) {
+				printf("hash: %s: not found\n", args[i]);
+				STATUS = 1;
+			}
+		}
 	}
 
-	if (addNodeBack(&HISTORY, cmd) == NULL) {
-		error("malloc failed");
-		exit(EXIT_FAILURE);
+	return 1;
+}
+
+/*
+ * Runs the builtin spawn function.
+ * With no arguments the current process launch engine is printed,
+ * otherwise the named engine ("posix", "fork" or "zygote") is selected.
+ */
+int runSpawn(int argc, char * const args[])
+{
+	const char *mode = args[1];
+	enum SpawnMode newMode;
+
+	if (mode == NULL)
+		printf("%s\n", spawnModeName(getSpawnMode()));
+
+	else if (parseSpawnMode(mode, &newMode) < 0)
+		error("invalid argument provided");
+
+	else if (setSpawnMode(newMode) < 0)
+		error(strerror(errno));
+
+	return 1;
+}
+
+/*
+ * Looks up the job named by spec, either "%n" or a job number n.
+ * Returns NULL and reports an error if there is no such job.
+ */
+static struct Job *parseJobSpec(const char *spec)
+{
+	struct Job *job = NULL;
+
+	if (spec[0] == '%')
+		spec++;
+
+	if (*spec != '\0' && isNumber(spec))
+		job = findJob(atoi(spec));
+
+	if (job == NULL)
+		error("no such job");
+
+	return job;
+}
+
+/*
+ * Runs the builtin jobs function, listing every background job.
+ */
+int runJobs(int argc, char * const args[])
+{
+	printJobs();
+	return 1;
+}
+
+/*
+ * Runs the builtin wait function.
+ * With no arguments waits for every background job. Otherwise waits
+ * for each job given as "%n", or for the job containing each pid n.
+ */
+int runWait(int argc, char * const args[])
+{
+	int i;
+
+	if (args[1] == NULL) {
+		struct Job *job;
+
+		while ((job = firstJob()) != NULL) {
+			STATUS = exitStatus(waitJob(job));
+			removeJob(job);
+		}
+		return 1;
+	}
+
+	for (i = 1; args[i] != NULL; i++) {
+		struct Job *job;
+
+		if (args[i][0] == '%')
+			job = parseJobSpec(args[i]);
+
+		else if (!isNumber(args[i]) ||
+				(job = findJobByPid(atoi(args[i]))) == NULL) {
+			printf("wait: pid %s is not a child of this shell\n",
+					args[i]);
+			STATUS = 127;
+			continue;
+		}
+
+		if (job != NULL) {
+			STATUS = exitStatus(waitJob(job));
+			removeJob(job);
+		}
 	}
 
 	return 1;
 }
 
+/*
+ * Runs the builtin fg function.
+ * Waits in the foreground for the given job, or for the most recently
+ * started one if no job is given.
+ */
+int runFg(int argc, char * const args[])
+{
+	const char *spec = args[1];
+	struct Job *job;
+
+	if (spec != NULL) {
+		job = parseJobSpec(spec);
+	} else {
+		job = lastJob();
+		if (job == NULL)
+			error("no current job");
+	}
+
+	if (job == NULL)
+		return 1;
+
+	printf("%s\n", job->command);
+	STATUS = exitStatus(waitJob(job));
+	removeJob(job);
+
+	return 1;
+}
+
+/*
+ * Runs the builtin alloc function.
+ * Prints the per-command arena's counters and the number of calls the
+ * shell has made to malloc, calloc and realloc. "alloc -r" resets the
+ * counts, so a later "alloc" shows what the commands in between cost.
+ */
+int runAlloc(int argc, char * const args[])
+{
+	const char *arg = args[1];
+	struct MemStats stats;
+
+	if (arg != NULL && strcmp(arg, "-r") == 0) {
+		resetMemStats();
+		CMDARENA.chunkMallocs = 0;
+		CMDARENA.allocs = 0;
+		CMDARENA.resets = 0;
+		CMDARENA.peak = CMDARENA.inUse;
+		return 1;
+
+	} else if (arg != NULL) {
+		error("invalid argument provided");
+		return 1;
+	}
+
+	getMemStats(&stats);
+	printf("malloc calls:       %lu\n", stats.mallocs);
+	printf("calloc calls:       %lu\n", stats.callocs);
+	printf("realloc calls:      %lu\n", stats.reallocs);
+	printf("arena resets:       %lu\n", CMDARENA.resets);
+	printf("arena allocations:  %lu\n", CMDARENA.allocs);
+	printf("arena chunk allocs: %lu\n", CMDARENA.chunkMallocs);
+	printf("arena bytes in use: %zu\n", CMDARENA.inUse);
+	printf("arena peak bytes:   %zu\n", CMDARENA.peak);
+
+	return 1;
+}
+
+/*
+ * Runs the builtin profile function.
+ * With no arguments prints the latency table of every phase of the
+ * command loop. "profile on|off" starts or stops recording and
+ * "profile reset" clears what has been recorded.
+ */
+int runProfile(int argc, char * const args[])
+{
+	const char *arg = args[1];
+
+	if (arg == NULL)
+		profileReport();
+
+	else if (strcmp(arg, "on") == 0)
+		setProfiling(1);
+
+	else if (strcmp(arg, "off") == 0)
+		setProfiling(0);
+
+	else if (strcmp(arg, "reset") == 0)
+		profileReset();
+
+	else
+		error("invalid argument provided");
+
+	return 1;
+}
+
+/*
+ * Runs the builtin trace function.
+ * With no arguments prints how many launch events are recorded.
+ * "trace on|off" starts or stops recording, "trace clear" forgets the
+ * events and "trace dump file" writes them in Chrome trace format.
+ */
+int runTrace(int argc, char * const args[])
+{
+	const char *arg = args[1];
+
+	if (arg == NULL)
+		traceSummary();
+
+	else if (strcmp(arg, "on") == 0)
+		setTracing(1);
+
+	else if (strcmp(arg, "off") == 0)
+		setTracing(0);
+
+	else if (strcmp(arg, "clear") == 0)
+		traceClear();
+
+	else if (strcmp(arg, "dump") != 0)
+		error("invalid argument provided");
+
+	else if (args[2] == NULL)
+		error("Too few arguments given");
+
+	else if (traceDump(args[2]) < 0)
+		error(strerror(errno));
+
+	return 1;
+}
+
+/*
+ * Adds a copy of cmd to the history list.
+ * If the number of commands saved is is more than the history size,
+ * the oldest command is removed.
+ * Returns a pointer to the saved copy, or NULL if cmd could not be
+ * saved, which has been reported.
+ */
+char *addToHistory(const char *cmd)
+{
+	char *copy = historyAppend(cmd);
+	if (copy == NULL) {
+		/* the history file reports its own failures */
+		if (!historyFileOpen())
+			error("command too long for history");
+	} else {
+		indexHistory();
+	}
+
+	return copy;
+}
+
 /*
  * Tests wether testString is a number.
  * Returns 1 if yes, 0 if no.
@@ -162,92 +497,132 @@ int isNumber(const char *testString)
  * with the given index from the history list.
  * Returns NULL on failure.
  */
-char *getHistory(const char *index)
+const char *getHistory(const char *index)
 {
 	if (!isNumber(index)) {
 		error("invalid argument provided");
 		return NULL;
 	}
 
-	int idx = atoi(index);
-	struct Node *node = getNode(&HISTORY, idx - 1);
-	if (node == NULL) {
+	const char *cmd = historyEntry(atoi(index));
+	if (cmd == NULL) {
 		error("event not found");
 		return NULL;
 	}
 
-	return (char *)node->data;
+	return cmd;
 }
 
 /*
- * Prints a list of the all the commands in the history list.
+ * Runs the builtin history function.
+ * With no arguments every command in the history list is printed,
+ * "history n" prints the last n commands, "history -c" clears the
+ * list and "history -s [n]" prints or sets its size.
  */
-int runHistory()
+int runHistory(int argc, char * const args[])
 {
+	const char *arg = args[1];
+	const char *size = arg ? args[2] : NULL;
+	int first = 1;
+	int i;
 
-	int counter = 0;
-	struct Node *curNode = HISTORY.head;
+	if (arg == NULL) {
+		first = 1;
 
-	while (curNode != NULL) {
-		printf("[%d] %s\n", ++counter, (char *)curNode->data);
-		curNode = curNode->next;
-	}
+	} else if (strcmp(arg, "-c") == 0) {
+		if (historyFileOpen())
+			error("a shared history file cannot be cleared");
+		else
+			clearHistory();
+		clearHistoryIndex();
+		return 1;
 
-	return 1;
-}
+	} else if (strcmp(arg, "-s") == 0) {
+		if (size == NULL)
+			printf("%d\n", historySize());
+		else if (!isNumber(size) || setHistorySize(atoi(size)) < 0)
+			error("invalid history size");
+		else
+			clearHistoryIndex();
+		return 1;
 
-/*
- * Checks if cmd is a builtin command.
- * Returns 1 if it is, 0 if not.
- */
-int isBuiltin(const char *cmd)
-{
-	if (strcmp(cmd, "exit") == 0 ||
-		strcmp(cmd, "cd") == 0 ||
-		strcmp(cmd, "path") == 0 ||
-		strcmp(cmd, "history") == 0)
+	} else if (isNumber(arg)) {
+		first = historyCount() - atoi(arg) + 1;
+		if (first < 1)
+			first = 1;
 
+	} else {
+		error("invalid argument provided");
 		return 1;
+	}
 
-	return 0;
+	for (i = first; i <= historyCount(); i++)
+		printf("[%d] %s\n", i, historyEntry(i));
+
+	return 1;
 }
 
-/*
- * Executes builtin command cmd.
- * args is an array of char * providing arguments to the commands.
- * args[0] should be the name of the command.
- * Returns 1 if command has completed.
- * Returns 0 if the shell's exit command has been called.
- * Returns -1 if a fatal error ahs occured.
- */
-int executeBuiltin(const char *cmd, char * const args[])
+static const struct Builtin coreBuiltins[] = {
+	{ "exit",	runExit,	0, 1 },
+	{ "cd",		runCd,		1, 1 },
+	{ "path",	runPath,	0, 2 },
+	{ "history",	runHistory,	0, 2 },
+	{ "hash",	runHash,	0, ANYARGS },
+	{ "spawn",	runSpawn,	0, 1 },
+	{ "jobs",	runJobs,	0, 0 },
+	{ "wait",	runWait,	0, ANYARGS },
+	{ "fg",		runFg,		0, 1 },
+	{ "alloc",	runAlloc,	0, 1 },
+	{ "profile",	runProfile,	0, 1 },
+	{ "trace",	runTrace,	0, 2 },
+
+	/* utilities run in the shell, see coreutils.h */
+	{ "echo",	runEcho,	0, ANYARGS },
+	{ "true",	runTrue,	0, ANYARGS },
+	{ "false",	runFalse,	0, ANYARGS },
+	{ "test",	runTest,	0, ANYARGS },
+	{ "[",		runTest,	1, ANYARGS },
+	{ "printf",	runPrintf,	1, ANYARGS },
+	{ "cat",	runCat,		0, ANYARGS },
+
+	{ "parallel",	runParallel,	1, ANYARGS },
+	{ "timeout",	runTimeout,	2, ANYARGS },
+};
+
+static void completeBuiltin(const struct Builtin *builtin)
 {
-	if (strcmp(cmd, "exit") == 0)
-		return runExit();
-
-	else if (strcmp(cmd, "cd") == 0)
-		return runCd(args[1]);
-
-	else if (strcmp(cmd, "path") == 0)
-		return runPath(args[1], args[2]);
-
-	else if (strcmp(cmd, "history") == 0)
-		return runHistory();
-
-	return 1;
+	addCommandName(builtin->name);
 }
 
 void initLists()
 {
-	initList(&HISTORY);
 	initList(&PATH);
+	initJobs();
+	initArena(&CMDARENA, CMDARENASIZE);
+
+	registerBuiltins(coreBuiltins,
+			sizeof(coreBuiltins) / sizeof(coreBuiltins[0]));
+	forEachBuiltin(completeBuiltin);
 }
 
 void cleanup()
 {
-	traverseList(&HISTORY, *free);
-	removeAllNodes(&HISTORY);
+	clearHistoryIndex();
+	clearHistory();
+	closeHistoryFile();
 
 	traverseList(&PATH, *free);
 	removeAllNodes(&PATH);
+
+	closePathWatch();
+	searchInvalidate();
+	setPathIndexFile(NULL);
+	hashClear();
+	clearCompletions();
+	stopZygote();
+	cleanupJobs();
+	freeArena(&CMDARENA);
+	clearBuiltins();
+	closeUring();
+	closeEvents();
 }
@@ -1,43 +1,62 @@
 #ifndef _BUILTIN_H
 #define _BUILTIN_H_
 
+#include "arena.h"
 #include "list.h"
 
+/* Default number of commands kept in the history list */
 #define MAXHISTORY 100
 
+/* Initial size of the per-command arena */
+#define CMDARENASIZE 4096
+
 extern struct List PATH;
-extern struct List HISTORY;
 
 /*
- * Adds cmd to the history list.
- * If the number of commands saved is is more than MAXHISTORY,
+ * Owns the current command line, its tokens and argument arrays.
+ * Reset by the shell before each new command.
+ */
+extern struct Arena CMDARENA;
+
+/*
+ * Exit status of the last command, as in the "$?" of other shells.
+ * Builtins set it; 0 means success.
+ */
+extern int STATUS;
+
+/*
+ * Adds a copy of cmd to the history list.
+ * If the number of commands saved is is more than the history size,
  * the oldest command is removed.
+ * Returns a pointer to the saved copy, or NULL if cmd could not be
+ * saved, which has been reported.
  */
-int addToHistory(char *cmd);
+char *addToHistory(const char *cmd);
 
 /*
  * Returns a pointer to the command associated
  * with the given index from the history list.
  * Returns NULL on failure.
  */
-char *getHistory(const char *index);
+const char *getHistory(const char *index);
 
 /*
- * Checks if cmd is a builtin command.
- * Returns 1 if it is, 0 if not.
+ * Tests wether testString is a number.
+ * Returns 1 if yes, 0 if no.
  */
-int isBuiltin(const char *cmd);
+int isNumber(const char *testString);
 
 /*
- * Executes builtin command cmd.
- * args is an array of char * providing arguments to the commands.
- * args[0] should be the name of the command.
- * Returns 1 if command has completed.
- * Returns 0 if the shell's exit command has been called.
- * Returns -1 if a fatal error ahs occured.
+ * Adds every directory of value, a colon-separated list in the format
+ * of the PATH environment variable, to the path list. Empty entries
+ * are skipped.
  */
-int executeBuiltin(const char *cmd, char * const args[]);
+void importPath(const char *value);
 
+/*
+ * Creates the path list, job table and command arena, and registers
+ * the shell's own builtins.
+ */
 void initLists();
 
 void cleanup();
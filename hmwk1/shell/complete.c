@@ -0,0 +1,382 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "arena.h"
+#include "complete.h"
+#include "list.h"
+#include "pathindex.h"
+#include "search.h"
+#include "trie.h"
+#include "util.h"
+
+#define DIRENTBUFSIZE (32 * 1024)
+
+/* characters the tokenizer would split or interpret, escaped in words */
+#define SPECIALCHARS " \t\\'\"|;&<>"
+
+/* what getdents64() fills its buffer with */
+struct LinuxDirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/*
+ * The command names: builtins and other added names, and the executables
+ * of the path list. The trie is rebuilt when the index changes.
+ */
+static char **extraNames;
+static int numExtraNames;
+static struct Trie commands;
+static int commandsBuilt;
+static unsigned int commandsVersion;
+static const struct List *commandsPath;
+
+/* everything a completion returns, and the buffer for getdents64() */
+static struct Arena scratch;
+static int scratchReady;
+
+/*
+ * Adds name, e.g. a builtin, to the names completed as commands along
+ * with the executables of the path list.
+ */
+void addCommandName(const char *name)
+{
+	char **names = realloc(extraNames,
+			sizeof(*extraNames) * (numExtraNames + 1));
+
+	if (names == NULL)
+		errMalloc();
+	extraNames = names;
+
+	extraNames[numExtraNames] = strdup(name);
+	if (extraNames[numExtraNames] == NULL)
+		errMalloc();
+	numExtraNames++;
+
+	commandsBuilt = 0;
+}
+
+static void insertCommand(const char *name, void *arg)
+{
+	trieInsert(&commands, name);
+}
+
+/*
+ * Rebuilds the command trie if the executables may have changed.
+ */
+static void updateCommands(const struct List *path)
+{
+	int i;
+
+	if (commandsBuilt && commandsPath == path &&
+			commandsVersion == pathIndexVersion())
+		return;
+
+	if (commandsBuilt)
+		freeTrie(&commands);
+	else
+		initTrie(&commands);
+
+	for (i = 0; i < numExtraNames; i++)
+		trieInsert(&commands, extraNames[i]);
+	forEachExecutable(path, insertCommand, NULL);
+
+	/* read after the walk, which may have loaded the index */
+	commandsVersion = pathIndexVersion();
+	commandsPath = path;
+	commandsBuilt = 1;
+}
+
+/*
+ * Returns a copy of s with the characters in SPECIALCHARS escaped,
+ * followed by suffix.
+ */
+static char *escapeWord(const char *s, const char *suffix)
+{
+	char *copy = arenaAlloc(&scratch, 2 * strlen(s) + strlen(suffix) + 1);
+	char *d = copy;
+
+	for (; *s != '\0'; s++) {
+		if (strchr(SPECIALCHARS, *s) != NULL)
+			*d++ = '\\';
+		*d++ = *s;
+	}
+	strcpy(d, suffix);
+
+	return copy;
+}
+
+struct NameList {
+	const char **names;
+	unsigned int count;
+};
+
+static void listName(const char *name, void *arg)
+{
+	struct NameList *list = arg;
+
+	list->names[list->count++] = arenaStrdup(&scratch, name);
+}
+
+static void completeCommand(const struct List *path, const char *word,
+		int list, struct Completion *comp)
+{
+	char common[1024];
+
+	/* no name is that long, and common could not hold it */
+	if (strlen(word) >= sizeof(common) - 1)
+		return;
+
+	updateCommands(path);
+
+	comp->count = triePrefix(&commands, word, common, sizeof(common));
+	if (comp->count == 0)
+		return;
+
+	comp->insert = escapeWord(common + strlen(word),
+			comp->count == 1 ? " " : "");
+
+	if (list) {
+		struct NameList names;
+
+		names.names = arenaAlloc(&scratch, sizeof(char *) * MAXLISTED);
+		names.count = 0;
+		trieList(&commands, word, MAXLISTED, listName, &names);
+		comp->names = names.names;
+		comp->numNames = names.count;
+	}
+}
+
+/*
+ * The names in the directory completed last, kept while it is unchanged.
+ * Hidden names are kept only when they are asked for, in place of the
+ * others.
+ */
+static struct Trie files;
+static int filesBuilt;
+static char *filesDir;
+static int filesHidden;
+static struct stat filesStat;
+
+/*
+ * Fills the file trie with the names in dirFd, the directory dir, that
+ * are hidden or not. The entries are read in bulk with getdents64().
+ */
+static void readFiles(int dirFd, const char *dir, const struct stat *st,
+		int hidden)
+{
+	char *buf = arenaAlloc(&scratch, DIRENTBUFSIZE);
+	long n;
+
+	if (filesBuilt)
+		freeTrie(&files);
+	else
+		initTrie(&files);
+	free(filesDir);
+	filesDir = NULL;
+	filesBuilt = 0;
+
+	while ((n = syscall(SYS_getdents64, dirFd, buf, DIRENTBUFSIZE)) > 0) {
+		long off;
+
+		for (off = 0; off < n; ) {
+			struct LinuxDirent64 *ent =
+				(struct LinuxDirent64 *)(buf + off);
+			const char *name = ent->d_name;
+
+			off += ent->d_reclen;
+			if ((name[0] == '.') != hidden ||
+					strcmp(name, ".") == 0 ||
+					strcmp(name, "..") == 0)
+				continue;
+			trieInsert(&files, name);
+		}
+	}
+
+	filesDir = strdup(dir);
+	if (filesDir == NULL)
+		errMalloc();
+	filesHidden = hidden;
+	filesStat = *st;
+	filesBuilt = 1;
+}
+
+/*
+ * Returns 1 if the file trie holds the names of dir as it is now.
+ * A directory's modification time changes whenever a name is added to
+ * it or removed from it.
+ */
+static int filesCurrent(const char *dir, const struct stat *st, int hidden)
+{
+	return filesBuilt && filesHidden == hidden &&
+		strcmp(filesDir, dir) == 0 &&
+		filesStat.st_dev == st->st_dev &&
+		filesStat.st_ino == st->st_ino &&
+		filesStat.st_mtim.tv_sec == st->st_mtim.tv_sec &&
+		filesStat.st_mtim.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/*
+ * Completes word from the names in the directory it names, or in the
+ * current directory. Hidden names are candidates only after a ".".
+ */
+static void completeFile(const char *word, int list, struct Completion *comp)
+{
+	const char *slash = strrchr(word, '/');
+	const char *base = slash != NULL ? slash + 1 : word;
+	size_t len = slash == NULL ? 1 : slash == word ? 1 : slash - word;
+	char dir[len + 1];
+	char common[1024];
+	struct stat st;
+	int isDir;
+	int fd;
+
+	/* no name is that long, and common could not hold it */
+	if (strlen(base) >= sizeof(common) - 1)
+		return;
+
+	if (slash == NULL) {
+		strcpy(dir, ".");
+	} else {
+		memcpy(dir, word, len);
+		dir[len] = '\0';
+	}
+
+	fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return;
+	}
+	if (!filesCurrent(dir, &st, base[0] == '.'))
+		readFiles(fd, dir, &st, base[0] == '.');
+
+	comp->count = triePrefix(&files, base, common, sizeof(common));
+	if (comp->count == 0) {
+		close(fd);
+		return;
+	}
+
+	/* symbolic links to directories count as directories */
+	isDir = comp->count == 1 && fstatat(fd, common, &st, 0) == 0 &&
+		S_ISDIR(st.st_mode);
+	close(fd);
+
+	comp->insert = escapeWord(common + strlen(base), comp->count > 1 ? "" :
+			isDir ? "/" : " ");
+
+	if (list) {
+		struct NameList names;
+
+		names.names = arenaAlloc(&scratch, sizeof(char *) * MAXLISTED);
+		names.count = 0;
+		trieList(&files, base, MAXLISTED, listName, &names);
+		comp->names = names.names;
+		comp->numNames = names.count;
+	}
+}
+
+/*
+ * Returns 1 if the word starting at start in line is the first word of
+ * a command, 0 otherwise.
+ */
+static int isCommandWord(const char *line, size_t start)
+{
+	while (start > 0 && (line[start - 1] == ' ' || line[start - 1] == '\t'))
+		start--;
+
+	if (start == 0)
+		return 1;
+	if (line[start - 1] == '+')
+		return start >= 2 && line[start - 2] == '|';
+
+	return strchr("|;&", line[start - 1]) != NULL;
+}
+
+/*
+ * Completes the word that ends at cursor in line. The first word of a
+ * command is completed from the command names and the executables of
+ * path, unless it holds a "/"; other words are completed from the
+ * files of the directory they name, or of the current directory.
+ * With list set the candidates are returned as well.
+ * Returns the number of candidates.
+ */
+unsigned int completeLine(const struct List *path, const char *line,
+		size_t cursor, int list, struct Completion *comp)
+{
+	size_t start = cursor;
+	size_t i;
+	char *word;
+	char *w;
+
+	memset(comp, 0, sizeof(*comp));
+	comp->insert = "";
+
+	if (!scratchReady) {
+		initArena(&scratch, DIRENTBUFSIZE + 4096);
+		scratchReady = 1;
+	}
+	arenaReset(&scratch);
+
+	/* the word goes back to a blank or operator that is not escaped */
+	while (start > 0 && (strchr(SPECIALCHARS, line[start - 1]) == NULL ||
+				(start > 1 && line[start - 2] == '\\')))
+		start--;
+
+	/* quoted words are left alone; escapes are removed */
+	word = arenaAlloc(&scratch, cursor - start + 1);
+	for (i = start, w = word; i < cursor; i++) {
+		if (line[i] == '\'' || line[i] == '"')
+			return 0;
+		if (line[i] == '\\' && i + 1 < cursor)
+			i++;
+		*w++ = line[i];
+	}
+	*w = '\0';
+
+	if (isCommandWord(line, start) && strchr(word, '/') == NULL)
+		completeCommand(path, word, list, comp);
+	else
+		completeFile(word, list, comp);
+
+	return comp->count;
+}
+
+/*
+ * Releases the command names and everything completions use.
+ */
+void clearCompletions()
+{
+	int i;
+
+	for (i = 0; i < numExtraNames; i++)
+		free(extraNames[i]);
+	free(extraNames);
+	extraNames = NULL;
+	numExtraNames = 0;
+
+	if (commandsBuilt)
+		freeArena(&commands.arena);
+	commandsBuilt = 0;
+
+	if (filesBuilt)
+		freeArena(&files.arena);
+	filesBuilt = 0;
+	free(filesDir);
+	filesDir = NULL;
+
+	if (scratchReady)
+		freeArena(&scratch);
+	scratchReady = 0;
+}
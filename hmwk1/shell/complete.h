@@ -0,0 +1,47 @@
+#ifndef _COMPLETE_H_
+#define _COMPLETE_H_
+
+#include <stddef.h>
+
+#include "list.h"
+
+/* The most candidates a completion lists */
+#define MAXLISTED 1000
+
+/*
+ * The result of completing a word. insert is what to add at the cursor,
+ * escaped for the tokenizer; after the only candidate it ends with a
+ * space, or "/" for a directory. names holds the first MAXLISTED
+ * candidates in sorted order if they were asked for.
+ * The strings stay valid until the next completion.
+ */
+struct Completion {
+	const char *insert;
+	unsigned int count;
+	const char **names;
+	unsigned int numNames;
+};
+
+/*
+ * Adds name, e.g. a builtin, to the names completed as commands along
+ * with the executables of the path list.
+ */
+void addCommandName(const char *name);
+
+/*
+ * Completes the word that ends at cursor in line. The first word of a
+ * command is completed from the command names and the executables of
+ * path, unless it holds a "/"; other words are completed from the
+ * files of the directory they name, or of the current directory.
+ * With list set the candidates are returned as well.
+ * Returns the number of candidates.
+ */
+unsigned int completeLine(const struct List *path, const char *line,
+		size_t cursor, int list, struct Completion *comp);
+
+/*
+ * Releases the command names and everything completions use.
+ */
+void clearCompletions();
+
+#endif
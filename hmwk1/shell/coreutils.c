@@ -0,0 +1,812 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
+#include "builtin.h"
+#include "coreutils.h"
+#include "uring.h"
+
+/* largest amount handed to one copy_file_range() or sendfile() call */
+#define COPYCHUNK (1 << 30)
+#define COPYBUFSIZE (64 * 1024)
+
+/* longest printf conversion specification, e.g. "%-+#012.34lld" */
+#define MAXSPEC 32
+
+/*
+ * Prints a diagnostic for the utility name to stderr, like the
+ * programs these builtins stand in for.
+ */
+static void utilError(const char *name, const char *what, const char *why)
+{
+	fflush(stdout);
+	if (what != NULL)
+		fprintf(stderr, "%s: %s: %s\n", name, what, why);
+	else
+		fprintf(stderr, "%s: %s\n", name, why);
+}
+
+static int decodeEscape(const char *s, int inArg, char *c, int *stop);
+
+/*
+ * Returns 1 if arg is a group of echo options, such as "-n" or "-ne",
+ * 0 if it is to be printed.
+ */
+static int isEchoOption(const char *arg)
+{
+	return arg[0] == '-' && arg[1] != '\0' &&
+		strspn(arg + 1, "neE") == strlen(arg + 1);
+}
+
+/*
+ * Prints s with its backslash escapes decoded, as echo -e does.
+ * Returns 0, or -1 if output should stop (\c).
+ */
+static int echoEscaped(const char *s)
+{
+	int stop = 0;
+
+	while (*s && !stop) {
+		char c;
+
+		if (*s == '\\' && s[1] != '\0') {
+			s++;
+			s += decodeEscape(s, 1, &c, &stop);
+			if (!stop)
+				putchar(c);
+		} else {
+			putchar(*s++);
+		}
+	}
+
+	return stop ? -1 : 0;
+}
+
+int runEcho(int argc, char * const args[])
+{
+	int newline = 1;
+	int escapes = 0;
+	int first;
+	int i = 1;
+
+	for (; args[i] != NULL && isEchoOption(args[i]); i++) {
+		const char *opt;
+
+		for (opt = args[i] + 1; *opt; opt++) {
+			if (*opt == 'n')
+				newline = 0;
+			else
+				escapes = (*opt == 'e');
+		}
+	}
+
+	for (first = i; args[i] != NULL; i++) {
+		if (i > first)
+			putchar(' ');
+		if (!escapes)
+			fputs(args[i], stdout);
+		else if (echoEscaped(args[i]) < 0)
+			return 1;
+	}
+
+	if (newline)
+		putchar('\n');
+
+	return 1;
+}
+
+int runTrue(int argc, char * const args[])
+{
+	STATUS = 0;
+	return 1;
+}
+
+int runFalse(int argc, char * const args[])
+{
+	STATUS = 1;
+	return 1;
+}
+
+/*
+ * State of the test expression parser. args[pos..end) are the words
+ * not consumed yet.
+ */
+struct TestParser {
+	char * const *args;
+	int pos;
+	int end;
+	const char *error;
+};
+
+static int remaining(const struct TestParser *t)
+{
+	return t->end - t->pos;
+}
+
+static int isBinaryOp(const char *op)
+{
+	static const char *ops[] = {
+		"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt",
+		"-ge", "-nt", "-ot", "-ef", NULL
+	};
+	int i;
+
+	for (i = 0; ops[i] != NULL; i++) {
+		if (strcmp(op, ops[i]) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int isUnaryOp(const char *op)
+{
+	return op[0] == '-' && op[1] != '\0' && op[2] == '\0' &&
+			strchr("bcdefghLnprsStuwxz", op[1]) != NULL;
+}
+
+/*
+ * Parses s as a decimal integer, allowing surrounding blanks.
+ * Returns 0 on success, -1 (and sets t->error) if s is not one.
+ */
+static int testInteger(struct TestParser *t, const char *s, long long *value)
+{
+	char *end;
+
+	errno = 0;
+	*value = strtoll(s, &end, 10);
+	while (*end == ' ' || *end == '\t')
+		end++;
+
+	if (end == s || *end != '\0' || errno != 0) {
+		t->error = "integer expression expected";
+		return -1;
+	}
+
+	return 0;
+}
+
+static int testUnary(struct TestParser *t, char op, const char *arg)
+{
+	struct stat st;
+	int mode = 0;
+
+	switch (op) {
+	case 'n':
+		return arg[0] != '\0';
+	case 'z':
+		return arg[0] == '\0';
+	case 't': {
+		long long fd;
+
+		if (testInteger(t, arg, &fd) < 0)
+			return 0;
+		return isatty(fd);
+	}
+	case 'h':
+	case 'L':
+		return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+	case 'r':
+		mode = R_OK;
+		break;
+	case 'w':
+		mode = W_OK;
+		break;
+	case 'x':
+		mode = X_OK;
+		break;
+	}
+
+	if (mode != 0)
+		return faccessat(AT_FDCWD, arg, mode, AT_EACCESS) == 0;
+
+	if (stat(arg, &st) < 0)
+		return 0;
+
+	switch (op) {
+	case 'b':
+		return S_ISBLK(st.st_mode);
+	case 'c':
+		return S_ISCHR(st.st_mode);
+	case 'd':
+		return S_ISDIR(st.st_mode);
+	case 'f':
+		return S_ISREG(st.st_mode);
+	case 'g':
+		return (st.st_mode & S_ISGID) != 0;
+	case 'p':
+		return S_ISFIFO(st.st_mode);
+	case 's':
+		return st.st_size > 0;
+	case 'S':
+		return S_ISSOCK(st.st_mode);
+	case 'u':
+		return (st.st_mode & S_ISUID) != 0;
+	default:
+		/* -e */
+		return 1;
+	}
+}
+
+static int testFiles(const char *op, const char *left, const char *right)
+{
+	struct stat l, r;
+	int haveLeft = stat(left, &l) == 0;
+	int haveRight = stat(right, &r) == 0;
+
+	if (strcmp(op, "-ef") == 0)
+		return haveLeft && haveRight && l.st_dev == r.st_dev &&
+				l.st_ino == r.st_ino;
+
+	if (strcmp(op, "-ot") == 0)
+		return testFiles("-nt", right, left);
+
+	/* a missing file is older than any existing one */
+	if (!haveLeft)
+		return 0;
+	if (!haveRight)
+		return 1;
+
+	return l.st_mtim.tv_sec > r.st_mtim.tv_sec ||
+			(l.st_mtim.tv_sec == r.st_mtim.tv_sec &&
+			 l.st_mtim.tv_nsec > r.st_mtim.tv_nsec);
+}
+
+static int testBinary(struct TestParser *t, const char *left, const char *op,
+		const char *right)
+{
+	long long l, r;
+
+	if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+		return strcmp(left, right) == 0;
+	if (strcmp(op, "!=") == 0)
+		return strcmp(left, right) != 0;
+	if (strcmp(op, "<") == 0)
+		return strcmp(left, right) < 0;
+	if (strcmp(op, ">") == 0)
+		return strcmp(left, right) > 0;
+	if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 ||
+			strcmp(op, "-ef") == 0)
+		return testFiles(op, left, right);
+
+	if (testInteger(t, left, &l) < 0 || testInteger(t, right, &r) < 0)
+		return 0;
+
+	if (strcmp(op, "-eq") == 0)
+		return l == r;
+	if (strcmp(op, "-ne") == 0)
+		return l != r;
+	if (strcmp(op, "-lt") == 0)
+		return l < r;
+	if (strcmp(op, "-le") == 0)
+		return l <= r;
+	if (strcmp(op, "-gt") == 0)
+		return l > r;
+	return l >= r;
+}
+
+static int testOr(struct TestParser *t);
+
+/*
+ * primary: "(" or ")" | word binop word | unop word | word
+ * A binary operator in the second position wins over every other
+ * reading, as POSIX requires for three arguments.
+ */
+static int testPrimary(struct TestParser *t)
+{
+	char * const *a = t->args + t->pos;
+	int value;
+
+	if (remaining(t) <= 0) {
+		t->error = "argument expected";
+		return 0;
+	}
+
+	if (remaining(t) >= 3 && isBinaryOp(a[1])) {
+		t->pos += 3;
+		return testBinary(t, a[0], a[1], a[2]);
+	}
+
+	if (remaining(t) >= 2 && strcmp(a[0], "(") == 0) {
+		t->pos++;
+		value = testOr(t);
+		if (remaining(t) <= 0 || strcmp(t->args[t->pos], ")") != 0) {
+			if (t->error == NULL)
+				t->error = "')' expected";
+			return 0;
+		}
+		t->pos++;
+		return value;
+	}
+
+	if (remaining(t) >= 2 && isUnaryOp(a[0])) {
+		t->pos += 2;
+		return testUnary(t, a[0][1], a[1]);
+	}
+
+	t->pos++;
+	return a[0][0] != '\0';
+}
+
+static int testNot(struct TestParser *t)
+{
+	char * const *a = t->args + t->pos;
+
+	if (remaining(t) >= 2 && strcmp(a[0], "!") == 0 &&
+			!(remaining(t) >= 3 && isBinaryOp(a[1]))) {
+		t->pos++;
+		return !testNot(t);
+	}
+
+	return testPrimary(t);
+}
+
+static int testAnd(struct TestParser *t)
+{
+	int value = testNot(t);
+
+	while (t->error == NULL && remaining(t) > 0 &&
+			strcmp(t->args[t->pos], "-a") == 0) {
+		t->pos++;
+		value = testNot(t) && value;
+	}
+
+	return value;
+}
+
+static int testOr(struct TestParser *t)
+{
+	int value = testAnd(t);
+
+	while (t->error == NULL && remaining(t) > 0 &&
+			strcmp(t->args[t->pos], "-o") == 0) {
+		t->pos++;
+		value = testAnd(t) || value;
+	}
+
+	return value;
+}
+
+int runTest(int argc, char * const args[])
+{
+	struct TestParser t = { args, 1, argc, NULL };
+	int value;
+
+	if (strcmp(args[0], "[") == 0) {
+		if (strcmp(args[argc - 1], "]") != 0) {
+			utilError(args[0], NULL, "missing ']'");
+			STATUS = 2;
+			return 1;
+		}
+		t.end--;
+	}
+
+	/* no expression is false */
+	if (remaining(&t) == 0) {
+		STATUS = 1;
+		return 1;
+	}
+
+	value = testOr(&t);
+	if (t.error == NULL && remaining(&t) > 0)
+		t.error = "too many arguments";
+
+	if (t.error != NULL) {
+		utilError(args[0], NULL, t.error);
+		STATUS = 2;
+	} else {
+		STATUS = !value;
+	}
+
+	return 1;
+}
+
+/*
+ * Decodes the backslash escape at s (just after the backslash) into
+ * *c. In a %b argument (and for echo -e) octal escapes are written
+ * \0nnn, in a format \nnn, and \c (which sets *stop) ends all output.
+ * \xHH is one or two hexadecimal digits.
+ * Returns the number of characters consumed after the backslash.
+ */
+static int decodeEscape(const char *s, int inArg, char *c, int *stop)
+{
+	int len = 0;
+	int value = 0;
+
+	switch (*s) {
+	case 'a': *c = '\a'; return 1;
+	case 'b': *c = '\b'; return 1;
+	case 'e': *c = '\033'; return 1;
+	case 'f': *c = '\f'; return 1;
+	case 'n': *c = '\n'; return 1;
+	case 'r': *c = '\r'; return 1;
+	case 't': *c = '\t'; return 1;
+	case 'v': *c = '\v'; return 1;
+	case '\\': *c = '\\'; return 1;
+	case 'c':
+		if (inArg) {
+			*stop = 1;
+			return 1;
+		}
+		break;
+	}
+
+	if (*s == 'x' && isxdigit((unsigned char)s[1])) {
+		for (len = 1; len < 3 && isxdigit((unsigned char)s[len]); len++)
+			value = value * 16 + (isdigit((unsigned char)s[len]) ?
+					s[len] - '0' :
+					tolower((unsigned char)s[len]) - 'a' + 10);
+		*c = value;
+		return len;
+	}
+
+	if (inArg && *s == '0')
+		len = 1;
+	if (*s >= '0' && *s <= '7') {
+		int start = len;
+
+		while (len < start + 3 && s[len] >= '0' && s[len] <= '7')
+			value = value * 8 + s[len++] - '0';
+		*c = value;
+		return len;
+	}
+
+	/* not an escape: keep the backslash */
+	*c = '\\';
+	return 0;
+}
+
+/*
+ * Converts a printf numeric argument. A leading quote gives the value
+ * of the following character.
+ * Returns 0 on success, -1 after reporting an invalid number.
+ */
+static int printfNumber(const char *arg, int isSigned, long long *value)
+{
+	char *end;
+
+	if (arg[0] == '\'' || arg[0] == '"') {
+		*value = (unsigned char)arg[1];
+		return 0;
+	}
+
+	errno = 0;
+	if (isSigned)
+		*value = strtoll(arg, &end, 0);
+	else
+		*value = (long long)strtoull(arg, &end, 0);
+
+	if (*arg == '\0')
+		return 0;
+
+	if (end == arg || *end != '\0' || errno != 0) {
+		utilError("printf", arg, errno ? strerror(errno) :
+				"invalid number");
+		STATUS = 1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Converts a printf floating-point argument. A leading quote gives the
+ * value of the following character.
+ * Returns 0 on success, -1 after reporting an invalid number.
+ */
+static int printfDouble(const char *arg, double *value)
+{
+	char *end;
+
+	if (arg[0] == '\'' || arg[0] == '"') {
+		*value = (unsigned char)arg[1];
+		return 0;
+	}
+
+	errno = 0;
+	*value = strtod(arg, &end);
+
+	if (*arg == '\0')
+		return 0;
+
+	if (end == arg || *end != '\0') {
+		utilError("printf", arg, "invalid number");
+		STATUS = 1;
+		return -1;
+	}
+	if (errno != 0) {
+		utilError("printf", arg, strerror(errno));
+		STATUS = 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Prints one conversion. spec holds "%", the flags, width and
+ * precision; conv is the conversion character.
+ * Returns 0, or -1 if output should stop (\c in a %b argument).
+ */
+static int printfConversion(char *spec, size_t len, char conv,
+		const char *arg)
+{
+	long long value;
+	double real;
+	int stop = 0;
+
+	switch (conv) {
+	case 'd':
+	case 'i':
+		printfNumber(arg, 1, &value);
+		strcpy(spec + len, "lld");
+		printf(spec, value);
+		break;
+	case 'o':
+	case 'u':
+	case 'x':
+	case 'X':
+		printfNumber(arg, 0, &value);
+		snprintf(spec + len, 4, "ll%c", conv);
+		printf(spec, (unsigned long long)value);
+		break;
+	case 'f':
+	case 'F':
+	case 'e':
+	case 'E':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		printfDouble(arg, &real);
+		snprintf(spec + len, 2, "%c", conv);
+		printf(spec, real);
+		break;
+	case 'c': {
+		char c[2] = { arg[0], '\0' };
+
+		strcpy(spec + len, "s");
+		printf(spec, c);
+		break;
+	}
+	case 's':
+		strcpy(spec + len, "s");
+		printf(spec, arg);
+		break;
+	case 'b': {
+		char expanded[strlen(arg) + 1];
+		size_t n = 0;
+
+		while (*arg && !stop) {
+			if (*arg == '\\' && arg[1] != '\0') {
+				arg++;
+				arg += decodeEscape(arg, 1, &expanded[n++], &stop);
+				if (stop)
+					n--;
+			} else {
+				expanded[n++] = *arg++;
+			}
+		}
+		expanded[n] = '\0';
+
+		strcpy(spec + len, "s");
+		printf(spec, expanded);
+		break;
+	}
+	}
+
+	return stop ? -1 : 0;
+}
+
+int runPrintf(int argc, char * const args[])
+{
+	const char *format = args[1];
+	int next = 2;
+	int consumed;
+
+	do {
+		const char *p = format;
+
+		consumed = next;
+		while (*p) {
+			char spec[MAXSPEC + 4];
+			size_t len = 0;
+			int stop = 0;
+			char c;
+
+			if (*p == '\\' && p[1] != '\0') {
+				p++;
+				p += decodeEscape(p, 0, &c, &stop);
+				putchar(c);
+				continue;
+			}
+
+			if (*p != '%' || p[1] == '%') {
+				putchar(*p);
+				p += (*p == '%') ? 2 : 1;
+				continue;
+			}
+
+			spec[len++] = *p++;
+			while (*p && strchr("-+ #0", *p) && len < MAXSPEC)
+				spec[len++] = *p++;
+
+			/* width and precision, either given or taken from args */
+			while (*p && (strchr("0123456789.", *p) || *p == '*') &&
+					len < MAXSPEC) {
+				if (*p == '*') {
+					long long n = 0;
+
+					if (args[next] != NULL)
+						printfNumber(args[next++], 1, &n);
+					len += snprintf(spec + len, MAXSPEC - len, "%d",
+							(int)n);
+					if (len > MAXSPEC)
+						len = MAXSPEC;
+					p++;
+				} else {
+					spec[len++] = *p++;
+				}
+			}
+
+			/* length modifiers change nothing here */
+			while (*p && strchr("hlLqjzt", *p))
+				p++;
+
+			if (*p == '\0' || len >= MAXSPEC ||
+					!strchr("diouxXfFeEgGaAcsb", *p)) {
+				char what[2] = { *p, '\0' };
+
+				utilError("printf", *p ? what : "%",
+						"invalid conversion");
+				STATUS = 1;
+				return 1;
+			}
+
+			/* missing arguments are empty strings or zero */
+			if (printfConversion(spec, len, *p,
+						args[next] ? args[next] : "") < 0)
+				return 1;
+			if (args[next] != NULL)
+				next++;
+			p++;
+		}
+	} while (args[next] != NULL && next > consumed);
+
+	return 1;
+}
+
+/*
+ * Writes all len bytes of buf to fd.
+ * Returns 0 on success, -1 on failure.
+ */
+static int writeAll(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+enum CopyMethod { COPY_RANGE, COPY_SENDFILE, COPY_URING, COPY_READWRITE };
+
+/*
+ * Copies everything left in in to out, starting with the cheapest
+ * method the two file types allow and falling back when the kernel
+ * refuses it. Data the kernel cannot move by itself goes through
+ * io_uring (uring.c), or a read()/write() loop without it.
+ * Returns 0 on success, -1 if reading in failed and -2 if writing
+ * out failed.
+ */
+static int copyFd(int in, int out, const struct stat *inSt,
+		const struct stat *outSt)
+{
+	static char buf[COPYBUFSIZE];
+	enum CopyMethod method = COPY_URING;
+	ssize_t n;
+	int ret;
+
+	/* copy_file_range() wants two regular files, sendfile() an mmappable source */
+	if (S_ISREG(inSt->st_mode))
+		method = S_ISREG(outSt->st_mode) ? COPY_RANGE : COPY_SENDFILE;
+
+	while (1) {
+		if (method == COPY_RANGE) {
+			n = copy_file_range(in, NULL, out, NULL, COPYCHUNK, 0);
+			if (n < 0 && (errno == EXDEV || errno == EINVAL ||
+					errno == ENOSYS || errno == EOPNOTSUPP ||
+					errno == EBADF)) {
+				method = COPY_SENDFILE;
+				continue;
+			}
+		} else if (method == COPY_SENDFILE) {
+			n = sendfile(out, in, NULL, COPYCHUNK);
+			if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+				method = COPY_URING;
+				continue;
+			}
+		} else if (method == COPY_URING) {
+			ret = uringCopy(in, out);
+			if (ret <= 0)
+				return ret;
+			method = COPY_READWRITE;
+			continue;
+		} else {
+			n = read(in, buf, sizeof(buf));
+			if (n > 0 && writeAll(out, buf, n) < 0)
+				return -2;
+		}
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n == 0)
+			return 0;
+		if (n < 0)
+			return (errno == EPIPE || errno == ENOSPC ||
+					errno == EDQUOT) ? -2 : -1;
+	}
+}
+
+int runCat(int argc, char * const args[])
+{
+	struct stat inSt, outSt;
+	int i = 1;
+
+	/* anything already printed must come first */
+	fflush(stdout);
+
+	if (fstat(STDOUT_FILENO, &outSt) < 0) {
+		utilError("cat", "stdout", strerror(errno));
+		STATUS = 1;
+		return 1;
+	}
+
+	do {
+		const char *name = args[i] ? args[i] : "-";
+		int in = STDIN_FILENO;
+		int ret = -1;
+
+		if (strcmp(name, "-") != 0)
+			in = open(name, O_RDONLY | O_CLOEXEC);
+
+		if (in < 0 || fstat(in, &inSt) < 0) {
+			utilError("cat", name, strerror(errno));
+			STATUS = 1;
+
+		} else if (S_ISREG(inSt.st_mode) && S_ISREG(outSt.st_mode) &&
+				inSt.st_dev == outSt.st_dev &&
+				inSt.st_ino == outSt.st_ino) {
+			utilError("cat", name, "input file is output file");
+			STATUS = 1;
+
+		} else if ((ret = copyFd(in, STDOUT_FILENO, &inSt, &outSt)) < 0) {
+			utilError("cat", ret == -2 ? "write error" : name,
+					strerror(errno));
+			STATUS = 1;
+		}
+
+		if (in > STDIN_FILENO)
+			close(in);
+
+		/* no point in going on once stdout is gone */
+		if (ret == -2)
+			break;
+	} while (args[i] != NULL && args[++i] != NULL);
+
+	return 1;
+}
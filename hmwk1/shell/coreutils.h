@@ -0,0 +1,55 @@
+#ifndef _COREUTILS_H_
+#define _COREUTILS_H_
+
+/*
+ * In-process versions of the small utilities that scripts run most
+ * often. They behave like the programs of the same name: output goes
+ * to fd 1 (so redirections apply), diagnostics go to stderr, and the
+ * exit status is left in STATUS. See dispatch.h for the handler
+ * interface.
+ */
+
+/*
+ * echo [-neE] [string ...]
+ * Prints the strings separated by spaces, followed by a newline
+ * unless -n is given. With -e backslash escapes in the strings are
+ * decoded, as in printf's %b; -E turns that off again.
+ */
+int runEcho(int argc, char * const args[]);
+
+/*
+ * true / false
+ * Set the exit status to 0 / 1.
+ */
+int runTrue(int argc, char * const args[]);
+int runFalse(int argc, char * const args[]);
+
+/*
+ * test expression, [ expression ]
+ * Evaluates a POSIX test expression: the file tests -b -c -d -e -f
+ * -g -h -L -p -r -s -S -u -w -x, the string tests -n -z = != and the
+ * integer comparisons -eq -ne -lt -le -gt -ge, combined with ! -a -o
+ * and parentheses. The exit status is 0 if the expression is true, 1
+ * if it is false and 2 if it is malformed.
+ */
+int runTest(int argc, char * const args[]);
+
+/*
+ * printf format [argument ...]
+ * Formats the arguments like printf(3). Supports the conversions
+ * d i o u x X f F e E g G a A c s b and %%, with flags, width and
+ * precision (length modifiers are ignored), and the usual backslash
+ * escapes in format. The format is reused until every
+ * argument has been consumed.
+ */
+int runPrintf(int argc, char * const args[]);
+
+/*
+ * cat [file ...]
+ * Copies each file, or stdin for "-" or no files, to stdout.
+ * The data is moved by the kernel with copy_file_range() or sendfile()
+ * when the file types allow it, and with read() and write() otherwise.
+ */
+int runCat(int argc, char * const args[]);
+
+#endif
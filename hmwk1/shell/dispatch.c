@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "builtin.h"
+#include "dispatch.h"
+#include "spawn.h"
+#include "trace.h"
+#include "util.h"
+
+#define MINSLOTS 16
+#define MAXSEEDS 256
+
+/* every registered builtin, in registration order */
+static const struct Builtin **builtins;
+static int numBuiltins;
+static int maxBuiltins;
+
+/*
+ * The perfect hash: each registered name hashes with seed to its own
+ * slot, so a lookup is one hash and one comparison.
+ */
+static const struct Builtin **slots;
+static unsigned int slotMask;
+static unsigned int seed;
+
+/* STATUS as it was before the running builtin cleared it */
+static int previousStatus;
+
+/*
+ * FNV-1a hash of a NULL-terminated string, perturbed by seed.
+ */
+static unsigned int hashName(const char *s, unsigned int seed)
+{
+	unsigned int h = 2166136261u ^ (seed * 0x9e3779b9u);
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+
+	return h ^ (h >> 15);
+}
+
+/*
+ * Tries to place every builtin in numSlots slots with hash seed s.
+ * Returns 1 on success, 0 if two names collide.
+ */
+static int tryPlace(const struct Builtin **table, unsigned int numSlots,
+		unsigned int s)
+{
+	int i;
+
+	memset(table, 0, sizeof(*table) * numSlots);
+	for (i = 0; i < numBuiltins; i++) {
+		unsigned int slot = hashName(builtins[i]->name, s) &
+				(numSlots - 1);
+
+		if (table[slot] != NULL)
+			return 0;
+		table[slot] = builtins[i];
+	}
+
+	return 1;
+}
+
+/*
+ * Searches for a seed that gives every name its own slot, starting with
+ * at least twice as many slots as names and doubling them whenever
+ * MAXSEEDS seeds have failed.
+ */
+static void buildTable()
+{
+	unsigned int numSlots = MINSLOTS;
+	const struct Builtin **table;
+	unsigned int s;
+
+	while (numSlots < 2 * (unsigned int)numBuiltins)
+		numSlots *= 2;
+
+	while (1) {
+		table = malloc(sizeof(*table) * numSlots);
+		if (table == NULL)
+			errMalloc();
+
+		for (s = 0; s < MAXSEEDS; s++) {
+			if (tryPlace(table, numSlots, s)) {
+				free(slots);
+				slots = table;
+				slotMask = numSlots - 1;
+				seed = s;
+				return;
+			}
+		}
+
+		free(table);
+		numSlots *= 2;
+	}
+}
+
+/*
+ * Adds count builtins from table, which must stay valid for as long as
+ * the shell runs. A builtin with the name of one registered earlier
+ * replaces it. The perfect hash is rebuilt for the new set of names.
+ * Returns 0 on success, -1 if a name is NULL or empty.
+ */
+int registerBuiltins(const struct Builtin *table, int count)
+{
+	int i, j;
+
+	for (i = 0; i < count; i++) {
+		if (table[i].name == NULL || table[i].name[0] == '\0')
+			return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < numBuiltins; j++) {
+			if (strcmp(builtins[j]->name, table[i].name) == 0)
+				break;
+		}
+
+		if (j < numBuiltins) {
+			builtins[j] = &table[i];
+			continue;
+		}
+
+		if (numBuiltins == maxBuiltins) {
+			int newMax = maxBuiltins ? maxBuiltins * 2 : MINSLOTS;
+			const struct Builtin **temp = realloc(builtins,
+					sizeof(*temp) * newMax);
+
+			if (temp == NULL)
+				errMalloc();
+
+			builtins = temp;
+			maxBuiltins = newMax;
+		}
+		builtins[numBuiltins++] = &table[i];
+	}
+
+	buildTable();
+	return 0;
+}
+
+/*
+ * Returns the builtin called name, or NULL if there is none.
+ * Costs one hash and at most one string comparison.
+ */
+const struct Builtin *findBuiltin(const char *name)
+{
+	const struct Builtin *builtin;
+
+	if (slots == NULL)
+		return NULL;
+
+	builtin = slots[hashName(name, seed) & slotMask];
+	if (builtin == NULL || strcmp(builtin->name, name) != 0)
+		return NULL;
+
+	return builtin;
+}
+
+/*
+ * Checks the argument count of args against builtin and runs it.
+ * STATUS is cleared first, so a handler only sets it on failure.
+ * Returns what the handler returns, or 1 (with STATUS 2) if the count
+ * is wrong.
+ */
+int runBuiltin(const struct Builtin *builtin, char * const args[])
+{
+	int argc = 0;
+
+	while (args[argc] != NULL)
+		argc++;
+
+	previousStatus = STATUS;
+	STATUS = 0;
+
+	if (argc - 1 < builtin->minArgs) {
+		err("Too few arguments given");
+		STATUS = 2;
+		return 1;
+	}
+
+	if (builtin->maxArgs != ANYARGS && argc - 1 > builtin->maxArgs) {
+		err("Too many arguments given");
+		STATUS = 2;
+		return 1;
+	}
+
+	return builtin->handler(argc, args);
+}
+
+/*
+ * Returns the exit status of the command before the running builtin.
+ */
+int lastStatus()
+{
+	return previousStatus;
+}
+
+/*
+ * Runs builtin in a forked child with fds installed as its stdin,
+ * stdout and stderr (see spawnProcess()); every other descriptor is
+ * closed. The child exits with the builtin's status.
+ * Returns the pid of the child, or -1 with errno set on failure.
+ */
+pid_t spawnBuiltin(const struct Builtin *builtin, char * const args[],
+		const int fds[3])
+{
+	fflush(stdout);
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		if (installFds(fds) < 0)
+			_exit(EXIT_FAILURE);
+		closeInheritedFds();
+
+		runBuiltin(builtin, args);
+		if (fflush(stdout) == EOF)
+			STATUS = 1;
+		_exit(STATUS);
+	}
+
+	if (pid > 0)
+		traceStart(pid, args[0]);
+
+	return pid;
+}
+
+/*
+ * Calls fn for every registered builtin, in registration order.
+ */
+void forEachBuiltin(void (*fn)(const struct Builtin *builtin))
+{
+	int i;
+
+	for (i = 0; i < numBuiltins; i++)
+		fn(builtins[i]);
+}
+
+/*
+ * Forgets every registered builtin.
+ */
+void clearBuiltins()
+{
+	free(builtins);
+	free(slots);
+	builtins = NULL;
+	slots = NULL;
+	numBuiltins = 0;
+	maxBuiltins = 0;
+}
@@ -0,0 +1,75 @@
+#ifndef _DISPATCH_H_
+#define _DISPATCH_H_
+
+#include <sys/types.h>
+
+/* maxArgs value for builtins that take any number of arguments */
+#define ANYARGS -1
+
+/*
+ * Runs a builtin. argc counts args[0], the name of the command, and
+ * args is NULL-terminated.
+ * Returns 1 if the command has completed, 0 if the shell should exit,
+ * and -1 if a fatal error has occurred.
+ */
+typedef int (*BuiltinHandler)(int argc, char * const args[]);
+
+/*
+ * One entry of a builtin table. minArgs and maxArgs bound the number of
+ * arguments after the command name; runBuiltin() rejects any other
+ * count before calling handler.
+ */
+struct Builtin {
+	const char *name;
+	BuiltinHandler handler;
+	int minArgs;
+	int maxArgs;
+};
+
+/*
+ * Adds count builtins from table, which must stay valid for as long as
+ * the shell runs. A builtin with the name of one registered earlier
+ * replaces it. The perfect hash is rebuilt for the new set of names.
+ * Returns 0 on success, -1 if a name is NULL or empty.
+ */
+int registerBuiltins(const struct Builtin *table, int count);
+
+/*
+ * Returns the builtin called name, or NULL if there is none.
+ * Costs one hash and at most one string comparison.
+ */
+const struct Builtin *findBuiltin(const char *name);
+
+/*
+ * Checks the argument count of args against builtin and runs it.
+ * STATUS is cleared first, so a handler only sets it on failure.
+ * Returns what the handler returns, or 1 (with STATUS 2) if the count
+ * is wrong.
+ */
+int runBuiltin(const struct Builtin *builtin, char * const args[]);
+
+/*
+ * Returns the exit status of the command before the running builtin.
+ */
+int lastStatus();
+
+/*
+ * Runs builtin in a forked child with fds installed as its stdin,
+ * stdout and stderr (see spawnProcess()); every other descriptor is
+ * closed. The child exits with the builtin's status.
+ * Returns the pid of the child, or -1 with errno set on failure.
+ */
+pid_t spawnBuiltin(const struct Builtin *builtin, char * const args[],
+		const int fds[3]);
+
+/*
+ * Calls fn for every registered builtin, in registration order.
+ */
+void forEachBuiltin(void (*fn)(const struct Builtin *builtin));
+
+/*
+ * Forgets every registered builtin.
+ */
+void clearBuiltins();
+
+#endif
@@ -0,0 +1,469 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "events.h"
+#include "util.h"
+
+/* events taken from epoll at a time */
+#define MAXEVENTS 64
+
+/* signals read from the signalfd at a time */
+#define MAXSIGNALS 16
+
+/* the handler of a watched descriptor, indexed by descriptor */
+struct Watch {
+	FdHandler handler;
+	void *data;
+};
+
+static int epollFd = -1;
+static int signalFd = -1;
+static int timerFd = -1;
+
+static struct Watch *watches;
+static int numWatchSlots;
+
+static sigset_t watchedSignals;
+static SignalHandler signalHandlers[_NSIG];
+
+/* watched signals a forked child gets back, unblocked */
+static sigset_t stopSignals;
+
+static sigset_t origMask;
+static int haveOrigMask;
+
+/* running timers, the first to expire first */
+static struct Timer *timers;
+
+static void forgetLoop();
+
+/*
+ * A forked child closes its parent's loop at once, before it can close
+ * every inherited descriptor (closeInheritedFds()) and reuse their
+ * numbers.
+ */
+static void onFork()
+{
+	int sig;
+
+	forgetLoop();
+
+	/* the child's own signalfd is opened without these */
+	for (sig = 1; sig < _NSIG; sig++) {
+		if (sigismember(&stopSignals, sig)) {
+			sigdelset(&watchedSignals, sig);
+			signalHandlers[sig] = NULL;
+		}
+	}
+	sigprocmask(SIG_UNBLOCK, &stopSignals, NULL);
+	sigemptyset(&stopSignals);
+}
+
+/*
+ * Forgets the descriptors and timers of the loop. In a forked child
+ * the epoll instance is still its parent's, so nothing is removed from
+ * it, only closed.
+ */
+static void forgetLoop()
+{
+	struct Timer *timer;
+
+	if (epollFd >= 0)
+		close(epollFd);
+	if (signalFd >= 0)
+		close(signalFd);
+	if (timerFd >= 0)
+		close(timerFd);
+	epollFd = signalFd = timerFd = -1;
+
+	free(watches);
+	watches = NULL;
+	numWatchSlots = 0;
+
+	for (timer = timers; timer != NULL; timer = timer->next)
+		timer->running = 0;
+	timers = NULL;
+}
+
+static void captureMask()
+{
+	if (haveOrigMask)
+		return;
+
+	sigprocmask(SIG_BLOCK, NULL, &origMask);
+	sigemptyset(&watchedSignals);
+	sigemptyset(&stopSignals);
+	pthread_atfork(NULL, NULL, onFork);
+	haveOrigMask = 1;
+}
+
+static int addLoopFd(int fd)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static unsigned long long nowNs()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Arms the timerfd for the first timer, or disarms it if there is none.
+ */
+static void armTimer()
+{
+	struct itimerspec its;
+
+	if (timerFd < 0)
+		return;
+
+	memset(&its, 0, sizeof(its));
+	if (timers != NULL) {
+		its.it_value.tv_sec = timers->deadline / 1000000000ULL;
+		its.it_value.tv_nsec = timers->deadline % 1000000000ULL;
+	}
+	timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/*
+ * Creates the epoll instance, the signalfd and the timerfd, unless they
+ * are open already.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+static int openLoop()
+{
+	if (epollFd >= 0)
+		return 0;
+
+	captureMask();
+
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	signalFd = signalfd(-1, &watchedSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+	timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (epollFd < 0 || signalFd < 0 || timerFd < 0 ||
+			addLoopFd(signalFd) < 0 || addLoopFd(timerFd) < 0) {
+		int saved = errno;
+
+		forgetLoop();
+		errno = saved;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Calls handler when fd has any of events. A descriptor can be watched
+ * once.
+ * Returns 0 on success, -1 with errno set on failure; EPERM if fd is a
+ * regular file, which is always ready.
+ */
+int watchFd(int fd, unsigned int events, FdHandler handler, void *data)
+{
+	struct epoll_event ev;
+
+	if (openLoop() < 0)
+		return -1;
+
+	if (fd >= numWatchSlots) {
+		int size = numWatchSlots ? numWatchSlots : 64;
+		struct Watch *grown;
+
+		while (size <= fd)
+			size *= 2;
+		grown = realloc(watches, sizeof(*watches) * size);
+		if (grown == NULL)
+			errMalloc();
+		memset(grown + numWatchSlots, 0,
+				sizeof(*watches) * (size - numWatchSlots));
+		watches = grown;
+		numWatchSlots = size;
+	}
+
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		return -1;
+
+	watches[fd].handler = handler;
+	watches[fd].data = data;
+	return 0;
+}
+
+/*
+ * Changes the events watched on fd; 0 pauses it.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+int changeFd(int fd, unsigned int events)
+{
+	struct epoll_event ev;
+
+	if (epollFd < 0 || fd >= numWatchSlots || watches[fd].handler == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	ev.events = events;
+	ev.data.fd = fd;
+	return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+/*
+ * Stops watching fd. Must be called before fd is closed.
+ */
+void unwatchFd(int fd)
+{
+	if (epollFd < 0 || fd >= numWatchSlots || watches[fd].handler == NULL)
+		return;
+
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+	watches[fd].handler = NULL;
+	watches[fd].data = NULL;
+}
+
+/*
+ * Blocks sig and calls handler whenever it is received.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+int watchSignal(int sig, SignalHandler handler)
+{
+	sigset_t set;
+
+	if (sig <= 0 || sig >= _NSIG) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (openLoop() < 0)
+		return -1;
+
+	sigemptyset(&set);
+	sigaddset(&set, sig);
+	sigaddset(&watchedSignals, sig);
+	signalHandlers[sig] = handler;
+
+	/* blocked first, so it cannot be delivered the old way meanwhile */
+	sigprocmask(SIG_BLOCK, &set, NULL);
+	if (signalfd(signalFd, &watchedSignals, 0) < 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Like watchSignal(), for a signal that stops the shell. A forked child
+ * stops watching it, and gets it back unblocked, so it stops the child
+ * as it would if the shell did not watch it.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+int watchStopSignal(int sig, SignalHandler handler)
+{
+	if (watchSignal(sig, handler) < 0)
+		return -1;
+
+	/* one blocked when the shell started stays blocked */
+	if (!sigismember(&origMask, sig))
+		sigaddset(&stopSignals, sig);
+
+	return 0;
+}
+
+/*
+ * Starts timer, which calls handler once seconds from now. A timer
+ * already running is restarted.
+ */
+void startTimer(struct Timer *timer, double seconds, TimerHandler handler,
+		void *data)
+{
+	struct Timer **p;
+	struct Timer *prev = NULL;
+
+	stopTimer(timer);
+	if (openLoop() < 0)
+		return;
+
+	timer->deadline = nowNs() + (unsigned long long)(seconds * 1e9);
+	timer->handler = handler;
+	timer->data = data;
+	timer->running = 1;
+
+	for (p = &timers; *p != NULL && (*p)->deadline <= timer->deadline;
+			p = &(*p)->next)
+		prev = *p;
+
+	timer->prev = prev;
+	timer->next = *p;
+	if (*p != NULL)
+		(*p)->prev = timer;
+	*p = timer;
+
+	if (timers == timer)
+		armTimer();
+}
+
+/*
+ * Stops timer if it is running.
+ */
+void stopTimer(struct Timer *timer)
+{
+	int first;
+
+	if (!timer->running)
+		return;
+
+	first = (timer == timers);
+	timer->running = 0;
+	if (timer->prev != NULL)
+		timer->prev->next = timer->next;
+	else
+		timers = timer->next;
+	if (timer->next != NULL)
+		timer->next->prev = timer->prev;
+
+	if (first)
+		armTimer();
+}
+
+/*
+ * Calls the handler of every watched signal received.
+ */
+static void handleSignals()
+{
+	struct signalfd_siginfo info[MAXSIGNALS];
+	ssize_t n;
+	int i;
+
+	while ((n = read(signalFd, info, sizeof(info))) > 0) {
+		for (i = 0; i < n / (ssize_t)sizeof(*info); i++) {
+			unsigned int sig = info[i].ssi_signo;
+
+			if (sig < _NSIG && signalHandlers[sig] != NULL)
+				signalHandlers[sig](sig);
+		}
+	}
+}
+
+/*
+ * Calls the handler of every timer that has expired.
+ */
+static void handleTimers()
+{
+	uint64_t expirations;
+	unsigned long long now = nowNs();
+
+	if (read(timerFd, &expirations, sizeof(expirations)) < 0 &&
+			errno != EAGAIN)
+		return;
+
+	while (timers != NULL && timers->deadline <= now) {
+		struct Timer *timer = timers;
+
+		timers = timer->next;
+		if (timers != NULL)
+			timers->prev = NULL;
+		timer->running = 0;
+		timer->next = NULL;
+
+		timer->handler(timer);
+	}
+
+	armTimer();
+}
+
+/*
+ * Waits up to timeout milliseconds (forever if -1, not at all if 0) for
+ * events, and calls the handlers of every one that has occurred.
+ * Returns the number of events handled, or -1 if the wait failed or
+ * was interrupted by a signal that is not watched.
+ */
+int runEvents(int timeout)
+{
+	struct epoll_event events[MAXEVENTS];
+	int n;
+	int i;
+
+	if (openLoop() < 0)
+		return -1;
+
+	n = epoll_wait(epollFd, events, MAXEVENTS, timeout);
+	for (i = 0; i < n; i++) {
+		int fd = events[i].data.fd;
+
+		if (fd == signalFd)
+			handleSignals();
+		else if (fd == timerFd)
+			handleTimers();
+		/* an earlier handler may have stopped watching it */
+		else if (fd < numWatchSlots && watches[fd].handler != NULL)
+			watches[fd].handler(fd, events[i].events,
+					watches[fd].data);
+	}
+
+	return n;
+}
+
+static void onReadable(int fd, unsigned int events, void *data)
+{
+	*(int *)data = 1;
+}
+
+/*
+ * Handles events until fd can be read without blocking, or is at end
+ * of file. Returns at once if fd cannot be watched, e.g. if it is a
+ * regular file.
+ */
+void waitReadable(int fd)
+{
+	int ready = 0;
+
+	if (watchFd(fd, EPOLLIN, onReadable, &ready) < 0)
+		return;
+
+	/* a handler of another signal is no reason to stop waiting */
+	while (!ready && (runEvents(-1) >= 0 || errno == EINTR))
+		;
+
+	/* left watched, it would wake every later wait while input waits */
+	unwatchFd(fd);
+}
+
+/*
+ * Returns the signal mask the shell started with, which processes it
+ * starts must get back.
+ */
+const sigset_t *originalSignalMask()
+{
+	captureMask();
+	return &origMask;
+}
+
+/*
+ * Closes the loop. Watched signals are unblocked.
+ */
+void closeEvents()
+{
+	if (haveOrigMask)
+		sigprocmask(SIG_SETMASK, &origMask, NULL);
+
+	forgetLoop();
+	sigemptyset(&watchedSignals);
+	sigemptyset(&stopSignals);
+	memset(signalHandlers, 0, sizeof(signalHandlers));
+}
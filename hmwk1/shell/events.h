@@ -0,0 +1,122 @@
+#ifndef _EVENTS_H_
+#define _EVENTS_H_
+
+#include <signal.h>
+
+/*
+ * The shell's event loop: one epoll instance that every wait in the
+ * shell goes through, whether for input, for children or for time.
+ *
+ * Signals that are watched are blocked and read from a signalfd, so
+ * one arriving between checking for work and going to sleep is never
+ * missed, and no handler runs in the middle of other code. Timers are
+ * kept in order of expiry, with the first one armed on a timerfd.
+ * Descriptors are watched level-triggered.
+ *
+ * A child forked from the shell starts with an empty loop: it keeps the
+ * watched signals, except those watched with watchStopSignal(), but not
+ * the descriptors and timers of its parent.
+ */
+
+/*
+ * Called with the epoll events (EPOLLIN, ...) that occurred on fd.
+ */
+typedef void (*FdHandler)(int fd, unsigned int events, void *data);
+
+/*
+ * Called when the watched signal sig has been received.
+ */
+typedef void (*SignalHandler)(int sig);
+
+struct Timer;
+
+/*
+ * Called when timer expires. It may start the timer again.
+ */
+typedef void (*TimerHandler)(struct Timer *timer);
+
+/*
+ * A timer, owned by whoever starts it. It must be stopped before it is
+ * freed or goes out of scope.
+ */
+struct Timer {
+	unsigned long long deadline;
+	TimerHandler handler;
+	void *data;
+	int running;
+	struct Timer *next;
+	struct Timer *prev;
+};
+
+/*
+ * Calls handler when fd has any of events. A descriptor can be watched
+ * once.
+ * Returns 0 on success, -1 with errno set on failure; EPERM if fd is a
+ * regular file, which is always ready.
+ */
+int watchFd(int fd, unsigned int events, FdHandler handler, void *data);
+
+/*
+ * Changes the events watched on fd; 0 pauses it.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+int changeFd(int fd, unsigned int events);
+
+/*
+ * Stops watching fd. Must be called before fd is closed.
+ */
+void unwatchFd(int fd);
+
+/*
+ * Blocks sig and calls handler whenever it is received.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+int watchSignal(int sig, SignalHandler handler);
+
+/*
+ * Like watchSignal(), for a signal that stops the shell. A forked child
+ * stops watching it, and gets it back unblocked, so it stops the child
+ * as it would if the shell did not watch it.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+int watchStopSignal(int sig, SignalHandler handler);
+
+/*
+ * Starts timer, which calls handler once seconds from now. A timer
+ * already running is restarted.
+ */
+void startTimer(struct Timer *timer, double seconds, TimerHandler handler,
+		void *data);
+
+/*
+ * Stops timer if it is running.
+ */
+void stopTimer(struct Timer *timer);
+
+/*
+ * Waits up to timeout milliseconds (forever if -1, not at all if 0) for
+ * events, and calls the handlers of every one that has occurred.
+ * Returns the number of events handled, or -1 if the wait failed or
+ * was interrupted by a signal that is not watched.
+ */
+int runEvents(int timeout);
+
+/*
+ * Handles events until fd can be read without blocking, or is at end
+ * of file. Returns at once if fd cannot be watched, e.g. if it is a
+ * regular file.
+ */
+void waitReadable(int fd);
+
+/*
+ * Returns the signal mask the shell started with, which processes it
+ * starts must get back.
+ */
+const sigset_t *originalSignalMask();
+
+/*
+ * Closes the loop. Watched signals are unblocked.
+ */
+void closeEvents();
+
+#endif
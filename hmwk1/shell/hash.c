@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "util.h"
+
+#define HASHINITSIZE 64
+
+static struct HashEntry **table;
+static unsigned int tableSize;
+static unsigned int numEntries;
+
+/*
+ * FNV-1a hash of a NULL-terminated string.
+ */
+static unsigned int hashString(const char *s)
+{
+	unsigned int h = 2166136261u;
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+/*
+ * Doubles the number of buckets and rehashes every entry.
+ * The table is created on first use.
+ */
+static void growTable()
+{
+	unsigned int newSize = tableSize ? tableSize * 2 : HASHINITSIZE;
+	struct HashEntry **newTable = calloc(newSize, sizeof(*newTable));
+	unsigned int i;
+
+	if (newTable == NULL)
+		errMalloc();
+
+	for (i = 0; i < tableSize; i++) {
+		struct HashEntry *cur = table[i];
+
+		while (cur != NULL) {
+			struct HashEntry *next = cur->next;
+			unsigned int b = hashString(cur->name) & (newSize - 1);
+
+			cur->next = newTable[b];
+			newTable[b] = cur;
+			cur = next;
+		}
+	}
+
+	free(table);
+	table = newTable;
+	tableSize = newSize;
+}
+
+static void freeEntry(struct HashEntry *entry)
+{
+	free(entry->name);
+	free(entry->path);
+	free(entry);
+}
+
+static char *copyString(const char *s)
+{
+	char *copy;
+
+	if (s == NULL)
+		return NULL;
+
+	copy = malloc(strlen(s) + 1);
+	if (copy == NULL)
+		errMalloc();
+
+	strcpy(copy, s);
+	return copy;
+}
+
+/*
+ * Returns the entry remembered for name.
+ * Returns NULL if name has not been hashed.
+ */
+struct HashEntry *hashFind(const char *name)
+{
+	struct HashEntry *cur;
+
+	if (tableSize == 0)
+		return NULL;
+
+	cur = table[hashString(name) & (tableSize - 1)];
+	while (cur != NULL) {
+		if (strcmp(cur->name, name) == 0)
+			return cur;
+		cur = cur->next;
+	}
+
+	return NULL;
+}
+
+/*
+ * Remembers that name resolves to path.
+ * A NULL path records that name could not be found.
+ * Any previous entry for name is replaced.
+ */
+struct HashEntry *hashInsert(const char *name, const char *path)
+{
+	struct HashEntry *entry = hashFind(name);
+	unsigned int b;
+
+	if (entry != NULL) {
+		free(entry->path);
+		entry->path = copyString(path);
+		entry->hits = 0;
+		return entry;
+	}
+
+	/* keep the load factor at or below 1 */
+	if (numEntries >= tableSize)
+		growTable();
+
+	entry = malloc(sizeof(*entry));
+	if (entry == NULL)
+		errMalloc();
+
+	entry->name = copyString(name);
+	entry->path = copyString(path);
+	entry->hits = 0;
+
+	b = hashString(name) & (tableSize - 1);
+	entry->next = table[b];
+	table[b] = entry;
+	numEntries++;
+
+	return entry;
+}
+
+/*
+ * Forgets the entry for name.
+ * Returns 1 if an entry was removed, 0 if name was not hashed.
+ */
+int hashRemove(const char *name)
+{
+	struct HashEntry **link;
+
+	if (tableSize == 0)
+		return 0;
+
+	link = &table[hashString(name) & (tableSize - 1)];
+	while (*link != NULL) {
+		struct HashEntry *cur = *link;
+
+		if (strcmp(cur->name, name) == 0) {
+			*link = cur->next;
+			freeEntry(cur);
+			numEntries--;
+			return 1;
+		}
+		link = &cur->next;
+	}
+
+	return 0;
+}
+
+/*
+ * Forgets every remembered location.
+ */
+void hashClear()
+{
+	unsigned int i;
+
+	for (i = 0; i < tableSize; i++) {
+		struct HashEntry *cur = table[i];
+
+		while (cur != NULL) {
+			struct HashEntry *next = cur->next;
+
+			freeEntry(cur);
+			cur = next;
+		}
+	}
+
+	free(table);
+	table = NULL;
+	tableSize = 0;
+	numEntries = 0;
+}
+
+/*
+ * Prints the hit count and location of every positive entry.
+ */
+void hashPrint()
+{
+	unsigned int i;
+	int header = 0;
+
+	for (i = 0; i < tableSize; i++) {
+		struct HashEntry *cur;
+
+		for (cur = table[i]; cur != NULL; cur = cur->next) {
+			if (cur->path == NULL)
+				continue;
+
+			if (!header) {
+				printf("hits\tcommand\n");
+				header = 1;
+			}
+			printf("%4u\t%s\n", cur->hits, cur->path);
+		}
+	}
+
+	if (!header)
+		printf("hash table empty\n");
+}
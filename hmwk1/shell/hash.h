@@ -0,0 +1,46 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+
+/*
+ * Remembered command locations, in the style of the bash "hash" table.
+ * Each entry maps a command name to the full path it resolved to.
+ * An entry with a NULL path records that the name was not found in
+ * the path list (negative cache).
+ */
+struct HashEntry {
+	char *name;
+	char *path;
+	unsigned int hits;
+	struct HashEntry *next;
+};
+
+/*
+ * Returns the entry remembered for name.
+ * Returns NULL if name has not been hashed.
+ */
+struct HashEntry *hashFind(const char *name);
+
+/*
+ * Remembers that name resolves to path.
+ * A NULL path records that name could not be found.
+ * Any previous entry for name is replaced.
+ */
+struct HashEntry *hashInsert(const char *name, const char *path);
+
+/*
+ * Forgets the entry for name.
+ * Returns 1 if an entry was removed, 0 if name was not hashed.
+ */
+int hashRemove(const char *name);
+
+/*
+ * Forgets every remembered location.
+ */
+void hashClear();
+
+/*
+ * Prints the hit count and location of every positive entry.
+ */
+void hashPrint();
+
+#endif
@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include "histfile.h"
+#include "util.h"
+
+#define HISTFILEMAGIC "W4118HST"
+#define HISTFILEVERSION 1
+
+/* The file grows in chunks; the mapping covers the largest allowed size */
+#define HISTFILECHUNK (1024 * 1024)
+#define HISTFILEMAX (1ULL << 30)
+
+struct HistFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t pad;
+	uint64_t tail;
+};
+
+/*
+ * A shell claims the record at the tail by storing its size and state
+ * in one compare-and-swap, then moves the tail past it, so every record
+ * below the tail has its size even if its writer is killed. state is
+ * RECORDWRITING with the writer's pid above the low bits while the text
+ * is written, then RECORDDONE. A record whose writer died first is
+ * marked RECORDSKIP by the next shell to scan it. The text follows the
+ * record header, NUL-terminated and padded to a multiple of 8 bytes.
+ */
+struct HistRecord {
+	uint32_t size;
+	uint32_t state;
+};
+
+/* a record's header as the one word it is claimed with */
+union RecordWord {
+	struct HistRecord rec;
+	uint64_t word;
+};
+
+#define RECORDDONE 1
+#define RECORDSKIP 2
+#define RECORDWRITING 3
+#define RECORDSTATEBITS 2
+#define RECORDSTATEMASK 3
+
+static int histFd = -1;
+static char *map;
+static uint64_t fileSize;
+
+/* offsets of the complete records seen so far, oldest first */
+static uint64_t *offsets;
+static int numOffsets;
+static int maxOffsets;
+static uint64_t scanPos = sizeof(struct HistFileHeader);
+
+static struct HistFileHeader *header()
+{
+	return (struct HistFileHeader *)map;
+}
+
+/*
+ * Makes sure the file is at least size bytes long.
+ * Other shells may be growing it too, so the check and the
+ * ftruncate() are done under an exclusive lock.
+ * Returns 0 on success, -1 on failure.
+ */
+static int growFile(uint64_t size)
+{
+	struct stat st;
+	int ret = 0;
+
+	if (size <= fileSize)
+		return 0;
+
+	flock(histFd, LOCK_EX);
+	if (fstat(histFd, &st) < 0) {
+		ret = -1;
+	} else if ((uint64_t)st.st_size < size) {
+		uint64_t newSize = (size + HISTFILECHUNK - 1) / HISTFILECHUNK *
+				HISTFILECHUNK;
+
+		if (ftruncate(histFd, newSize) < 0)
+			ret = -1;
+		else
+			st.st_size = newSize;
+	}
+	flock(histFd, LOCK_UN);
+
+	if (ret == 0)
+		fileSize = st.st_size;
+
+	return ret;
+}
+
+/*
+ * Refreshes the known size of the file, which other shells may have
+ * grown. Only bytes below fileSize may be touched through the mapping.
+ */
+static void refreshFileSize()
+{
+	struct stat st;
+
+	if (fstat(histFd, &st) == 0)
+		fileSize = st.st_size;
+}
+
+/*
+ * Opens (creating if needed) the history file at path and maps it.
+ * Returns 0 on success, -1 on failure.
+ */
+int openHistoryFile(const char *path)
+{
+	struct stat st;
+
+	closeHistoryFile();
+
+	histFd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (histFd < 0)
+		return -1;
+
+	map = mmap(NULL, HISTFILEMAX, PROT_READ | PROT_WRITE, MAP_SHARED,
+			histFd, 0);
+	if (map == MAP_FAILED) {
+		map = NULL;
+		closeHistoryFile();
+		return -1;
+	}
+
+	/* the first shell to get the lock writes the header */
+	flock(histFd, LOCK_EX);
+	if (fstat(histFd, &st) < 0 || (st.st_size == 0 &&
+				ftruncate(histFd, HISTFILECHUNK) < 0)) {
+		flock(histFd, LOCK_UN);
+		closeHistoryFile();
+		return -1;
+	}
+
+	if (st.st_size == 0) {
+		memcpy(header()->magic, HISTFILEMAGIC, sizeof(header()->magic));
+		header()->version = HISTFILEVERSION;
+		header()->tail = sizeof(struct HistFileHeader);
+	}
+	flock(histFd, LOCK_UN);
+
+	refreshFileSize();
+	if (fileSize < sizeof(struct HistFileHeader) ||
+			memcmp(header()->magic, HISTFILEMAGIC, 8) != 0 ||
+			header()->version != HISTFILEVERSION) {
+		closeHistoryFile();
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns 1 if a history file is open, 0 otherwise.
+ */
+int historyFileOpen()
+{
+	return map != NULL;
+}
+
+/*
+ * Moves the tail from off past the record of size bytes claimed there,
+ * unless a shell already has.
+ */
+static void advanceTail(uint64_t off, uint64_t size)
+{
+	__atomic_compare_exchange_n(&header()->tail, &off, off + size, 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+/*
+ * Appends cmd to the history file.
+ * Returns a pointer to the copy in the file, or NULL after reporting
+ * why it could not be added.
+ */
+char *histfileAppend(const char *cmd)
+{
+	size_t len = strlen(cmd);
+	uint64_t size = (sizeof(struct HistRecord) + len + 1 + 7) & ~7ULL;
+	uint32_t writing = (uint32_t)getpid() << RECORDSTATEBITS |
+		RECORDWRITING;
+	union RecordWord claim;
+	union RecordWord *word;
+
+	if (map == NULL)
+		return NULL;
+
+	if (size > UINT32_MAX) {
+		err("command too long for history");
+		return NULL;
+	}
+
+	claim.rec.size = size;
+	claim.rec.state = writing;
+
+	/* claim the record at the tail; no other shell will write there */
+	while (1) {
+		uint64_t off = __atomic_load_n(&header()->tail, __ATOMIC_ACQUIRE);
+		union RecordWord found = { .word = 0 };
+
+		if (off + size > HISTFILEMAX) {
+			err("history file is full");
+			return NULL;
+		}
+
+		/* nothing is reserved yet, so failing here leaves no gap */
+		if (growFile(off + size) < 0) {
+			err(strerror(errno));
+			return NULL;
+		}
+
+		word = (union RecordWord *)(map + off);
+		if (__atomic_compare_exchange_n(&word->word, &found.word,
+					claim.word, 0, __ATOMIC_ACQ_REL,
+					__ATOMIC_ACQUIRE)) {
+			advanceTail(off, size);
+			break;
+		}
+
+		if (found.rec.size < sizeof(struct HistRecord)) {
+			err("history file is corrupt");
+			return NULL;
+		}
+
+		/* another shell claimed it; its writer may have died since */
+		advanceTail(off, found.rec.size);
+	}
+
+	memcpy(&word->rec + 1, cmd, len + 1);
+
+	/* a shell that took this shell for dead has skipped the record */
+	if (!__atomic_compare_exchange_n(&word->rec.state, &writing,
+				RECORDDONE, 0, __ATOMIC_RELEASE,
+				__ATOMIC_RELAXED)) {
+		err("history entry was dropped by another shell");
+		return NULL;
+	}
+
+	return (char *)(&word->rec + 1);
+}
+
+/*
+ * Returns 1 if the shell writing a record in state has exited, 0 if it
+ * may still be running.
+ */
+static int writerGone(uint32_t state)
+{
+	pid_t pid = state >> RECORDSTATEBITS;
+
+	return kill(pid, 0) < 0 && errno == ESRCH;
+}
+
+/*
+ * Indexes any records completed since the last scan.
+ * Scanning stops at the first record still being written, so command
+ * numbers never change once they have been seen. Records whose writer
+ * died are stepped over.
+ */
+static void scanFile()
+{
+	uint64_t tail = __atomic_load_n(&header()->tail, __ATOMIC_ACQUIRE);
+
+	while (scanPos < tail) {
+		struct HistRecord *rec;
+		uint32_t state;
+		uint32_t size;
+
+		if (scanPos + sizeof(*rec) > fileSize) {
+			refreshFileSize();
+			if (scanPos + sizeof(*rec) > fileSize)
+				break;
+		}
+
+		rec = (struct HistRecord *)(map + scanPos);
+		state = __atomic_load_n(&rec->state, __ATOMIC_ACQUIRE);
+		size = __atomic_load_n(&rec->size, __ATOMIC_RELAXED);
+		if (size < sizeof(*rec) || size % 8 != 0 ||
+				scanPos + size > tail)
+			break;
+
+		if ((state & RECORDSTATEMASK) == RECORDWRITING) {
+			if (!writerGone(state))
+				break;
+			__atomic_compare_exchange_n(&rec->state, &state,
+					RECORDSKIP, 0, __ATOMIC_ACQ_REL,
+					__ATOMIC_ACQUIRE);
+		}
+
+		/* anything else was left half-written; it holds no command */
+		if (state == RECORDDONE) {
+			if (numOffsets == maxOffsets) {
+				maxOffsets = maxOffsets ? maxOffsets * 2 : 1024;
+				offsets = realloc(offsets,
+						sizeof(*offsets) * maxOffsets);
+				if (offsets == NULL)
+					errMalloc();
+			}
+			offsets[numOffsets++] = scanPos;
+		}
+		scanPos += size;
+	}
+}
+
+/*
+ * Returns the number of complete commands in the history file,
+ * including those appended by other shells.
+ */
+int histfileCount()
+{
+	if (map == NULL)
+		return 0;
+
+	scanFile();
+	return numOffsets;
+}
+
+/*
+ * Returns the nth command in the history file, counting the oldest as 1.
+ * Returns NULL if there is no such command.
+ */
+const char *histfileEntry(int n)
+{
+	if (map == NULL)
+		return NULL;
+
+	if (n > numOffsets)
+		scanFile();
+	if (n < 1 || n > numOffsets)
+		return NULL;
+
+	return map + offsets[n - 1] + sizeof(struct HistRecord);
+}
+
+/*
+ * Unmaps and closes the history file.
+ */
+void closeHistoryFile()
+{
+	if (map != NULL)
+		munmap(map, HISTFILEMAX);
+	if (histFd >= 0)
+		close(histFd);
+
+	free(offsets);
+	map = NULL;
+	histFd = -1;
+	fileSize = 0;
+	offsets = NULL;
+	numOffsets = 0;
+	maxOffsets = 0;
+	scanPos = sizeof(struct HistFileHeader);
+}
@@ -0,0 +1,51 @@
+#ifndef _HISTFILE_H_
+#define _HISTFILE_H_
+
+/*
+ * An append-only history file shared by every shell that opens it.
+ *
+ * The file starts with a header holding the offset of the end of the
+ * reserved records. A shell appends a command by claiming the record at
+ * that offset with a compare-and-swap through a shared mapping, moving
+ * the offset past it, then writing the command in the space it claimed,
+ * so concurrent shells never overwrite each other and the file is never
+ * rewritten. Commands are read straight from the mapping; a record whose
+ * writer died before finishing it is skipped.
+ */
+
+/*
+ * Opens (creating if needed) the history file at path and maps it.
+ * Returns 0 on success, -1 on failure.
+ */
+int openHistoryFile(const char *path);
+
+/*
+ * Returns 1 if a history file is open, 0 otherwise.
+ */
+int historyFileOpen();
+
+/*
+ * Appends cmd to the history file.
+ * Returns a pointer to the copy in the file, or NULL after reporting
+ * why it could not be added.
+ */
+char *histfileAppend(const char *cmd);
+
+/*
+ * Returns the number of complete commands in the history file,
+ * including those appended by other shells.
+ */
+int histfileCount();
+
+/*
+ * Returns the nth command in the history file, counting the oldest as 1.
+ * Returns NULL if there is no such command.
+ */
+const char *histfileEntry(int n);
+
+/*
+ * Unmaps and closes the history file.
+ */
+void closeHistoryFile();
+
+#endif
@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "histindex.h"
+#include "history.h"
+#include "util.h"
+
+/* the most entries of the shortest list a search goes through */
+#define HISTSEARCHSTEPS (16 * HISTSEARCHLIMIT)
+
+/*
+ * The commands holding one trigram, by the number they were appended as
+ * (see historyAdded()), in increasing order. Numbers of commands that
+ * have since been evicted are dropped now and then.
+ */
+struct Posting {
+	unsigned int trigram;
+	unsigned int count;
+	unsigned int cap;
+	unsigned int *seqs;
+};
+
+/* a command that matched a search */
+struct Match {
+	int n;
+	int rank;
+};
+
+/* open addressing table of posting lists; trigram 0 marks a free slot */
+static struct Posting *table;
+static unsigned int tableSize;
+static unsigned int numPostings;
+
+static int started;
+static unsigned int indexed;
+
+/* the numbers up to this one have been dropped from every list */
+static unsigned int compactedBelow;
+
+/*
+ * Returns the trigram starting at s, which is never 0.
+ */
+static unsigned int trigramAt(const char *s)
+{
+	return ((unsigned int)(unsigned char)s[0] << 16 |
+		(unsigned int)(unsigned char)s[1] << 8 |
+		(unsigned char)s[2]) + 1;
+}
+
+static unsigned int postingSlot(unsigned int trigram)
+{
+	return (trigram * 2654435761u) & (tableSize - 1);
+}
+
+/*
+ * Returns the posting list of trigram, or NULL if no command holds it.
+ */
+static struct Posting *findPosting(unsigned int trigram)
+{
+	unsigned int i;
+
+	if (tableSize == 0)
+		return NULL;
+
+	for (i = postingSlot(trigram); table[i].trigram != 0;
+			i = (i + 1) & (tableSize - 1)) {
+		if (table[i].trigram == trigram)
+			return &table[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Doubles the size of the table, keeping it at most half full.
+ */
+static void growTable()
+{
+	struct Posting *old = table;
+	unsigned int oldSize = tableSize;
+	unsigned int i;
+
+	tableSize = oldSize ? oldSize * 2 : 4096;
+	table = calloc(tableSize, sizeof(*table));
+	if (table == NULL)
+		errMalloc();
+
+	for (i = 0; i < oldSize; i++) {
+		unsigned int j;
+
+		if (old[i].trigram == 0)
+			continue;
+		for (j = postingSlot(old[i].trigram); table[j].trigram != 0;
+				j = (j + 1) & (tableSize - 1))
+			;
+		table[j] = old[i];
+	}
+
+	free(old);
+}
+
+/*
+ * Returns the posting list of trigram, adding an empty one if needed.
+ */
+static struct Posting *addPosting(unsigned int trigram)
+{
+	struct Posting *p = findPosting(trigram);
+	unsigned int i;
+
+	if (p != NULL)
+		return p;
+
+	if (2 * (numPostings + 1) > tableSize)
+		growTable();
+
+	for (i = postingSlot(trigram); table[i].trigram != 0;
+			i = (i + 1) & (tableSize - 1))
+		;
+	table[i].trigram = trigram;
+	numPostings++;
+
+	return &table[i];
+}
+
+/*
+ * Adds cmd, appended as number seq, to the list of each of its trigrams.
+ */
+static void addCommand(unsigned int seq, const char *cmd)
+{
+	size_t len = strlen(cmd);
+	size_t i;
+
+	for (i = 0; i + 3 <= len; i++) {
+		struct Posting *p = addPosting(trigramAt(cmd + i));
+
+		/* a trigram repeated in the command is listed once */
+		if (p->count > 0 && p->seqs[p->count - 1] == seq)
+			continue;
+
+		if (p->count == p->cap) {
+			p->cap = p->cap ? p->cap * 2 : 4;
+			p->seqs = realloc(p->seqs, sizeof(*p->seqs) * p->cap);
+			if (p->seqs == NULL)
+				errMalloc();
+		}
+		p->seqs[p->count++] = seq;
+	}
+}
+
+/*
+ * Returns the position of the first number in p not below seq.
+ */
+static unsigned int lowerBound(const struct Posting *p, unsigned int seq)
+{
+	unsigned int lo = 0;
+	unsigned int hi = p->count;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (p->seqs[mid] < seq)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * Drops the numbers below first, those of evicted commands, from every
+ * list.
+ */
+static void compact(unsigned int first)
+{
+	unsigned int i;
+
+	for (i = 0; i < tableSize; i++) {
+		struct Posting *p = &table[i];
+		unsigned int dead;
+
+		if (p->trigram == 0)
+			continue;
+		dead = lowerBound(p, first);
+		memmove(p->seqs, p->seqs + dead,
+				sizeof(*p->seqs) * (p->count - dead));
+		p->count -= dead;
+	}
+
+	compactedBelow = first - 1;
+}
+
+/*
+ * Indexes every command appended since the last update.
+ */
+static void updateIndex()
+{
+	unsigned int added = historyAdded();
+	unsigned int offset = added - historyCount();
+	unsigned int seq;
+
+	/* the history was cleared or resized */
+	if (added < indexed)
+		clearHistoryIndex();
+	started = 1;
+
+	/* commands evicted before they could be indexed are skipped */
+	if (indexed < offset)
+		indexed = offset;
+
+	for (seq = indexed + 1; seq <= added; seq++)
+		addCommand(seq, historyEntry(seq - offset));
+	indexed = added;
+
+	/* once more have been evicted than are kept, drop them */
+	if (offset - compactedBelow > added - offset)
+		compact(offset + 1);
+}
+
+/*
+ * Indexes the commands added to the history since the last call.
+ * Does nothing until the first search, so a shell that never searches
+ * never builds the index.
+ */
+void indexHistory()
+{
+	if (started)
+		updateIndex();
+}
+
+/*
+ * Returns how good a match for query cmd is, 0 being the best.
+ */
+static int rankMatch(const char *cmd, const char *query)
+{
+	const char *p = strstr(cmd, query);
+
+	if (p == cmd)
+		return 0;
+
+	for (; p != NULL; p = strstr(p + 1, query)) {
+		if (strchr(" \t/|;&<>", p[-1]) != NULL)
+			return 1;
+	}
+
+	return 2;
+}
+
+static int compareMatches(const void *a, const void *b)
+{
+	const struct Match *x = a, *y = b;
+
+	if (x->rank != y->rank)
+		return x->rank - y->rank;
+
+	return y->n - x->n;
+}
+
+/*
+ * Returns the posting lists of the trigrams of query in lists, the
+ * shortest first.
+ * Returns the number of lists, or -1 if a trigram is in no command.
+ */
+static int queryPostings(const char *query, struct Posting **lists)
+{
+	size_t len = strlen(query);
+	int numLists = 0;
+	size_t i;
+	int j;
+
+	for (i = 0; i + 3 <= len; i++) {
+		struct Posting *p = findPosting(trigramAt(query + i));
+
+		if (p == NULL || p->count == 0)
+			return -1;
+
+		for (j = 0; j < numLists && lists[j] != p; j++)
+			;
+		if (j < numLists)
+			continue;
+
+		lists[numLists++] = p;
+		if (p->count < lists[0]->count) {
+			lists[numLists - 1] = lists[0];
+			lists[0] = p;
+		}
+	}
+
+	return numLists;
+}
+
+/*
+ * The matches found so far. Those starting with the query are also
+ * kept apart, without repeats: once there are max of them no older
+ * command can make the list.
+ */
+struct Search {
+	const char *query;
+	struct Match matches[HISTSEARCHLIMIT];
+	int numMatches;
+	const char **prefixed;
+	int numPrefixed;
+	int max;
+};
+
+/*
+ * Records cmd, history entry n, if it contains the query.
+ * Returns 1 if the search is over, 0 otherwise.
+ */
+static int checkMatch(struct Search *s, int n, const char *cmd)
+{
+	struct Match *m = &s->matches[s->numMatches];
+	int i;
+
+	if (strstr(cmd, s->query) == NULL)
+		return 0;
+
+	m->n = n;
+	m->rank = rankMatch(cmd, s->query);
+	s->numMatches++;
+
+	if (m->rank == 0) {
+		for (i = 0; i < s->numPrefixed; i++) {
+			if (strcmp(s->prefixed[i], cmd) == 0)
+				break;
+		}
+		if (i == s->numPrefixed)
+			s->prefixed[s->numPrefixed++] = cmd;
+	}
+
+	return s->numPrefixed == s->max;
+}
+
+/*
+ * Finds up to max commands containing query and stores their history
+ * numbers (see historyEntry()) in found, best first: commands starting
+ * with the query, then those with the query at the start of a word,
+ * then the rest, newer before older within each. A command repeated
+ * appears once.
+ * Returns the number of commands stored.
+ */
+int searchHistory(const char *query, int *found, int max)
+{
+	size_t len = strlen(query);
+	struct Posting *lists[len > 2 ? len - 2 : 1];
+	const char *prefixed[max > 0 ? max : 1];
+	struct Search s;
+	unsigned int offset;
+	int numFound = 0;
+	int checked = 0;
+	int i, j;
+
+	if (len == 0 || max <= 0)
+		return 0;
+
+	s.query = query;
+	s.numMatches = 0;
+	s.prefixed = prefixed;
+	s.numPrefixed = 0;
+	s.max = max;
+
+	updateIndex();
+	offset = historyAdded() - historyCount();
+
+	if (len < 3) {
+		/* too short for a trigram: check the newest commands */
+		for (i = historyCount(); i > 0 && checked < HISTSEARCHLIMIT;
+				i--, checked++) {
+			if (checkMatch(&s, i, historyEntry(i)))
+				break;
+		}
+	} else {
+		int numLists = queryPostings(query, lists);
+		unsigned int k;
+		int steps = 0;
+
+		/* the shortest list leads, newest first; the others are probed */
+		for (k = numLists > 0 ? lists[0]->count : 0; k > 0 &&
+				checked < HISTSEARCHLIMIT &&
+				steps < HISTSEARCHSTEPS; k--, steps++) {
+			unsigned int seq = lists[0]->seqs[k - 1];
+
+			if (seq <= offset)
+				break;
+
+			for (j = 1; j < numLists; j++) {
+				unsigned int pos = lowerBound(lists[j], seq);
+
+				if (pos == lists[j]->count ||
+						lists[j]->seqs[pos] != seq)
+					break;
+			}
+			if (j < numLists)
+				continue;
+
+			/* the trigrams may be in the command but apart */
+			checked++;
+			if (checkMatch(&s, seq - offset,
+						historyEntry(seq - offset)))
+				break;
+		}
+	}
+
+	qsort(s.matches, s.numMatches, sizeof(*s.matches), compareMatches);
+
+	for (i = 0; i < s.numMatches && numFound < max; i++) {
+		const char *cmd = historyEntry(s.matches[i].n);
+
+		for (j = 0; j < numFound; j++) {
+			if (strcmp(historyEntry(found[j]), cmd) == 0)
+				break;
+		}
+		if (j == numFound)
+			found[numFound++] = s.matches[i].n;
+	}
+
+	return numFound;
+}
+
+/*
+ * Forgets the index, e.g. after the history was cleared or resized.
+ */
+void clearHistoryIndex()
+{
+	unsigned int i;
+
+	for (i = 0; i < tableSize; i++)
+		free(table[i].seqs);
+	free(table);
+
+	table = NULL;
+	tableSize = 0;
+	numPostings = 0;
+	started = 0;
+	indexed = 0;
+	compactedBelow = 0;
+}
@@ -0,0 +1,39 @@
+#ifndef _HISTINDEX_H_
+#define _HISTINDEX_H_
+
+/*
+ * A trigram index of the command history, for incremental search.
+ *
+ * Every run of three characters in a command maps to the sorted list of
+ * the commands holding it (a posting list). A search intersects the
+ * lists of the query's trigrams, starting from the shortest and going
+ * back from the newest command, and checks a bounded number of the
+ * commands found, so its cost does not grow with the history.
+ */
+
+/* The most commands a search checks against the query */
+#define HISTSEARCHLIMIT 4096
+
+/*
+ * Indexes the commands added to the history since the last call.
+ * Does nothing until the first search, so a shell that never searches
+ * never builds the index.
+ */
+void indexHistory();
+
+/*
+ * Finds up to max commands containing query and stores their history
+ * numbers (see historyEntry()) in found, best first: commands starting
+ * with the query, then those with the query at the start of a word,
+ * then the rest, newer before older within each. A command repeated
+ * appears once.
+ * Returns the number of commands stored.
+ */
+int searchHistory(const char *query, int *found, int max);
+
+/*
+ * Forgets the index, e.g. after the history was cleared or resized.
+ */
+void clearHistoryIndex();
+
+#endif
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtin.h"
+#include "histfile.h"
+#include "history.h"
+#include "util.h"
+
+/* Average command length the string arena is sized for */
+#define HISTORYAVGLEN 64
+#define HISTORYMINARENA (64 * 1024)
+
+/*
+ * start is a logical offset into the arena: it only ever grows, and
+ * the text lives at start % arenaSize. Entries are laid out in the
+ * arena in the order they were added, so the oldest entry is always
+ * the next one to be overwritten.
+ */
+struct HistoryEntry {
+	unsigned long long start;
+	unsigned int len;
+};
+
+static struct HistoryEntry *entries;
+static int capacity = MAXHISTORY;
+static int head;
+static int count;
+static unsigned int added;
+
+static char *arena;
+static unsigned long long arenaSize;
+static unsigned long long tail;
+
+static unsigned long long arenaSizeFor(int cap)
+{
+	unsigned long long size = (unsigned long long)cap * HISTORYAVGLEN;
+
+	return size < HISTORYMINARENA ? HISTORYMINARENA : size;
+}
+
+/*
+ * Allocates an empty ring of the current capacity.
+ */
+static void allocHistory()
+{
+	arenaSize = arenaSizeFor(capacity);
+	entries = malloc(sizeof(*entries) * capacity);
+	arena = malloc(arenaSize);
+	if (entries == NULL || arena == NULL)
+		errMalloc();
+
+	head = 0;
+	count = 0;
+	tail = 0;
+	added = 0;
+}
+
+static void evictOldest()
+{
+	head = (head + 1) % capacity;
+	count--;
+}
+
+/*
+ * Sets the number of commands kept, keeping the most recent ones.
+ * Returns 0 on success, -1 if capacity is out of range.
+ */
+int setHistorySize(int newCapacity)
+{
+	struct HistoryEntry *oldEntries = entries;
+	char *oldArena = arena;
+	unsigned long long oldArenaSize = arenaSize;
+	int oldCapacity = capacity;
+	int oldHead = head;
+	int oldCount = count;
+	int i;
+
+	if (newCapacity < 1 || newCapacity > HISTORYLIMIT)
+		return -1;
+
+	capacity = newCapacity;
+	if (oldEntries == NULL)
+		return 0;
+
+	allocHistory();
+
+	/* the arena may be smaller now; re-add what fits, newest last */
+	i = oldCount > capacity ? oldCount - capacity : 0;
+	for (; i < oldCount; i++) {
+		struct HistoryEntry *e = &oldEntries[(oldHead + i) % oldCapacity];
+
+		historyAppend(oldArena + e->start % oldArenaSize);
+	}
+
+	free(oldEntries);
+	free(oldArena);
+	return 0;
+}
+
+/*
+ * Returns the number of commands that can be kept.
+ */
+int historySize()
+{
+	return capacity;
+}
+
+/*
+ * Returns the number of commands currently kept.
+ */
+int historyCount()
+{
+	if (historyFileOpen())
+		return histfileCount();
+
+	return count;
+}
+
+/*
+ * Returns the number of commands appended since the history was
+ * created, cleared or resized, including those evicted since.
+ * The command appended as number k is entry k - (historyAdded() -
+ * historyCount()) while it is kept.
+ */
+unsigned int historyAdded()
+{
+	if (historyFileOpen())
+		return histfileCount();
+
+	return added;
+}
+
+/*
+ * Returns the nth command kept, counting the oldest as 1.
+ * The string stays valid until the next change to the history.
+ * Returns NULL if there is no such command.
+ */
+const char *historyEntry(int n)
+{
+	if (historyFileOpen())
+		return histfileEntry(n);
+
+	if (n < 1 || n > count)
+		return NULL;
+
+	return arena + entries[(head + n - 1) % capacity].start % arenaSize;
+}
+
+/*
+ * Appends a copy of cmd, evicting the oldest commands if needed.
+ * cmd may point at a command already in the history.
+ * Returns a pointer to the stored copy, or NULL if cmd is too long
+ * to be kept or, with a history file, after the file has reported why
+ * it could not be added.
+ */
+char *historyAppend(const char *cmd)
+{
+	size_t len = strlen(cmd);
+	unsigned long long start;
+	char *copy;
+
+	if (historyFileOpen())
+		return histfileAppend(cmd);
+
+	if (entries == NULL)
+		allocHistory();
+
+	if (len + 1 > arenaSize)
+		return NULL;
+
+	/* strings never wrap; skip to the start of the arena instead */
+	start = tail;
+	if (start % arenaSize + len + 1 > arenaSize)
+		start += arenaSize - start % arenaSize;
+
+	/* evict every entry the new text will overwrite */
+	while (count > 0 && entries[head].start + arenaSize < start + len + 1)
+		evictOldest();
+
+	if (count == capacity)
+		evictOldest();
+
+	copy = arena + start % arenaSize;
+	/* cmd may be an evicted entry occupying the same bytes */
+	memmove(copy, cmd, len + 1);
+
+	struct HistoryEntry *e = &entries[(head + count) % capacity];
+	e->start = start;
+	e->len = len;
+	count++;
+	added++;
+	tail = start + len + 1;
+
+	return copy;
+}
+
+/*
+ * Forgets every command and releases the history's memory.
+ */
+void clearHistory()
+{
+	free(entries);
+	free(arena);
+	entries = NULL;
+	arena = NULL;
+	head = 0;
+	count = 0;
+	tail = 0;
+	added = 0;
+}
@@ -0,0 +1,58 @@
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+/* The largest capacity the history can be given */
+#define HISTORYLIMIT (4 * 1024 * 1024)
+
+/*
+ * The command history is a fixed-capacity ring of entries whose text is
+ * kept in one contiguous, circular string arena. Appending, evicting
+ * the oldest entry and looking up an entry by number are all O(1).
+ */
+
+/*
+ * Sets the number of commands kept, keeping the most recent ones.
+ * Returns 0 on success, -1 if capacity is out of range.
+ */
+int setHistorySize(int capacity);
+
+/*
+ * Returns the number of commands that can be kept.
+ */
+int historySize();
+
+/*
+ * Returns the number of commands currently kept.
+ */
+int historyCount();
+
+/*
+ * Returns the number of commands appended since the history was
+ * created, cleared or resized, including those evicted since.
+ * The command appended as number k is entry k - (historyAdded() -
+ * historyCount()) while it is kept.
+ */
+unsigned int historyAdded();
+
+/*
+ * Returns the nth command kept, counting the oldest as 1.
+ * The string stays valid until the next change to the history.
+ * Returns NULL if there is no such command.
+ */
+const char *historyEntry(int n);
+
+/*
+ * Appends a copy of cmd, evicting the oldest commands if needed.
+ * cmd may point at a command already in the history.
+ * Returns a pointer to the stored copy, or NULL if cmd is too long
+ * to be kept or, with a history file, after the file has reported why
+ * it could not be added.
+ */
+char *historyAppend(const char *cmd);
+
+/*
+ * Forgets every command and releases the history's memory.
+ */
+void clearHistory();
+
+#endif
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "events.h"
+#include "input.h"
+#include "util.h"
+
+#define INPUTBUFSIZE (64 * 1024)
+
+/*
+ * Prepares in to read lines from fd.
+ * If useMap is set and fd is a regular file it is memory mapped.
+ * Returns 0 on success, -1 on failure.
+ */
+int openInput(struct Input *in, int fd, int useMap)
+{
+	struct stat st;
+
+	memset(in, 0, sizeof(*in));
+	in->fd = fd;
+
+	if (useMap && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		off_t start = lseek(fd, 0, SEEK_CUR);
+
+		if (start < 0)
+			start = 0;
+
+		if (st.st_size <= start) {
+			in->eof = 1;
+			return 0;
+		}
+
+		/*
+		 * A private writable mapping lets lines be terminated in
+		 * place without changing the file.
+		 */
+		in->buf = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_POPULATE, fd, 0);
+		if (in->buf != MAP_FAILED) {
+			madvise(in->buf, st.st_size, MADV_SEQUENTIAL);
+			in->mapped = 1;
+			in->size = st.st_size;
+			in->cap = st.st_size;
+			in->pos = start;
+			in->eof = 1;
+			return 0;
+		}
+		in->buf = NULL;
+	}
+
+	/* one spare byte to terminate a final line with no newline */
+	in->cap = INPUTBUFSIZE;
+	in->buf = malloc(in->cap + 1);
+	if (in->buf == NULL)
+		errMalloc();
+
+	return 0;
+}
+
+/*
+ * Reads another block from in->fd onto the end of the buffer,
+ * first moving any partial line to the front.
+ * Returns the number of bytes read, 0 at end of file.
+ */
+static ssize_t fillBuffer(struct Input *in)
+{
+	ssize_t n;
+
+	if (in->pos > 0) {
+		memmove(in->buf, in->buf + in->pos, in->size - in->pos);
+		in->size -= in->pos;
+		in->pos = 0;
+	}
+
+	if (in->size == in->cap) {
+		/* a single line longer than the buffer */
+		in->cap *= 2;
+		in->buf = realloc(in->buf, in->cap + 1);
+		if (in->buf == NULL)
+			errMalloc();
+	}
+
+	/* children are reaped and timers run while no input has come */
+	waitReadable(in->fd);
+	do {
+		n = read(in->fd, in->buf + in->size, in->cap - in->size);
+	} while (n < 0 && errno == EINTR);
+
+	if (n <= 0) {
+		in->eof = 1;
+		return 0;
+	}
+
+	in->size += n;
+	return n;
+}
+
+/*
+ * Terminates the last line of a mapped file that has no newline.
+ * If the file ends exactly on a page boundary there is no byte after
+ * it to overwrite, so that one line is copied out.
+ */
+static char *finishMappedLine(struct Input *in)
+{
+	long pageSize = sysconf(_SC_PAGESIZE);
+	size_t len = in->size - in->pos;
+
+	if (in->size % pageSize != 0) {
+		/* the rest of the final page reads as zeroes */
+		return in->buf + in->pos;
+	}
+
+	free(in->lastLine);
+	in->lastLine = malloc(len + 1);
+	if (in->lastLine == NULL)
+		errMalloc();
+
+	memcpy(in->lastLine, in->buf + in->pos, len);
+	in->lastLine[len] = '\0';
+	return in->lastLine;
+}
+
+/*
+ * Returns the next line from in, without its trailing newline.
+ * The line stays valid until the next call to readLine().
+ * Returns NULL at end of input.
+ */
+char *readLine(struct Input *in)
+{
+	size_t scanned = in->pos;
+
+	if (in->buf == NULL)
+		return NULL;
+
+	if (in->mapped && in->fd == STDIN_FILENO) {
+		/* skip anything the last command read from the script */
+		off_t cur = lseek(in->fd, 0, SEEK_CUR);
+
+		if (cur > (off_t)in->pos && cur <= (off_t)in->size)
+			scanned = in->pos = cur;
+	}
+
+	while (1) {
+		char *start = in->buf + in->pos;
+		char *nl = memchr(in->buf + scanned, '\n', in->size - scanned);
+
+		if (nl != NULL) {
+			*nl = '\0';
+			in->pos = nl - in->buf + 1;
+
+			/* commands run from a script on stdin read on from here */
+			if (in->mapped && in->fd == STDIN_FILENO)
+				lseek(in->fd, in->pos, SEEK_SET);
+
+			return start;
+		}
+
+		if (in->eof) {
+			char *line;
+
+			if (in->pos == in->size)
+				return NULL;
+
+			if (in->mapped) {
+				line = finishMappedLine(in);
+			} else {
+				in->buf[in->size] = '\0';
+				line = start;
+			}
+			in->pos = in->size;
+			return line;
+		}
+
+		scanned = in->size - in->pos;
+		fillBuffer(in);
+		/* fillBuffer moved the unread data to the front */
+	}
+}
+
+/*
+ * Releases the buffer or mapping held by in. Does not close in->fd.
+ */
+void closeInput(struct Input *in)
+{
+	if (in->mapped)
+		munmap(in->buf, in->size);
+	else
+		free(in->buf);
+
+	free(in->lastLine);
+	memset(in, 0, sizeof(*in));
+	in->fd = -1;
+}
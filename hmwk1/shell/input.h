@@ -0,0 +1,42 @@
+#ifndef _INPUT_H_
+#define _INPUT_H_
+
+#include <stddef.h>
+
+/*
+ * A source of command lines.
+ * Regular files are memory mapped; anything else (terminals, pipes)
+ * is read in large blocks into a reusable buffer. Lines are split in
+ * place, so reading a line never allocates memory.
+ */
+struct Input {
+	int fd;
+	int mapped;
+	int eof;
+	char *buf;
+	size_t size;
+	size_t cap;
+	size_t pos;
+	char *lastLine;
+};
+
+/*
+ * Prepares in to read lines from fd.
+ * If useMap is set and fd is a regular file it is memory mapped.
+ * Returns 0 on success, -1 on failure.
+ */
+int openInput(struct Input *in, int fd, int useMap);
+
+/*
+ * Returns the next line from in, without its trailing newline.
+ * The line stays valid until the next call to readLine().
+ * Returns NULL at end of input.
+ */
+char *readLine(struct Input *in);
+
+/*
+ * Releases the buffer or mapping held by in. Does not close in->fd.
+ */
+void closeInput(struct Input *in);
+
+#endif
@@ -0,0 +1,554 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#include "events.h"
+#include "jobs.h"
+#include "trace.h"
+#include "util.h"
+
+static struct Job *jobsHead;
+static struct Job *jobsTail;
+static struct Job *freeJobs;
+
+/*
+ * Open addressing table mapping a pid to the job it belongs to, its
+ * position in that job and the pidfd its exit is read from, or -1 if
+ * it has none and is reaped after a SIGCHLD.
+ */
+struct PidSlot {
+	pid_t pid;
+	int index;
+	int pidfd;
+	struct Job *job;
+};
+
+static struct PidSlot *pidTable;
+static unsigned int pidTableSize;
+static unsigned int numPidSlots;
+
+/* the slots without a pidfd */
+static unsigned int numUntracked;
+
+/*
+ * Set once a child has to be reaped that nothing records the pid of,
+ * e.g. if there are no pidfds; any child is then reaped after SIGCHLD.
+ */
+static int reapAny;
+
+static void reapUntracked();
+
+static void onChildExit(int sig)
+{
+	reapUntracked();
+}
+
+/*
+ * Has SIGCHLD handled by the event loop, which reaps the children that
+ * exited without a pidfd. Must be called before any job starts.
+ */
+void initJobs()
+{
+	struct sigaction sa;
+
+	/* stopped children are not reported */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = SIG_DFL;
+	sa.sa_flags = SA_NOCLDSTOP;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+
+	if (watchSignal(SIGCHLD, onChildExit) < 0)
+		err(strerror(errno));
+}
+
+static unsigned int pidSlot(pid_t pid)
+{
+	return ((unsigned int)pid * 2654435761u) & (pidTableSize - 1);
+}
+
+static void insertPid(pid_t pid, struct Job *job, int index, int pidfd);
+
+/*
+ * Doubles the size of the pid table, keeping it at most half full.
+ */
+static void growPidTable()
+{
+	struct PidSlot *old = pidTable;
+	unsigned int oldSize = pidTableSize;
+	unsigned int i;
+
+	pidTableSize = oldSize ? oldSize * 2 : 64;
+	pidTable = calloc(pidTableSize, sizeof(*pidTable));
+	if (pidTable == NULL)
+		errMalloc();
+
+	numPidSlots = 0;
+	numUntracked = 0;
+	for (i = 0; i < oldSize; i++) {
+		if (old[i].job != NULL)
+			insertPid(old[i].pid, old[i].job, old[i].index,
+					old[i].pidfd);
+	}
+
+	free(old);
+}
+
+static void insertPid(pid_t pid, struct Job *job, int index, int pidfd)
+{
+	unsigned int i;
+
+	if ((numPidSlots + 1) * 2 > pidTableSize)
+		growPidTable();
+
+	i = pidSlot(pid);
+	while (pidTable[i].job != NULL)
+		i = (i + 1) & (pidTableSize - 1);
+
+	pidTable[i].pid = pid;
+	pidTable[i].index = index;
+	pidTable[i].pidfd = pidfd;
+	pidTable[i].job = job;
+	numPidSlots++;
+	if (pidfd < 0)
+		numUntracked++;
+}
+
+static struct PidSlot *lookupPid(pid_t pid)
+{
+	unsigned int i;
+
+	if (pidTableSize == 0)
+		return NULL;
+
+	for (i = pidSlot(pid); pidTable[i].job != NULL;
+			i = (i + 1) & (pidTableSize - 1)) {
+		if (pidTable[i].pid == pid)
+			return &pidTable[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Removes a slot, shifting back later entries of the same probe
+ * sequence so lookups never need tombstones.
+ */
+static void deletePid(struct PidSlot *slot)
+{
+	unsigned int mask = pidTableSize - 1;
+	unsigned int hole = slot - pidTable;
+	unsigned int i = hole;
+
+	if (slot->pidfd < 0)
+		numUntracked--;
+
+	while (1) {
+		i = (i + 1) & mask;
+		if (pidTable[i].job == NULL)
+			break;
+
+		/* can the entry at i move back to the hole? */
+		unsigned int home = pidSlot(pidTable[i].pid);
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			pidTable[hole] = pidTable[i];
+			hole = i;
+		}
+	}
+
+	pidTable[hole].job = NULL;
+	numPidSlots--;
+}
+
+/*
+ * Records that pid exited with the given wait status: in its job, if
+ * it still has one, and with its resource usage in the trace.
+ */
+static void finishPid(pid_t pid, int status, const struct rusage *usage)
+{
+	struct PidSlot *slot;
+	struct Job *job;
+
+	traceEnd(pid, status, usage);
+
+	slot = lookupPid(pid);
+	if (slot == NULL)
+		return;
+
+	job = slot->job;
+	if (slot->index == job->numPids - 1)
+		job->status = status;
+	job->numRunning--;
+
+	deletePid(slot);
+}
+
+/*
+ * Converts what waitid() reports into a wait status.
+ */
+static int waitStatus(const siginfo_t *info)
+{
+	if (info->si_code == CLD_EXITED)
+		return (info->si_status & 0xff) << 8;
+
+	return info->si_status | (info->si_code == CLD_DUMPED ? WCOREFLAG : 0);
+}
+
+/*
+ * Reaps the child that pidfd refers to once it has exited. The pidfd,
+ * unlike the pid, cannot come to mean another process, and the loop
+ * reports it alone, so an exit costs the same however many children
+ * are running.
+ */
+static void onPidExit(int pidfd, unsigned int events, void *data)
+{
+	struct rusage usage;
+	siginfo_t info;
+
+	memset(&info, 0, sizeof(info));
+	if (syscall(SYS_waitid, P_PIDFD, pidfd, &info, WEXITED | WNOHANG,
+				&usage) < 0) {
+		if (errno == EINTR)
+			return;
+	} else if (info.si_pid == 0) {
+		return;
+	} else {
+		finishPid(info.si_pid, waitStatus(&info), &usage);
+	}
+
+	unwatchFd(pidfd);
+	close(pidfd);
+}
+
+/*
+ * Opens a pidfd for the child pid and has the event loop reap it.
+ * pid cannot have been reused: nothing but the shell reaps it.
+ * Returns the pidfd, or -1 if the child is to be reaped after a
+ * SIGCHLD instead.
+ */
+static int watchPid(pid_t pid)
+{
+	int pidfd = -1;
+
+#ifdef SYS_pidfd_open
+	pidfd = syscall(SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+#endif
+	if (pidfd < 0) {
+		if (errno == ENOSYS)
+			reapAny = 1;
+		return -1;
+	}
+
+	if (watchFd(pidfd, EPOLLIN, onPidExit, NULL) < 0) {
+		close(pidfd);
+		return -1;
+	}
+
+	return pidfd;
+}
+
+/*
+ * Reaps pid with wait4() and the given options.
+ * Returns what wait4() returns.
+ */
+static pid_t reapPid(pid_t pid, int options)
+{
+	struct rusage usage;
+	int status;
+
+	pid = wait4(pid, &status, options, &usage);
+	if (pid > 0)
+		finishPid(pid, status, &usage);
+
+	return pid;
+}
+
+/*
+ * Reaps the children without a pidfd that have exited.
+ */
+static void reapUntracked()
+{
+	unsigned int i = 0;
+
+	if (reapAny) {
+		while (reapPid(-1, WNOHANG) > 0)
+			;
+		return;
+	}
+
+	/* a reaped slot is filled from later in its run; look at it again */
+	while (numUntracked > 0 && i < pidTableSize) {
+		if (pidTable[i].job == NULL || pidTable[i].pidfd >= 0 ||
+				reapPid(pidTable[i].pid, WNOHANG) <= 0)
+			i++;
+	}
+}
+
+/*
+ * Has the child pid, which belongs to no job, reaped once it exits.
+ */
+void disownChild(pid_t pid)
+{
+	if (watchPid(pid) < 0)
+		reapAny = 1;
+}
+
+/*
+ * Adds a job made of the numPids processes in pids to the job table.
+ * numPids must not be more than MAXJOBPIDS.
+ * command is a description of the job, copied (and possibly
+ * truncated) for display.
+ * Returns the new job.
+ */
+struct Job *addJob(const pid_t pids[], int numPids, const char *command,
+		int background)
+{
+	struct Job *job = freeJobs;
+	int i;
+
+	if (job != NULL) {
+		freeJobs = job->next;
+	} else {
+		job = malloc(sizeof(*job));
+		if (job == NULL)
+			errMalloc();
+	}
+
+	job->id = jobsTail ? jobsTail->id + 1 : 1;
+	job->background = background;
+	job->numPids = numPids;
+	job->numRunning = numPids;
+	job->status = 0;
+	snprintf(job->command, sizeof(job->command), "%s", command);
+	memcpy(job->pids, pids, sizeof(pid_t) * numPids);
+
+	job->next = NULL;
+	job->prev = jobsTail;
+	if (jobsTail != NULL)
+		jobsTail->next = job;
+	else
+		jobsHead = job;
+	jobsTail = job;
+
+	for (i = 0; i < numPids; i++)
+		insertPid(pids[i], job, i, watchPid(pids[i]));
+
+	return job;
+}
+
+/*
+ * Removes job from the job table and frees it.
+ */
+void removeJob(struct Job *job)
+{
+	int i;
+
+	for (i = 0; i < job->numPids; i++) {
+		struct PidSlot *slot = lookupPid(job->pids[i]);
+
+		if (slot != NULL && slot->job == job)
+			deletePid(slot);
+	}
+
+	if (job->prev != NULL)
+		job->prev->next = job->next;
+	else
+		jobsHead = job->next;
+
+	if (job->next != NULL)
+		job->next->prev = job->prev;
+	else
+		jobsTail = job->prev;
+
+	/* keep it for the next job */
+	job->next = freeJobs;
+	freeJobs = job;
+}
+
+/*
+ * Returns the oldest job, or NULL if there are none.
+ * The rest follow through job->next.
+ */
+struct Job *firstJob()
+{
+	return jobsHead;
+}
+
+/*
+ * Returns the most recently started job, or NULL if there are none.
+ */
+struct Job *lastJob()
+{
+	return jobsTail;
+}
+
+/*
+ * Returns the job with the given job number, or NULL.
+ */
+struct Job *findJob(int id)
+{
+	struct Job *job;
+
+	for (job = jobsHead; job != NULL; job = job->next) {
+		if (job->id == id)
+			return job;
+	}
+
+	return NULL;
+}
+
+/*
+ * Returns the job that pid belongs to, or NULL.
+ */
+struct Job *findJobByPid(pid_t pid)
+{
+	struct PidSlot *slot = lookupPid(pid);
+
+	return slot ? slot->job : NULL;
+}
+
+/*
+ * Reaps every child that has exited, without blocking,
+ * and records its exit status in its job and its resource usage in
+ * the trace.
+ */
+void reapChildren()
+{
+	if (runEvents(0) < 0)
+		reapUntracked();
+}
+
+/*
+ * Waits until every process in job has exited.
+ * Returns the wait status of the job's last process.
+ */
+int waitJob(struct Job *job)
+{
+	int i;
+
+	/* an exit since the job started is waiting on its pidfd */
+	while (job->numRunning > 0) {
+		if (runEvents(-1) >= 0 || errno == EINTR)
+			continue;
+
+		/* without a loop, block on the processes themselves */
+		for (i = 0; i < job->numPids; i++) {
+			if (lookupPid(job->pids[i]) != NULL)
+				reapPid(job->pids[i], 0);
+		}
+		break;
+	}
+
+	return job->status;
+}
+
+/*
+ * Converts a wait status into a shell exit status: the exit code of a
+ * process that exited, or 128 plus the signal that killed it.
+ */
+int exitStatus(int status)
+{
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+
+	return WEXITSTATUS(status);
+}
+
+/*
+ * Describes the state of job, e.g. "Running", "Done" or "Exit 2".
+ */
+static const char *jobState(const struct Job *job, char *buf, size_t len)
+{
+	if (job->numRunning > 0)
+		return "Running";
+
+	if (WIFSIGNALED(job->status))
+		snprintf(buf, len, "Signal %d", WTERMSIG(job->status));
+	else if (WEXITSTATUS(job->status) != 0)
+		snprintf(buf, len, "Exit %d", WEXITSTATUS(job->status));
+	else
+		return "Done";
+
+	return buf;
+}
+
+static void printJob(const struct Job *job)
+{
+	char buf[32];
+
+	printf("[%d] %-12s %s\n", job->id, jobState(job, buf, sizeof(buf)),
+			job->command);
+}
+
+/*
+ * Reports and removes background jobs that have finished.
+ */
+void notifyJobs()
+{
+	struct Job *job;
+
+	/* a shell with nothing running makes no system call here */
+	for (job = jobsHead; job != NULL && job->numRunning == 0;
+			job = job->next)
+		;
+	if (job != NULL)
+		runEvents(0);
+
+	job = jobsHead;
+	while (job != NULL) {
+		struct Job *next = job->next;
+
+		if (job->background && job->numRunning == 0) {
+			printJob(job);
+			removeJob(job);
+		}
+		job = next;
+	}
+}
+
+/*
+ * Prints the state of every background job.
+ */
+void printJobs()
+{
+	struct Job *job;
+
+	reapChildren();
+
+	for (job = jobsHead; job != NULL; job = job->next) {
+		if (job->background)
+			printJob(job);
+	}
+}
+
+/*
+ * Removes every job from the job table.
+ */
+void cleanupJobs()
+{
+	while (jobsHead != NULL)
+		removeJob(jobsHead);
+
+	while (freeJobs != NULL) {
+		struct Job *next = freeJobs->next;
+
+		free(freeJobs);
+		freeJobs = next;
+	}
+
+	free(pidTable);
+	pidTable = NULL;
+	pidTableSize = 0;
+	numPidSlots = 0;
+}
@@ -0,0 +1,117 @@
+#ifndef _JOBS_H_
+#define _JOBS_H_
+
+#include <sys/types.h>
+
+#include "pipeline.h"
+
+/* Every stage of a pipeline, plus a fan-out relay */
+#define MAXJOBPIDS (MAXSTAGES + 1)
+#define MAXJOBCOMMAND 256
+
+/*
+ * A job is every process started for one command line.
+ * Each process is also entered in a table keyed by pid, so a reaped
+ * child is matched to its job in constant time. Its exit is read from
+ * a pidfd watched by the event loop, which names the process itself,
+ * so no other child is looked at and a pid that is reused cannot be
+ * mistaken for it. A process without a pidfd is reaped by pid after a
+ * SIGCHLD.
+ * Jobs are kept in a doubly linked list in the order they started.
+ * Removed jobs are kept for reuse, so starting a job does not
+ * allocate memory once the shell is warmed up.
+ */
+struct Job {
+	int id;
+	int background;
+	int numPids;
+	int numRunning;
+	int status;
+	char command[MAXJOBCOMMAND];
+	pid_t pids[MAXJOBPIDS];
+	struct Job *next;
+	struct Job *prev;
+};
+
+/*
+ * Has SIGCHLD handled by the event loop, which reaps the children that
+ * exited without a pidfd. Must be called before any job starts.
+ */
+void initJobs();
+
+/*
+ * Adds a job made of the numPids processes in pids to the job table.
+ * numPids must not be more than MAXJOBPIDS.
+ * command is a description of the job, copied (and possibly
+ * truncated) for display.
+ * Returns the new job.
+ */
+struct Job *addJob(const pid_t pids[], int numPids, const char *command,
+		int background);
+
+/*
+ * Has the child pid, which belongs to no job, reaped once it exits.
+ */
+void disownChild(pid_t pid);
+
+/*
+ * Removes job from the job table and frees it.
+ */
+void removeJob(struct Job *job);
+
+/*
+ * Returns the oldest job, or NULL if there are none.
+ * The rest follow through job->next.
+ */
+struct Job *firstJob();
+
+/*
+ * Returns the most recently started job, or NULL if there are none.
+ */
+struct Job *lastJob();
+
+/*
+ * Returns the job with the given job number, or NULL.
+ */
+struct Job *findJob(int id);
+
+/*
+ * Returns the job that pid belongs to, or NULL.
+ */
+struct Job *findJobByPid(pid_t pid);
+
+/*
+ * Reaps every child that has exited, without blocking,
+ * and records its exit status in its job and its resource usage in
+ * the trace.
+ */
+void reapChildren();
+
+/*
+ * Waits until every process in job has exited.
+ * Returns the wait status of the job's last process.
+ */
+int waitJob(struct Job *job);
+
+/*
+ * Converts a wait status into a shell exit status: the exit code of a
+ * process that exited, or 128 plus the signal that killed it.
+ */
+int exitStatus(int status);
+
+/*
+ * Reports and removes background jobs that have finished.
+ */
+void notifyJobs();
+
+/*
+ * Prints the state of every background job.
+ */
+void printJobs();
+
+/*
+ * Removes every job from the job table.
+ */
+void cleanupJobs();
+
+#endif
@@ -0,0 +1,581 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+#include "builtin.h"
+#include "complete.h"
+#include "events.h"
+#include "histindex.h"
+#include "history.h"
+#include "lineedit.h"
+#include "pathwatch.h"
+#include "util.h"
+
+#define KEYCTRL(c) ((c) & 0x1f)
+#define ESC 27
+#define BACKSPACE 127
+
+/* the delete key, which has no byte of its own */
+#define DELETE 0x100
+
+/* ask before listing more completions than this */
+#define LISTQUERY 100
+
+/* the most matches ^R steps through */
+#define SEARCHMATCHES 64
+
+/* a growable string */
+struct Text {
+	char *s;
+	size_t len;
+	size_t cap;
+};
+
+/* the line being edited */
+static struct Text line;
+static size_t cursor;
+
+/* the line being edited before stepping into the history */
+static struct Text saved;
+
+/* what ^R is looking for */
+static struct Text query;
+
+/* what is sent to the terminal, written at once */
+static struct Text out;
+
+/* the terminal in raw mode and its own settings, while a line is edited */
+static int rawFd = -1;
+static struct termios orig;
+
+static void reserve(struct Text *t, size_t len)
+{
+	if (len + 1 <= t->cap)
+		return;
+
+	t->cap = t->cap ? t->cap : 128;
+	while (t->cap < len + 1)
+		t->cap *= 2;
+	t->s = realloc(t->s, t->cap);
+	if (t->s == NULL)
+		errMalloc();
+}
+
+static void setText(struct Text *t, const char *s)
+{
+	t->len = strlen(s);
+	reserve(t, t->len);
+	memcpy(t->s, s, t->len + 1);
+}
+
+static void appendText(struct Text *t, const char *s, size_t len)
+{
+	reserve(t, t->len + len);
+	memcpy(t->s + t->len, s, len);
+	t->len += len;
+	t->s[t->len] = '\0';
+}
+
+static void appendString(struct Text *t, const char *s)
+{
+	appendText(t, s, strlen(s));
+}
+
+/*
+ * Writes what has been added to out to the terminal.
+ */
+static void flush()
+{
+	size_t done = 0;
+
+	while (done < out.len) {
+		ssize_t n = write(STDOUT_FILENO, out.s + done, out.len - done);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		done += n;
+	}
+	out.len = 0;
+}
+
+/*
+ * Returns the next byte typed, or -1 at end of input.
+ */
+static int readKey(int fd)
+{
+	unsigned char c;
+	ssize_t n;
+
+	/* a byte at a time, so nothing meant for a command is consumed */
+	waitReadable(fd);
+	do {
+		n = read(fd, &c, 1);
+	} while (n < 0 && errno == EINTR);
+
+	return n == 1 ? c : -1;
+}
+
+static size_t terminalWidth()
+{
+	struct winsize ws;
+
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0 || ws.ws_col == 0)
+		return 80;
+	return ws.ws_col;
+}
+
+/*
+ * Redraws the prompt and the line. A line that does not fit is scrolled
+ * sideways to keep the cursor in view.
+ */
+static void refresh(const char *prompt)
+{
+	size_t promptLen = strlen(prompt);
+	size_t width = terminalWidth();
+	size_t room = width > promptLen + 1 ? width - promptLen - 1 : 1;
+	size_t start = cursor > room ? cursor - room : 0;
+	size_t shown = line.len - start < room ? line.len - start : room;
+	size_t column = promptLen + cursor - start;
+	char move[32];
+
+	appendString(&out, "\r");
+	appendString(&out, prompt);
+	appendText(&out, line.s + start, shown);
+	appendString(&out, "\x1b[0K\r");
+	if (column > 0) {
+		/* a count of 0 would still move one column */
+		snprintf(move, sizeof(move), "\x1b[%zuC", column);
+		appendString(&out, move);
+	}
+	flush();
+}
+
+static void insertText(const char *s, size_t len)
+{
+	reserve(&line, line.len + len);
+	memmove(line.s + cursor + len, line.s + cursor, line.len - cursor + 1);
+	memcpy(line.s + cursor, s, len);
+	line.len += len;
+	cursor += len;
+}
+
+static void deleteText(size_t from, size_t to)
+{
+	memmove(line.s + from, line.s + to, line.len - to + 1);
+	line.len -= to - from;
+	cursor = from;
+}
+
+/*
+ * Replaces the line with history entry n, counting back from the most
+ * recent as 1; 0 is the line being edited.
+ */
+static void showHistory(int n)
+{
+	if (n == 0)
+		setText(&line, saved.s);
+	else
+		setText(&line, historyEntry(historyCount() - n + 1));
+	cursor = line.len;
+}
+
+/*
+ * Prints the candidates for the word before the cursor in columns,
+ * asking first if there are many.
+ */
+static void listCompletions(int fd, const char *prompt)
+{
+	struct Completion comp;
+	size_t width = terminalWidth();
+	size_t colWidth = 0;
+	unsigned int cols, rows, r, c, i;
+
+	completeLine(&PATH, line.s, cursor, 1, &comp);
+	appendString(&out, "\r\n");
+
+	if (comp.count > LISTQUERY) {
+		char query[64];
+		int key;
+
+		snprintf(query, sizeof(query),
+				"Display all %u possibilities? (y or n)",
+				comp.count);
+		appendString(&out, query);
+		flush();
+		do {
+			key = readKey(fd);
+		} while (key != -1 && key != 'y' && key != 'Y' && key != 'n' &&
+				key != 'N' && key != KEYCTRL('C') && key != KEYCTRL('D'));
+		appendString(&out, "\r\n");
+		if (key != 'y' && key != 'Y') {
+			refresh(prompt);
+			return;
+		}
+	}
+
+	for (i = 0; i < comp.numNames; i++) {
+		if (strlen(comp.names[i]) + 2 > colWidth)
+			colWidth = strlen(comp.names[i]) + 2;
+	}
+	cols = colWidth < width ? width / colWidth : 1;
+	rows = (comp.numNames + cols - 1) / cols;
+
+	/* down the columns, like ls */
+	for (r = 0; r < rows; r++) {
+		for (c = 0; c < cols; c++) {
+			i = c * rows + r;
+			if (i >= comp.numNames)
+				break;
+			appendString(&out, comp.names[i]);
+			if ((c + 1) * rows + r < comp.numNames) {
+				size_t pad = colWidth - strlen(comp.names[i]);
+
+				while (pad-- > 0)
+					appendString(&out, " ");
+			}
+		}
+		appendString(&out, "\r\n");
+	}
+	if (comp.numNames < comp.count) {
+		char more[64];
+
+		snprintf(more, sizeof(more), "(%u more)\r\n",
+				comp.count - comp.numNames);
+		appendString(&out, more);
+	}
+	refresh(prompt);
+}
+
+/*
+ * Completes the word before the cursor. A second Tab in a row lists the
+ * candidates if there was nothing to add.
+ */
+static void complete(int fd, const char *prompt, int again)
+{
+	struct Completion comp;
+
+	/* pick up programs installed while the prompt was up */
+	drainPathWatch();
+
+	if (completeLine(&PATH, line.s, cursor, 0, &comp) == 0) {
+		appendString(&out, "\a");
+		flush();
+		return;
+	}
+
+	if (comp.insert[0] != '\0') {
+		insertText(comp.insert, strlen(comp.insert));
+		refresh(prompt);
+	} else if (again) {
+		listCompletions(fd, prompt);
+	} else {
+		appendString(&out, "\a");
+		flush();
+	}
+}
+
+/*
+ * Reads the rest of an escape sequence and returns the control key it
+ * stands for, or 0 if it means nothing here.
+ */
+static int readEscape(int fd)
+{
+	int c = readKey(fd);
+	int d;
+
+	if (c != '[' && c != 'O')
+		return 0;
+
+	d = readKey(fd);
+	if (c == '[' && d >= '0' && d <= '9') {
+		/* ESC [ n ~ */
+		if (readKey(fd) != '~')
+			return 0;
+		switch (d) {
+		case '1':
+		case '7':
+			return KEYCTRL('A');
+		case '4':
+		case '8':
+			return KEYCTRL('E');
+		case '3':
+			return DELETE;
+		}
+		return 0;
+	}
+
+	switch (d) {
+	case 'A':
+		return KEYCTRL('P');
+	case 'B':
+		return KEYCTRL('N');
+	case 'C':
+		return KEYCTRL('F');
+	case 'D':
+		return KEYCTRL('B');
+	case 'H':
+		return KEYCTRL('A');
+	case 'F':
+		return KEYCTRL('E');
+	}
+	return 0;
+}
+
+/*
+ * Shows the match of a reverse search, with the cursor where the query
+ * was found in it.
+ */
+static void showMatch(int failed)
+{
+	struct Text prompt = { NULL, 0, 0 };
+	const char *at = strstr(line.s, query.s);
+
+	appendString(&prompt, failed ? "(failed reverse-i-search)`" :
+			"(reverse-i-search)`");
+	appendString(&prompt, query.s);
+	appendString(&prompt, "': ");
+
+	cursor = at != NULL ? at - line.s : line.len;
+	refresh(prompt.s);
+	free(prompt.s);
+}
+
+/*
+ * Searches the history for what is typed, showing the best match (see
+ * searchHistory()); ^R steps to the next one, ^G gives up and restores
+ * the line. Any other key ends the search, leaving the match in the
+ * line.
+ * Returns that key, for the editor to act on, or 0.
+ */
+static int reverseSearch(int fd)
+{
+	int found[SEARCHMATCHES];
+	int numFound = 0;
+	int pos = 0;
+	int failed = 0;
+
+	setText(&saved, line.s);
+	setText(&query, "");
+	showMatch(0);
+
+	while (1) {
+		int key = readKey(fd);
+
+		if (key == KEYCTRL('R')) {
+			if (pos + 1 < numFound)
+				pos++;
+			else
+				appendString(&out, "\a");
+		} else if (key == BACKSPACE || key == KEYCTRL('H')) {
+			if (query.len > 0)
+				query.s[--query.len] = '\0';
+			pos = 0;
+			numFound = searchHistory(query.s, found, SEARCHMATCHES);
+		} else if (key >= ' ' && key <= 0xff) {
+			char c = key;
+
+			appendText(&query, &c, 1);
+			pos = 0;
+			numFound = searchHistory(query.s, found, SEARCHMATCHES);
+		} else if (key == KEYCTRL('G')) {
+			setText(&line, saved.s);
+			cursor = line.len;
+			return 0;
+		} else {
+			cursor = line.len;
+			return key == ESC ? readEscape(fd) : key;
+		}
+
+		/* with nothing found the last match stays */
+		failed = query.len > 0 && numFound == 0;
+		if (numFound > 0)
+			setText(&line, historyEntry(found[pos]));
+		else if (query.len == 0)
+			setText(&line, saved.s);
+		if (failed)
+			appendString(&out, "\a");
+		showMatch(failed);
+	}
+}
+
+/*
+ * Edits a line until Enter, ^C or the end of input.
+ * Returns 1 for a line, 0 to start over, -1 at end of input.
+ */
+static int edit(int fd, const char *prompt)
+{
+	int historyPos = 0;
+	int lastTab = 0;
+	int next = 0;
+
+	while (1) {
+		int key = next != 0 ? next : readKey(fd);
+		int tab = 0;
+		char c;
+		size_t i;
+
+		next = 0;
+		if (key == -1)
+			return line.len > 0 ? 1 : -1;
+		if (key == ESC)
+			key = readEscape(fd);
+
+		switch (key) {
+		case '\r':
+		case '\n':
+			appendString(&out, "\r\n");
+			flush();
+			return 1;
+		case KEYCTRL('C'):
+			appendString(&out, "^C\r\n");
+			flush();
+			return 0;
+		case KEYCTRL('D'):
+			if (line.len == 0) {
+				appendString(&out, "\r\n");
+				flush();
+				return -1;
+			}
+			if (cursor < line.len)
+				deleteText(cursor, cursor + 1);
+			break;
+		case DELETE:
+			if (cursor < line.len)
+				deleteText(cursor, cursor + 1);
+			break;
+		case BACKSPACE:
+		case KEYCTRL('H'):
+			if (cursor > 0)
+				deleteText(cursor - 1, cursor);
+			break;
+		case '\t':
+			complete(fd, prompt, lastTab);
+			tab = 1;
+			break;
+		case KEYCTRL('A'):
+			cursor = 0;
+			break;
+		case KEYCTRL('E'):
+			cursor = line.len;
+			break;
+		case KEYCTRL('B'):
+			if (cursor > 0)
+				cursor--;
+			break;
+		case KEYCTRL('F'):
+			if (cursor < line.len)
+				cursor++;
+			break;
+		case KEYCTRL('K'):
+			deleteText(cursor, line.len);
+			break;
+		case KEYCTRL('U'):
+			deleteText(0, cursor);
+			break;
+		case KEYCTRL('W'):
+			/* the word before the cursor and the blanks after it */
+			i = cursor;
+			while (i > 0 && line.s[i - 1] == ' ')
+				i--;
+			while (i > 0 && line.s[i - 1] != ' ')
+				i--;
+			deleteText(i, cursor);
+			break;
+		case KEYCTRL('R'):
+			next = reverseSearch(fd);
+			break;
+		case KEYCTRL('L'):
+			appendString(&out, "\x1b[H\x1b[2J");
+			break;
+		case KEYCTRL('P'):
+			if (historyPos == historyCount())
+				break;
+			if (historyPos == 0)
+				setText(&saved, line.s);
+			showHistory(++historyPos);
+			break;
+		case KEYCTRL('N'):
+			if (historyPos > 0)
+				showHistory(--historyPos);
+			break;
+		default:
+			if (key < ' ' || key == BACKSPACE || key > 0xff)
+				break;
+			c = key;
+			insertText(&c, 1);
+			break;
+		}
+
+		if (!tab)
+			refresh(prompt);
+		lastTab = tab;
+	}
+}
+
+/*
+ * Shows prompt and reads a line from the terminal fd.
+ * The line stays valid until the next call to editLine().
+ * Returns NULL at end of input (^D on an empty line).
+ */
+char *editLine(int fd, const char *prompt)
+{
+	struct termios raw;
+	int result;
+
+	/* anything printed before the prompt goes first */
+	fflush(stdout);
+
+	if (tcgetattr(fd, &orig) < 0)
+		return NULL;
+	raw = orig;
+	raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+	raw.c_cflag |= CS8;
+	raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+	raw.c_cc[VMIN] = 1;
+	raw.c_cc[VTIME] = 0;
+
+	/* TCSADRAIN keeps what was typed ahead */
+	if (tcsetattr(fd, TCSADRAIN, &raw) < 0)
+		return NULL;
+	rawFd = fd;
+
+	do {
+		setText(&line, "");
+		cursor = 0;
+		refresh(prompt);
+		result = edit(fd, prompt);
+	} while (result == 0);
+
+	tcsetattr(fd, TCSADRAIN, &orig);
+	rawFd = -1;
+
+	return result > 0 ? line.s : NULL;
+}
+
+/*
+ * Releases the editor's buffers, and restores the terminal if a line
+ * is being edited.
+ */
+void closeLineEditor()
+{
+	if (rawFd >= 0) {
+		tcsetattr(rawFd, TCSADRAIN, &orig);
+		rawFd = -1;
+	}
+
+	free(line.s);
+	free(saved.s);
+	free(query.s);
+	free(out.s);
+	memset(&line, 0, sizeof(line));
+	memset(&saved, 0, sizeof(saved));
+	memset(&query, 0, sizeof(query));
+	memset(&out, 0, sizeof(out));
+	cursor = 0;
+}
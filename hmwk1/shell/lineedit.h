@@ -0,0 +1,29 @@
+#ifndef _LINEEDIT_H_
+#define _LINEEDIT_H_
+
+/*
+ * A line editor for terminals. The terminal is put in raw mode while a
+ * line is edited and restored before it is returned, so commands run
+ * with the settings the shell started with.
+ *
+ * Keys: left/right, ^B/^F, home/end, ^A/^E move the cursor; backspace,
+ * delete, ^D, ^K, ^U, ^W delete; up/down, ^P/^N step through the
+ * history, and ^R searches it (histindex.h); ^L clears the screen; ^C
+ * abandons the line. Tab completes a command or file name (complete.h),
+ * and a second Tab lists the candidates.
+ */
+
+/*
+ * Shows prompt and reads a line from the terminal fd.
+ * The line stays valid until the next call to editLine().
+ * Returns NULL at end of input (^D on an empty line).
+ */
+char *editLine(int fd, const char *prompt);
+
+/*
+ * Releases the editor's buffers, and restores the terminal if a line
+ * is being edited.
+ */
+void closeLineEditor();
+
+#endif
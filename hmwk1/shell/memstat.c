@@ -0,0 +1,45 @@
+#include <stdlib.h>
+
+#include "memstat.h"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static struct MemStats counts;
+
+void *__wrap_malloc(size_t size)
+{
+	counts.mallocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	counts.callocs++;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	counts.reallocs++;
+	return __real_realloc(ptr, size);
+}
+
+/*
+ * Copies the current counts into stats.
+ */
+void getMemStats(struct MemStats *stats)
+{
+	*stats = counts;
+}
+
+/*
+ * Sets every count back to zero.
+ */
+void resetMemStats()
+{
+	counts.mallocs = 0;
+	counts.callocs = 0;
+	counts.reallocs = 0;
+}
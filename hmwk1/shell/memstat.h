@@ -0,0 +1,25 @@
+#ifndef _MEMSTAT_H_
+#define _MEMSTAT_H_
+
+/*
+ * Counts of the calls made by the shell's own code to malloc(),
+ * calloc() and realloc(). The shell is linked with --wrap for each
+ * of them, so calls made inside the C library are not counted.
+ */
+struct MemStats {
+	unsigned long mallocs;
+	unsigned long callocs;
+	unsigned long reallocs;
+};
+
+/*
+ * Copies the current counts into stats.
+ */
+void getMemStats(struct MemStats *stats);
+
+/*
+ * Sets every count back to zero.
+ */
+void resetMemStats();
+
+#endif
@@ -0,0 +1,435 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+
+#include "arena.h"
+#include "builtin.h"
+#include "dispatch.h"
+#include "events.h"
+#include "input.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "profile.h"
+#include "search.h"
+#include "spawn.h"
+#include "util.h"
+
+#define MINOUTPUT 4096
+#define MAXFAILED 101
+
+/*
+ * One started job. Records are kept in the order the jobs started,
+ * which with -k is also the order their output is written in.
+ */
+struct ParallelJob {
+	int fd;			/* read end of its stdout, -1 at EOF */
+	struct Job *job;	/* NULL once it has exited */
+	int status;
+	char *out;
+	size_t len;
+	size_t cap;
+	struct ParallelJob *next;
+	struct ParallelJob *prev;
+};
+
+struct Parallel {
+	int slots;
+	int keepOrder;
+
+	/* the command template, words[0..numWords) */
+	char * const *words;
+	int numWords;
+
+	/* inputs after ":::", or lines of stdin if inputs is NULL */
+	char * const *inputs;
+	struct Input stdinInput;
+	int inputDone;
+
+	int devNull;
+	int running;
+	int failed;
+	int writeFailed;
+
+	struct ParallelJob *head;
+	struct ParallelJob *tail;
+	struct ParallelJob *freeList;
+	struct Arena scratch;
+};
+
+/*
+ * Returns the next input, or NULL when there are no more.
+ */
+static const char *nextInput(struct Parallel *p)
+{
+	const char *input;
+
+	if (p->inputs != NULL) {
+		input = *p->inputs;
+		if (input != NULL)
+			p->inputs++;
+	} else {
+		input = readLine(&p->stdinInput);
+	}
+
+	if (input == NULL)
+		p->inputDone = 1;
+
+	return input;
+}
+
+/*
+ * Returns a copy of word with every "{}" replaced by input, allocated
+ * from the scratch arena. Sets *replaced if there was one.
+ */
+static char *substitute(struct Parallel *p, const char *word,
+		const char *input, int *replaced)
+{
+	size_t inputLen = strlen(input);
+	size_t len = 0;
+	const char *s;
+	char *copy;
+
+	for (s = strstr(word, "{}"); s != NULL; s = strstr(s + 2, "{}"))
+		len += inputLen;
+	if (len == 0)
+		return (char *)word;
+
+	copy = arenaAlloc(&p->scratch, strlen(word) + len + 1);
+	len = 0;
+	while ((s = strstr(word, "{}")) != NULL) {
+		memcpy(copy + len, word, s - word);
+		len += s - word;
+		memcpy(copy + len, input, inputLen);
+		len += inputLen;
+		word = s + 2;
+	}
+	strcpy(copy + len, word);
+
+	*replaced = 1;
+	return copy;
+}
+
+static struct ParallelJob *newRecord(struct Parallel *p)
+{
+	struct ParallelJob *rec = p->freeList;
+
+	if (rec != NULL) {
+		p->freeList = rec->next;
+	} else {
+		rec = calloc(1, sizeof(*rec));
+		if (rec == NULL)
+			errMalloc();
+	}
+
+	rec->fd = -1;
+	rec->job = NULL;
+	rec->status = 0;
+	rec->len = 0;
+
+	rec->next = NULL;
+	rec->prev = p->tail;
+	if (p->tail != NULL)
+		p->tail->next = rec;
+	else
+		p->head = rec;
+	p->tail = rec;
+
+	return rec;
+}
+
+/*
+ * Unlinks rec and keeps it, and its output buffer, for the next job.
+ */
+static void freeRecord(struct Parallel *p, struct ParallelJob *rec)
+{
+	if (rec->prev != NULL)
+		rec->prev->next = rec->next;
+	else
+		p->head = rec->next;
+
+	if (rec->next != NULL)
+		rec->next->prev = rec->prev;
+	else
+		p->tail = rec->prev;
+
+	rec->next = p->freeList;
+	p->freeList = rec;
+}
+
+static void readOutput(int fd, unsigned int events, void *data);
+
+/*
+ * Starts the job for the next input, if there is one.
+ */
+static void startNext(struct Parallel *p)
+{
+	char command[MAXJOBCOMMAND];
+	const struct Builtin *builtin;
+	struct ParallelJob *rec;
+	const char *input;
+	const char *path = NULL;
+	char **args;
+	int replaced = 0;
+	int pipeFds[2];
+	size_t used = 0;
+	pid_t pid;
+	int i;
+
+	input = nextInput(p);
+	if (input == NULL)
+		return;
+
+	arenaReset(&p->scratch);
+	args = arenaAlloc(&p->scratch, sizeof(char *) * (p->numWords + 2));
+	for (i = 0; i < p->numWords; i++)
+		args[i] = substitute(p, p->words[i], input, &replaced);
+	if (!replaced)
+		args[i++] = arenaStrdup(&p->scratch, input);
+	args[i] = NULL;
+
+	rec = newRecord(p);
+
+	builtin = findBuiltin(args[0]);
+	if (builtin == NULL) {
+		unsigned long long start = profileStart();
+		path = getFullPath(&PATH, args[0]);
+		profileEnd(PHASE_LOOKUP, start);
+		if (path == NULL) {
+			/* finished before it started */
+			rec->status = 127;
+			return;
+		}
+	}
+
+	if (pipe2(pipeFds, O_CLOEXEC) < 0) {
+		err(strerror(errno));
+		rec->status = 1;
+		return;
+	}
+
+	int fds[3] = { p->devNull, pipeFds[1], -1 };
+	if (builtin != NULL)
+		pid = spawnBuiltin(builtin, args, fds);
+	else
+		pid = spawnProcess(path, args, fds);
+	close(pipeFds[1]);
+
+	if (pid < 0) {
+		err(strerror(errno));
+		close(pipeFds[0]);
+		rec->status = 1;
+		return;
+	}
+
+	command[0] = '\0';
+	for (i = 0; args[i] != NULL && used < sizeof(command); i++)
+		used += snprintf(command + used, sizeof(command) - used,
+				i ? " %s" : "%s", args[i]);
+
+	rec->fd = pipeFds[0];
+	rec->job = addJob(&pid, 1, command, 0);
+	p->running++;
+
+	/* with no loop to read it from, the output is collected now */
+	if (watchFd(rec->fd, EPOLLIN, readOutput, rec) < 0) {
+		while (rec->fd >= 0)
+			readOutput(rec->fd, EPOLLIN, rec);
+	}
+}
+
+/*
+ * Reads whatever is available from the output of rec, the data of the
+ * watch on fd.
+ */
+static void readOutput(int fd, unsigned int events, void *data)
+{
+	struct ParallelJob *rec = data;
+	ssize_t n;
+
+	if (rec->len == rec->cap) {
+		size_t cap = rec->cap ? rec->cap * 2 : MINOUTPUT;
+		char *out = realloc(rec->out, cap);
+
+		if (out == NULL)
+			errMalloc();
+		rec->out = out;
+		rec->cap = cap;
+	}
+
+	n = read(rec->fd, rec->out + rec->len, rec->cap - rec->len);
+	if (n > 0) {
+		rec->len += n;
+	} else if (n == 0 || (errno != EINTR && errno != EAGAIN)) {
+		unwatchFd(rec->fd);
+		close(rec->fd);
+		rec->fd = -1;
+	}
+}
+
+/*
+ * Writes the output of a finished job to stdout and forgets it.
+ */
+static void emit(struct Parallel *p, struct ParallelJob *rec)
+{
+	const char *out = rec->out;
+	size_t len = rec->len;
+
+	if (rec->status != 0)
+		p->failed++;
+
+	while (len > 0 && !p->writeFailed) {
+		ssize_t n = write(STDOUT_FILENO, out, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			fprintf(stderr, "parallel: write error: %s\n",
+					strerror(errno));
+			p->writeFailed = 1;
+			break;
+		}
+		out += n;
+		len -= n;
+	}
+
+	freeRecord(p, rec);
+}
+
+static int isFinished(const struct ParallelJob *rec)
+{
+	return rec->fd < 0 && rec->job == NULL;
+}
+
+/*
+ * Collects the jobs that have exited and closed their output, and
+ * writes out every output that may be written now.
+ * Returns the number of jobs that finished.
+ */
+static int finishJobs(struct Parallel *p)
+{
+	struct ParallelJob *rec;
+	struct ParallelJob *next;
+	int finished = 0;
+
+	for (rec = p->head; rec != NULL; rec = rec->next) {
+		if (rec->job == NULL || rec->job->numRunning > 0 || rec->fd >= 0)
+			continue;
+
+		rec->status = exitStatus(rec->job->status);
+		removeJob(rec->job);
+		rec->job = NULL;
+		p->running--;
+		finished++;
+	}
+
+	for (rec = p->head; rec != NULL; rec = next) {
+		next = rec->next;
+
+		if (isFinished(rec))
+			emit(p, rec);
+		else if (p->keepOrder)
+			break;
+	}
+
+	return finished;
+}
+
+static int usage()
+{
+	err("usage: parallel [-j N] [-k] command [arg ...] [::: input ...]");
+	STATUS = 2;
+	return 1;
+}
+
+int runParallel(int argc, char * const args[])
+{
+	struct Parallel p;
+	int i = 1;
+
+	memset(&p, 0, sizeof(p));
+	p.slots = sysconf(_SC_NPROCESSORS_ONLN);
+
+	for (; args[i] != NULL && args[i][0] == '-'; i++) {
+		const char *value = NULL;
+
+		if (strcmp(args[i], "-k") == 0) {
+			p.keepOrder = 1;
+			continue;
+		} else if (strcmp(args[i], "-j") == 0) {
+			value = args[++i];
+		} else if (strncmp(args[i], "-j", 2) == 0) {
+			value = args[i] + 2;
+		}
+
+		if (value == NULL || *value == '\0' || !isNumber(value) ||
+				atoi(value) < 1)
+			return usage();
+		p.slots = atoi(value);
+	}
+
+	p.words = args + i;
+	while (args[i] != NULL && strcmp(args[i], ":::") != 0)
+		i++;
+	p.numWords = args + i - p.words;
+
+	if (p.numWords == 0)
+		return usage();
+
+	if (args[i] != NULL)
+		p.inputs = args + i + 1;
+	else if (openInput(&p.stdinInput, STDIN_FILENO, 0) < 0)
+		errMalloc();
+
+	p.devNull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	initArena(&p.scratch, 1024);
+	fflush(stdout);
+
+	while (1) {
+		while (p.running < p.slots && !p.inputDone)
+			startNext(&p);
+
+		/*
+		 * Exits are reaped, and outputs read, by the event loop; an
+		 * exit since the last check is waiting on its pidfd.
+		 */
+		if (finishJobs(&p) > 0)
+			continue;
+
+		if (p.inputDone && p.head == NULL)
+			break;
+
+		if (runEvents(-1) < 0 && errno != EINTR) {
+			struct ParallelJob *rec = p.head;
+
+			/* without a loop, block on a job itself */
+			while (rec != NULL && rec->job == NULL)
+				rec = rec->next;
+			if (rec != NULL)
+				waitJob(rec->job);
+		}
+	}
+
+	while (p.freeList != NULL) {
+		struct ParallelJob *rec = p.freeList;
+
+		p.freeList = rec->next;
+		free(rec->out);
+		free(rec);
+	}
+	freeArena(&p.scratch);
+	if (p.devNull >= 0)
+		close(p.devNull);
+	if (p.inputs == NULL)
+		closeInput(&p.stdinInput);
+
+	STATUS = p.failed < MAXFAILED ? p.failed : MAXFAILED;
+	if (p.writeFailed && STATUS == 0)
+		STATUS = 1;
+
+	return 1;
+}
@@ -0,0 +1,28 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+/*
+ * Runs the builtin parallel function:
+ *
+ *	parallel [-j N] [-k] command [arg ...] ::: input ...
+ *	parallel [-j N] [-k] command [arg ...] < inputs
+ *
+ * Runs command once for every input word after ":::", or for every
+ * line of stdin if there is no ":::", with at most N (default: the
+ * number of online CPUs) running at once. Each "{}" in the command is
+ * replaced by the input; if there is none the input is appended as
+ * the last argument.
+ *
+ * The command is resolved with getFullPath() and started by
+ * spawnProcess(), or forked if it is a builtin. Its stdin is
+ * /dev/null and its stdout is collected, then written out in one piece
+ * when it finishes, so the output of different jobs is never mixed.
+ * With -k the outputs are written in input order instead of the order
+ * the jobs finish in.
+ *
+ * The exit status is the number of jobs that failed, or 101 if more
+ * than 100 did.
+ */
+int runParallel(int argc, char * const args[]);
+
+#endif
@@ -0,0 +1,604 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+#include "pathindex.h"
+#include "search.h"
+#include "util.h"
+
+#define PATHINDEXMAGIC "W4118IDX"
+#define PATHINDEXVERSION 1
+
+/*
+ * The index, in memory and in the cache file:
+ *
+ *	struct IndexHeader
+ *	struct IndexDir		dirs[numDirs]		in path list order
+ *	struct IndexEntry	entries[numEntries]	sorted by name
+ *	char			strings[stringsSize]	NUL-terminated names
+ *
+ * Names are stored as offsets into strings.
+ */
+struct IndexHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t numDirs;
+	uint32_t numEntries;
+	uint32_t stringsSize;
+	uint64_t size;
+};
+
+/* all zero for a directory that did not exist */
+struct IndexDir {
+	uint64_t dev;
+	uint64_t ino;
+	int64_t mtimeSec;
+	int64_t mtimeNsec;
+	uint32_t name;
+	uint32_t pad;
+};
+
+struct IndexEntry {
+	uint32_t name;
+	uint32_t dir;
+};
+
+/* an executable found while scanning */
+struct Found {
+	const char *name;
+	uint32_t dir;
+};
+
+static char *indexFile;
+static char *image;
+static size_t imageSize;
+static int mapped;
+static int watched;
+static unsigned int version;
+
+/* names forgotten since the image was loaded, an open-addressed set */
+static char **staleNames;
+static uint32_t staleSize;
+static uint32_t numStale;
+
+static const struct IndexHeader *header()
+{
+	return (const struct IndexHeader *)image;
+}
+
+static const struct IndexDir *indexDirs()
+{
+	return (const struct IndexDir *)(header() + 1);
+}
+
+static const struct IndexEntry *indexEntries()
+{
+	return (const struct IndexEntry *)(indexDirs() + header()->numDirs);
+}
+
+static const char *indexStrings()
+{
+	return (const char *)(indexEntries() + header()->numEntries);
+}
+
+/*
+ * FNV-1a hash of a NULL-terminated string.
+ */
+static uint32_t hashName(const char *s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+/*
+ * Returns the slot of name in staleNames, or the empty slot where it
+ * belongs. The set must not be full.
+ */
+static uint32_t staleSlot(const char *name)
+{
+	uint32_t i = hashName(name) & (staleSize - 1);
+
+	while (staleNames[i] != NULL && strcmp(staleNames[i], name) != 0)
+		i = (i + 1) & (staleSize - 1);
+
+	return i;
+}
+
+static int isStale(const char *name)
+{
+	return numStale > 0 && staleNames[staleSlot(name)] != NULL;
+}
+
+static void clearStale()
+{
+	uint32_t i;
+
+	for (i = 0; i < staleSize; i++)
+		free(staleNames[i]);
+
+	free(staleNames);
+	staleNames = NULL;
+	staleSize = 0;
+	numStale = 0;
+}
+
+/*
+ * Sets the file the index is saved to and loaded from.
+ * With NULL the index is built in memory and never saved.
+ */
+void setPathIndexFile(const char *path)
+{
+	free(indexFile);
+	indexFile = NULL;
+
+	if (path != NULL) {
+		indexFile = strdup(path);
+		if (indexFile == NULL)
+			errMalloc();
+	}
+}
+
+/*
+ * Records what the directory dirFd looks like now.
+ */
+static void describeDir(int dirFd, struct IndexDir *dir)
+{
+	struct stat st;
+
+	memset(dir, 0, sizeof(*dir));
+	if (dirFd < 0 || fstat(dirFd, &st) < 0)
+		return;
+
+	dir->dev = st.st_dev;
+	dir->ino = st.st_ino;
+	dir->mtimeSec = st.st_mtim.tv_sec;
+	dir->mtimeNsec = st.st_mtim.tv_nsec;
+}
+
+/*
+ * Checks that the image is well formed and was built for the given
+ * directories, none of which has changed since.
+ * Returns 1 if it can be used, 0 otherwise.
+ */
+static int isCurrent(const char * const dirs[], const int dirFds[],
+		int numDirs)
+{
+	const struct IndexHeader *h = header();
+	const struct IndexEntry *entries;
+	const char *strings;
+	uint32_t i;
+
+	if (imageSize < sizeof(*h) ||
+			memcmp(h->magic, PATHINDEXMAGIC, 8) != 0 ||
+			h->version != PATHINDEXVERSION ||
+			h->size != imageSize || h->numDirs != numDirs ||
+			h->stringsSize == 0 ||
+			sizeof(*h) + (uint64_t)h->numDirs * sizeof(struct IndexDir) +
+			(uint64_t)h->numEntries * sizeof(struct IndexEntry) +
+			h->stringsSize != imageSize)
+		return 0;
+
+	entries = indexEntries();
+	strings = indexStrings();
+	if (strings[h->stringsSize - 1] != '\0')
+		return 0;
+
+	for (i = 0; i < h->numDirs; i++) {
+		const struct IndexDir *dir = &indexDirs()[i];
+		struct IndexDir now;
+
+		describeDir(dirFds[i], &now);
+		if (dir->name >= h->stringsSize ||
+				strcmp(strings + dir->name, dirs[i]) != 0 ||
+				dir->dev != now.dev || dir->ino != now.ino ||
+				dir->mtimeSec != now.mtimeSec ||
+				dir->mtimeNsec != now.mtimeNsec)
+			return 0;
+	}
+
+	for (i = 0; i < h->numEntries; i++) {
+		if (entries[i].name >= h->stringsSize ||
+				entries[i].dir >= h->numDirs)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Maps the cache file if it holds an index for the given directories.
+ * Returns 0 on success, -1 if there is no usable cache file.
+ */
+static int mapIndexFile(const char * const dirs[], const int dirFds[],
+		int numDirs)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	if (indexFile == NULL)
+		return -1;
+
+	fd = open(indexFile, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(struct IndexHeader)) {
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	image = map;
+	imageSize = st.st_size;
+	mapped = 1;
+
+	if (!isCurrent(dirs, dirFds, numDirs)) {
+		closePathIndex();
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Adds every executable in the directory dirFd to found.
+ */
+static void scanDir(int dirFd, uint32_t dirNum, struct Arena *names,
+		struct Found **found, size_t *numFound, size_t *maxFound)
+{
+	struct dirent *ent;
+	DIR *dirStream;
+	int fd;
+
+	if (dirFd < 0)
+		return;
+
+	/* an O_PATH descriptor cannot be read from */
+	fd = openat(dirFd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	dirStream = fdopendir(fd);
+	if (dirStream == NULL) {
+		close(fd);
+		return;
+	}
+
+	while ((ent = readdir(dirStream)) != NULL) {
+		if (ent->d_type == DT_DIR || strcmp(ent->d_name, ".") == 0 ||
+				strcmp(ent->d_name, "..") == 0)
+			continue;
+		if (!isExecutable(dirFd, ent->d_name))
+			continue;
+
+		if (*numFound == *maxFound) {
+			size_t max = *maxFound ? *maxFound * 2 : 1024;
+			struct Found *grown = realloc(*found,
+					sizeof(**found) * max);
+
+			if (grown == NULL)
+				errMalloc();
+			*found = grown;
+			*maxFound = max;
+		}
+
+		(*found)[*numFound].name = arenaStrdup(names, ent->d_name);
+		(*found)[*numFound].dir = dirNum;
+		(*numFound)++;
+	}
+
+	closedir(dirStream);
+}
+
+/*
+ * Orders by name, then by position in the path list.
+ */
+static int compareFound(const void *a, const void *b)
+{
+	const struct Found *x = a, *y = b;
+	int cmp = strcmp(x->name, y->name);
+
+	if (cmp != 0)
+		return cmp;
+	return (x->dir > y->dir) - (x->dir < y->dir);
+}
+
+/*
+ * Scans the directories and builds the index in memory.
+ */
+static void buildIndex(const char * const dirs[], const int dirFds[],
+		int numDirs)
+{
+	struct IndexHeader *h;
+	struct IndexDir *indexDir;
+	struct IndexEntry *entry;
+	struct Found *found = NULL;
+	size_t numFound = 0;
+	size_t maxFound = 0;
+	size_t numEntries = 0;
+	size_t stringsSize = 1;
+	struct Arena names;
+	char *strings;
+	size_t i;
+	size_t used;
+
+	initArena(&names, 16384);
+	for (i = 0; i < numDirs; i++) {
+		scanDir(dirFds[i], i, &names, &found, &numFound, &maxFound);
+		stringsSize += strlen(dirs[i]) + 1;
+	}
+
+	/* keep the first directory of every name */
+	qsort(found, numFound, sizeof(*found), compareFound);
+	for (i = 0; i < numFound; i++) {
+		if (i > 0 && strcmp(found[i].name, found[i - 1].name) == 0)
+			continue;
+		found[numEntries++] = found[i];
+		stringsSize += strlen(found[i].name) + 1;
+	}
+
+	imageSize = sizeof(*h) + numDirs * sizeof(*indexDir) +
+		numEntries * sizeof(*entry) + stringsSize;
+	image = calloc(1, imageSize);
+	if (image == NULL)
+		errMalloc();
+	mapped = 0;
+
+	h = (struct IndexHeader *)image;
+	memcpy(h->magic, PATHINDEXMAGIC, sizeof(h->magic));
+	h->version = PATHINDEXVERSION;
+	h->numDirs = numDirs;
+	h->numEntries = numEntries;
+	h->stringsSize = stringsSize;
+	h->size = imageSize;
+
+	indexDir = (struct IndexDir *)(h + 1);
+	entry = (struct IndexEntry *)(indexDir + numDirs);
+	strings = (char *)(entry + numEntries);
+
+	/* offset 0 is the empty string */
+	used = 1;
+	for (i = 0; i < numDirs; i++) {
+		describeDir(dirFds[i], &indexDir[i]);
+		indexDir[i].name = used;
+		strcpy(strings + used, dirs[i]);
+		used += strlen(dirs[i]) + 1;
+	}
+
+	for (i = 0; i < numEntries; i++) {
+		entry[i].name = used;
+		entry[i].dir = found[i].dir;
+		strcpy(strings + used, found[i].name);
+		used += strlen(found[i].name) + 1;
+	}
+
+	free(found);
+	freeArena(&names);
+}
+
+/*
+ * Replaces the cache file with the index in memory. Another shell may
+ * be reading the old file, so a new file is written and renamed over
+ * it. Failures are ignored; the file is only a cache.
+ */
+static void saveIndex()
+{
+	size_t len = strlen(indexFile);
+	char temp[len + 8];
+	size_t done = 0;
+	int fd;
+
+	snprintf(temp, sizeof(temp), "%s.XXXXXX", indexFile);
+	fd = mkostemp(temp, O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	while (done < imageSize) {
+		ssize_t n = write(fd, image + done, imageSize - done);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		done += n;
+	}
+
+	if (close(fd) < 0 || done < imageSize || rename(temp, indexFile) < 0)
+		unlink(temp);
+}
+
+/*
+ * Loads the index for the numDirs directories dirs, whose descriptors
+ * (opened with O_PATH, -1 if missing) are in dirFds. The cache file is
+ * used if it matches the directories, otherwise they are scanned and
+ * the cache file is rewritten.
+ */
+void loadPathIndex(const char * const dirs[], const int dirFds[], int numDirs)
+{
+	closePathIndex();
+	version++;
+
+	if (mapIndexFile(dirs, dirFds, numDirs) == 0)
+		return;
+
+	buildIndex(dirs, dirFds, numDirs);
+	if (indexFile != NULL)
+		saveIndex();
+}
+
+/*
+ * Returns 1 if an index is loaded, 0 otherwise.
+ */
+int pathIndexLoaded()
+{
+	return image != NULL;
+}
+
+/*
+ * Returns the position in the path list of the first directory holding
+ * the executable name, -1 if it is not in the index, or -2 if name was
+ * forgotten with pathIndexForget().
+ */
+int pathIndexFind(const char *name)
+{
+	const struct IndexEntry *entries;
+	const char *strings;
+	uint32_t low = 0;
+	uint32_t high;
+
+	if (image == NULL)
+		return -1;
+	if (isStale(name))
+		return -2;
+
+	entries = indexEntries();
+	strings = indexStrings();
+	high = header()->numEntries;
+
+	while (low < high) {
+		uint32_t mid = low + (high - low) / 2;
+		int cmp = strcmp(name, strings + entries[mid].name);
+
+		if (cmp == 0)
+			return entries[mid].dir;
+		if (cmp < 0)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+
+	return -1;
+}
+
+/*
+ * Marks name as changed in one of the directories since the index was
+ * built; pathIndexFind() no longer answers for it.
+ */
+void pathIndexForget(const char *name)
+{
+	uint32_t i;
+
+	if (image == NULL || isStale(name))
+		return;
+
+	/* keep the set at most half full */
+	if (2 * (numStale + 1) > staleSize) {
+		char **old = staleNames;
+		uint32_t oldSize = staleSize;
+
+		staleSize = staleSize ? staleSize * 2 : 64;
+		staleNames = calloc(staleSize, sizeof(*staleNames));
+		if (staleNames == NULL)
+			errMalloc();
+
+		for (i = 0; i < oldSize; i++) {
+			if (old[i] != NULL)
+				staleNames[staleSlot(old[i])] = old[i];
+		}
+		free(old);
+	}
+
+	i = staleSlot(name);
+	staleNames[i] = strdup(name);
+	if (staleNames[i] == NULL)
+		errMalloc();
+	numStale++;
+	version++;
+}
+
+/*
+ * Calls fn for every name in the index, in sorted order, with forgotten
+ * set to 0, then for every name forgotten since it was built, with
+ * forgotten set to 1. Forgotten names may no longer exist.
+ */
+void forEachPathIndexName(void (*fn)(const char *name, int forgotten,
+			void *arg), void *arg)
+{
+	const struct IndexEntry *entries;
+	const char *strings;
+	uint32_t i;
+
+	if (image == NULL)
+		return;
+
+	entries = indexEntries();
+	strings = indexStrings();
+	for (i = 0; i < header()->numEntries; i++) {
+		if (!isStale(strings + entries[i].name))
+			fn(strings + entries[i].name, 0, arg);
+	}
+
+	for (i = 0; i < staleSize; i++) {
+		if (staleNames[i] != NULL)
+			fn(staleNames[i], 1, arg);
+	}
+}
+
+/*
+ * Returns a number that changes whenever the set of names the index
+ * answers for may have changed.
+ */
+unsigned int pathIndexVersion()
+{
+	return version;
+}
+
+/*
+ * Tells the index whether every directory is watched for changes, so
+ * that pathIndexForget() is called for every name added or removed.
+ * The answers of pathIndexFind() are then known to be current.
+ */
+void setPathIndexWatched(int on)
+{
+	watched = on;
+}
+
+/*
+ * Returns 1 if every directory is watched, 0 otherwise.
+ */
+int pathIndexWatched()
+{
+	return watched;
+}
+
+/*
+ * Unmaps or frees the index.
+ */
+void closePathIndex()
+{
+	clearStale();
+	if (image == NULL)
+		return;
+
+	version++;
+
+	if (mapped)
+		munmap(image, imageSize);
+	else
+		free(image);
+
+	image = NULL;
+	imageSize = 0;
+	mapped = 0;
+}
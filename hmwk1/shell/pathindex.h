@@ -0,0 +1,82 @@
+#ifndef _PATHINDEX_H_
+#define _PATHINDEX_H_
+
+/*
+ * An index of every executable in the directories of the path list:
+ * a sorted array of {name, directory} records, in which a name appears
+ * once, with the first directory that holds it.
+ *
+ * The index is saved to a cache file along with the device, inode and
+ * modification time of every directory. A shell starting with the same
+ * path list maps the file and uses it as is, without reading the
+ * directories, as long as none of them has changed; otherwise the
+ * directories are scanned and the file is replaced.
+ *
+ * The image itself is never changed. Names that change while it is in
+ * use are recorded separately (pathIndexForget()) and looked up in the
+ * directories instead.
+ */
+
+/*
+ * Sets the file the index is saved to and loaded from.
+ * With NULL the index is built in memory and never saved.
+ */
+void setPathIndexFile(const char *path);
+
+/*
+ * Loads the index for the numDirs directories dirs, whose descriptors
+ * (opened with O_PATH, -1 if missing) are in dirFds. The cache file is
+ * used if it matches the directories, otherwise they are scanned and
+ * the cache file is rewritten.
+ */
+void loadPathIndex(const char * const dirs[], const int dirFds[], int numDirs);
+
+/*
+ * Returns 1 if an index is loaded, 0 otherwise.
+ */
+int pathIndexLoaded();
+
+/*
+ * Returns the position in the path list of the first directory holding
+ * the executable name, -1 if it is not in the index, or -2 if name was
+ * forgotten with pathIndexForget().
+ */
+int pathIndexFind(const char *name);
+
+/*
+ * Marks name as changed in one of the directories since the index was
+ * built; pathIndexFind() no longer answers for it.
+ */
+void pathIndexForget(const char *name);
+
+/*
+ * Tells the index whether every directory is watched for changes, so
+ * that pathIndexForget() is called for every name added or removed.
+ */
+void setPathIndexWatched(int on);
+
+/*
+ * Returns 1 if every directory is watched, 0 otherwise.
+ */
+int pathIndexWatched();
+
+/*
+ * Calls fn for every name in the index, in sorted order, with forgotten
+ * set to 0, then for every name forgotten since it was built, with
+ * forgotten set to 1. Forgotten names may no longer exist.
+ */
+void forEachPathIndexName(void (*fn)(const char *name, int forgotten,
+			void *arg), void *arg);
+
+/*
+ * Returns a number that changes whenever the set of names the index
+ * answers for may have changed.
+ */
+unsigned int pathIndexVersion();
+
+/*
+ * Unmaps or frees the index.
+ */
+void closePathIndex();
+
+#endif
@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+
+#include "events.h"
+#include "hash.h"
+#include "pathindex.h"
+#include "pathwatch.h"
+#include "search.h"
+#include "util.h"
+
+/* changes that can make a name resolve differently */
+#define NAMEEVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+		IN_ATTRIB)
+/* the directory itself is gone */
+#define SELFEVENTS (IN_DELETE_SELF | IN_MOVE_SELF)
+
+/*
+ * One entry of the path list, with watches on the directory and on its
+ * parent. The parent is watched because the shell keeps the directory
+ * open (see search.c), and an open directory that is removed does not
+ * report IN_DELETE_SELF until it is closed; its parent reports the
+ * removal at once.
+ *
+ * A directory listed twice, or reached through a symbolic link, shares
+ * its watch descriptor with the other entries, so watches are added
+ * with IN_MASK_ADD and only removed when no entry uses them. wd is -1
+ * while the directory is not watched.
+ */
+struct WatchedDir {
+	char *dir;
+	const char *base;	/* last component of dir, in parent */
+	int wd;
+	int parentWd;
+	struct WatchedDir *next;
+};
+
+static int inotifyFd = -1;
+static struct WatchedDir *watched;
+
+static void forgetAll();
+
+static void onWatchEvents(int fd, unsigned int events, void *data)
+{
+	drainPathWatch();
+}
+
+/*
+ * Creates the inotify instance, which the event loop reads when it has
+ * events, so an idle prompt costs no system call.
+ */
+static void openWatch()
+{
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0)
+		return;
+
+	if (watchFd(inotifyFd, EPOLLIN, onWatchEvents, NULL) < 0) {
+		close(inotifyFd);
+		inotifyFd = -1;
+	}
+}
+
+/*
+ * The index can only be trusted while every entry is watched.
+ */
+static void updateIndexWatched()
+{
+	struct WatchedDir *cur;
+
+	for (cur = watched; cur != NULL; cur = cur->next) {
+		if (cur->wd < 0) {
+			setPathIndexWatched(0);
+			return;
+		}
+	}
+
+	setPathIndexWatched(inotifyFd >= 0);
+}
+
+/*
+ * Returns 1 if any entry uses the watch descriptor wd, 0 otherwise.
+ */
+static int isWatched(int wd)
+{
+	struct WatchedDir *cur;
+
+	for (cur = watched; cur != NULL; cur = cur->next) {
+		if (cur->wd == wd || cur->parentWd == wd)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Removes the watch wd, unless an entry still uses it.
+ */
+static void releaseWatch(int wd)
+{
+	if (wd >= 0 && !isWatched(wd))
+		inotify_rm_watch(inotifyFd, wd);
+}
+
+static int addWatch(const char *dir, uint32_t mask)
+{
+	return inotify_add_watch(inotifyFd, dir, mask | IN_ONLYDIR |
+			IN_MASK_ADD);
+}
+
+/*
+ * Watches the parent of entry, once, and the directory if it exists.
+ * A directory that does not exist yet is watched when it is created in
+ * its parent.
+ */
+static void watchEntry(struct WatchedDir *entry)
+{
+	size_t len = entry->base - entry->dir;
+
+	if (entry->parentWd < 0 && *entry->base != '\0') {
+		/* the parent of "/a" is "/" */
+		char parent[len + 1];
+
+		memcpy(parent, entry->dir, len);
+		parent[len > 1 ? len - 1 : len] = '\0';
+		entry->parentWd = addWatch(parent, NAMEEVENTS);
+	}
+
+	entry->wd = addWatch(entry->dir, NAMEEVENTS | SELFEVENTS);
+}
+
+/*
+ * Starts watching the directories of the path list, and those added to
+ * it later.
+ */
+void startPathWatch()
+{
+	struct WatchedDir *cur;
+
+	if (inotifyFd >= 0)
+		return;
+
+	openWatch();
+	if (inotifyFd < 0)
+		return;
+
+	for (cur = watched; cur != NULL; cur = cur->next) {
+		if (cur->dir[0] == '/')
+			watchEntry(cur);
+	}
+
+	/* anything found before now was not watched */
+	forgetAll();
+}
+
+/*
+ * Records dir, which has been added to the path list, and watches it if
+ * the watch has been started. Relative directories are not watched.
+ */
+void watchPathDir(const char *dir)
+{
+	struct WatchedDir *entry = malloc(sizeof(*entry));
+	struct WatchedDir **tail;
+	char *end;
+
+	if (entry == NULL)
+		errMalloc();
+	entry->dir = strdup(dir);
+	if (entry->dir == NULL)
+		errMalloc();
+	entry->wd = -1;
+	entry->parentWd = -1;
+	entry->next = NULL;
+
+	/* "/usr/bin/" is "bin" in "/usr"; "/" has no parent */
+	end = entry->dir + strlen(entry->dir);
+	while (end > entry->dir + 1 && end[-1] == '/')
+		*--end = '\0';
+	entry->base = strrchr(entry->dir, '/');
+	entry->base = entry->base != NULL ? entry->base + 1 : entry->dir;
+
+	if (inotifyFd >= 0 && dir[0] == '/')
+		watchEntry(entry);
+
+	for (tail = &watched; *tail != NULL; tail = &(*tail)->next)
+		;
+	*tail = entry;
+
+	updateIndexWatched();
+}
+
+/*
+ * Stops watching dir, which has been removed from the path list once.
+ */
+void unwatchPathDir(const char *dir)
+{
+	size_t len = strlen(dir);
+	struct WatchedDir **prev;
+	struct WatchedDir *entry;
+
+	/* entries are kept without trailing slashes */
+	while (len > 1 && dir[len - 1] == '/')
+		len--;
+
+	for (prev = &watched; *prev != NULL; prev = &(*prev)->next) {
+		if (strncmp((*prev)->dir, dir, len) == 0 &&
+				(*prev)->dir[len] == '\0')
+			break;
+	}
+
+	entry = *prev;
+	if (entry == NULL)
+		return;
+
+	*prev = entry->next;
+	releaseWatch(entry->wd);
+	releaseWatch(entry->parentWd);
+
+	free(entry->dir);
+	free(entry);
+
+	updateIndexWatched();
+}
+
+/*
+ * Forgets everything found in the path list.
+ */
+static void forgetAll()
+{
+	searchInvalidate();
+	hashClear();
+	updateIndexWatched();
+}
+
+/*
+ * Stops watching the directory of entry, which has gone.
+ */
+static void dirGone(struct WatchedDir *entry)
+{
+	int wd = entry->wd;
+
+	if (wd < 0)
+		return;
+
+	entry->wd = -1;
+	releaseWatch(wd);
+}
+
+/*
+ * Handles one event: a name changing in a directory of the path list,
+ * a directory of the path list changing in its parent, or one going.
+ */
+static void handleEvent(const struct inotify_event *event)
+{
+	struct WatchedDir *cur;
+	int inPath = 0;
+	int gone = 0;
+
+	if (event->mask & IN_Q_OVERFLOW) {
+		forgetAll();
+		return;
+	}
+
+	for (cur = watched; cur != NULL; cur = cur->next) {
+		if (cur->wd == event->wd)
+			inPath = 1;
+
+		if (cur->wd == event->wd && (event->mask & SELFEVENTS)) {
+			dirGone(cur);
+			gone = 1;
+		} else if (cur->parentWd == event->wd && event->len > 0 &&
+				strcmp(cur->base, event->name) == 0) {
+			/* created, removed, replaced or its mode changed */
+			dirGone(cur);
+			watchEntry(cur);
+			gone = 1;
+		}
+	}
+
+	/* other names in a parent, such as $HOME, are not commands */
+	if (gone) {
+		forgetAll();
+	} else if (inPath && event->len > 0 && !(event->mask & IN_ISDIR)) {
+		hashRemove(event->name);
+		pathIndexForget(event->name);
+	}
+}
+
+/*
+ * Reads every pending event without blocking and forgets what changed.
+ */
+void drainPathWatch()
+{
+	/* aligned for struct inotify_event */
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+
+	if (inotifyFd < 0)
+		return;
+
+	while (1) {
+		ssize_t len = read(inotifyFd, buf, sizeof(buf));
+		char *p;
+
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			break;
+
+		for (p = buf; p < buf + len; ) {
+			struct inotify_event *event = (struct inotify_event *)p;
+
+			handleEvent(event);
+			p += sizeof(*event) + event->len;
+		}
+	}
+}
+
+/*
+ * Stops watching every directory.
+ */
+void closePathWatch()
+{
+	while (watched != NULL) {
+		struct WatchedDir *next = watched->next;
+
+		free(watched->dir);
+		free(watched);
+		watched = next;
+	}
+
+	if (inotifyFd >= 0) {
+		unwatchFd(inotifyFd);
+		close(inotifyFd);
+		inotifyFd = -1;
+	}
+
+	setPathIndexWatched(0);
+}
@@ -0,0 +1,43 @@
+#ifndef _PATHWATCH_H_
+#define _PATHWATCH_H_
+
+/*
+ * Watches the directories of the path list with inotify, so that the
+ * remembered locations of commands (hash.h) and the executable index
+ * (pathindex.h) are corrected as programs are installed or removed.
+ *
+ * A change to a name forgets only that name. If a directory itself is
+ * removed or renamed, or events were lost, everything is forgotten.
+ */
+
+/*
+ * Starts watching the directories of the path list, and those added to
+ * it later. Only worth it for a long-lived shell: closing an inotify
+ * instance waits for the kernel to release its watches, which can take
+ * milliseconds, so a short script would spend more time exiting than
+ * it could save.
+ */
+void startPathWatch();
+
+/*
+ * Records dir, which has been added to the path list, and watches it if
+ * the watch has been started. Relative directories are not watched.
+ */
+void watchPathDir(const char *dir);
+
+/*
+ * Stops watching dir, which has been removed from the path list once.
+ */
+void unwatchPathDir(const char *dir);
+
+/*
+ * Reads every pending event without blocking and forgets what changed.
+ */
+void drainPathWatch();
+
+/*
+ * Stops watching every directory.
+ */
+void closePathWatch();
+
+#endif
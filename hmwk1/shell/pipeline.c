@@ -0,0 +1,425 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include "builtin.h"
+#include "dispatch.h"
+#include "jobs.h"
+#include "pipeline.h"
+#include "profile.h"
+#include "relay.h"
+#include "search.h"
+#include "spawn.h"
+#include "trace.h"
+#include "util.h"
+
+static int syntaxError(const char *near)
+{
+	printf("error: syntax error near \"%s\"\n", near);
+	return -1;
+}
+
+/*
+ * Builds a pipeline from the numTokens tokens in tokens, which must not
+ * include the ";" or "&" that ends it; that token's text is passed as
+ * terminator (NULL at the end of the line) so a syntax error can name
+ * it. Argument arrays come from arena.
+ * Returns 0 on success, -1 after reporting a syntax error.
+ */
+int parsePipeline(struct Arena *arena, const struct Token *tokens,
+		int numTokens, const char *terminator, struct Pipeline *pipeline)
+{
+	const char *end = terminator != NULL ? terminator : "newline";
+	int i = 0;
+
+	pipeline->numStages = 0;
+	pipeline->fanout = -1;
+	pipeline->background = 0;
+
+	while (i < numTokens || pipeline->numStages == 0) {
+		struct Stage *stage;
+		int numWords = 0;
+		int j;
+
+		if (pipeline->numStages == MAXSTAGES) {
+			err("too many pipeline stages");
+			return -1;
+		}
+		stage = &pipeline->stages[pipeline->numStages++];
+		stage->in = NULL;
+		stage->out = NULL;
+		stage->append = 0;
+
+		/* size the argument array for this stage */
+		for (j = i; j < numTokens && tokens[j].type != TOK_PIPE &&
+				tokens[j].type != TOK_FANOUT; j++) {
+			if (tokens[j].type == TOK_WORD)
+				numWords++;
+		}
+		stage->args = arenaAlloc(arena, sizeof(char *) * (numWords + 1));
+
+		numWords = 0;
+		for (; i < j; i++) {
+			enum TokenType type = tokens[i].type;
+
+			if (type == TOK_WORD) {
+				stage->args[numWords++] = tokens[i].text;
+				continue;
+			}
+
+			/* a redirection, which must name a file */
+			if (i + 1 == j || tokens[i + 1].type != TOK_WORD)
+				return syntaxError(i + 1 < numTokens ?
+						tokens[i + 1].text : end);
+
+			if (type == TOK_IN) {
+				stage->in = tokens[++i].text;
+			} else {
+				stage->out = tokens[++i].text;
+				stage->append = (type == TOK_APPEND);
+			}
+		}
+		stage->args[numWords] = NULL;
+
+		if (numWords == 0)
+			return syntaxError(i < numTokens ? tokens[i].text : end);
+
+		if (i == numTokens)
+			break;
+
+		/* tokens[i] is "|" or "|+" */
+		if (tokens[i].type == TOK_PIPE && pipeline->fanout >= 0) {
+			err("syntax error: \"|\" after \"|+\"");
+			return -1;
+		}
+		if (tokens[i].type == TOK_FANOUT && pipeline->fanout < 0)
+			pipeline->fanout = pipeline->numStages;
+
+		if (++i == numTokens)
+			return syntaxError(end);
+	}
+
+	return 0;
+}
+
+/*
+ * Runs the fan-out relay in a forked child, for background pipelines.
+ */
+static pid_t spawnRelay(int src, int dsts[], int numDsts)
+{
+	pid_t pid = fork();
+	if (pid == 0)
+		_exit(relayFanout(src, dsts, numDsts) < 0 ? EXIT_FAILURE : 0);
+
+	if (pid > 0)
+		traceStart(pid, "[relay]");
+
+	return pid;
+}
+
+static void closeFd(int *fd)
+{
+	if (*fd >= 0) {
+		close(*fd);
+		*fd = -1;
+	}
+}
+
+/*
+ * Opens the files named by each stage's redirections, placing the
+ * descriptors (or -1) in redirIn[] and redirOut[].
+ * Returns 0 on success. On failure reports the error, closes anything
+ * opened and returns -1.
+ */
+static int openRedirections(const struct Pipeline *pipeline,
+		int redirIn[], int redirOut[])
+{
+	int i;
+
+	for (i = 0; i < pipeline->numStages; i++) {
+		const struct Stage *stage = &pipeline->stages[i];
+		const char *failed = NULL;
+
+		redirIn[i] = redirOut[i] = -1;
+
+		if (stage->in != NULL) {
+			redirIn[i] = open(stage->in, O_RDONLY | O_CLOEXEC);
+			if (redirIn[i] < 0)
+				failed = stage->in;
+		}
+
+		if (failed == NULL && stage->out != NULL) {
+			int flags = O_WRONLY | O_CREAT | O_CLOEXEC |
+				(stage->append ? O_APPEND : O_TRUNC);
+
+			redirOut[i] = open(stage->out, flags, 0666);
+			if (redirOut[i] < 0)
+				failed = stage->out;
+		}
+
+		if (failed != NULL) {
+			printf("error: %s: %s\n", failed, strerror(errno));
+			for (; i >= 0; i--) {
+				closeFd(&redirIn[i]);
+				closeFd(&redirOut[i]);
+			}
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Runs a builtin in the shell itself, with stdin and stdout temporarily
+ * replaced by inFd and outFd when they are not -1.
+ * Returns what runBuiltin() returns.
+ */
+static int runBuiltinRedirected(const struct Builtin *builtin,
+		char * const args[], int inFd, int outFd)
+{
+	int fds[3] = { inFd, outFd, -1 };
+	int saved[2] = { -1, -1 };
+	int ret;
+	int i;
+
+	fflush(stdout);
+	for (i = 0; i < 2; i++) {
+		if (fds[i] >= 0)
+			saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 10);
+	}
+
+	if (installFds(fds) < 0) {
+		err(strerror(errno));
+		ret = 1;
+	} else {
+		ret = runBuiltin(builtin, args);
+	}
+
+	/* output still buffered is written to the redirection */
+	if (fflush(stdout) == EOF) {
+		fprintf(stderr, "%s: write error: %s\n", args[0],
+				strerror(errno));
+		clearerr(stdout);
+		STATUS = 1;
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (saved[i] >= 0) {
+			dup2(saved[i], i);
+			close(saved[i]);
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * Writes the command line of pipeline into buf, for display in the
+ * job table. Long command lines are truncated.
+ */
+static void describePipeline(const struct Pipeline *pipeline, char *buf,
+		size_t len)
+{
+	size_t used = 0;
+	int i, j;
+
+	buf[0] = '\0';
+	for (i = 0; i < pipeline->numStages && used < len; i++) {
+		if (i > 0)
+			used += snprintf(buf + used, len - used, (i < pipeline->fanout ||
+					pipeline->fanout < 0) ? " | " : " |+ ");
+
+		const struct Stage *stage = &pipeline->stages[i];
+
+		for (j = 0; stage->args[j] != NULL && used < len; j++)
+			used += snprintf(buf + used, len - used, j ? " %s" : "%s",
+					stage->args[j]);
+
+		if (stage->in != NULL && used < len)
+			used += snprintf(buf + used, len - used, " < %s", stage->in);
+		if (stage->out != NULL && used < len)
+			used += snprintf(buf + used, len - used, " %s %s",
+					stage->append ? ">>" : ">", stage->out);
+	}
+
+	if (used < len && pipeline->background)
+		snprintf(buf + used, len - used, " &");
+}
+
+/*
+ * Runs every stage of the pipeline concurrently, connected by pipes.
+ * The stages are entered in the job table as one job. Unless the
+ * pipeline runs in the background, waits for all of them to finish.
+ * Returns 1 if the pipeline has completed.
+ * Returns 0 if the shell's exit command has been called.
+ * Returns -1 if a fatal error has occured.
+ */
+int runPipeline(struct Pipeline *pipeline)
+{
+	int n = pipeline->numStages;
+	const char *paths[MAXSTAGES] = {0};
+	const struct Builtin *builtins[MAXSTAGES] = {0};
+	pid_t pids[MAXSTAGES + 1];
+	int relayDsts[MAXSTAGES];
+	int numDsts = 0;
+	int relaySrc = -1;
+	int prevRead = -1;
+	int numPids = 0;
+	int redirIn[MAXSTAGES];
+	int redirOut[MAXSTAGES];
+	int i;
+
+	/* Resolve every stage before starting any of them */
+	for (i = 0; i < n; i++) {
+		char *command = pipeline->stages[i].args[0];
+
+		builtins[i] = findBuiltin(command);
+		if (builtins[i] != NULL)
+			continue;
+
+		unsigned long long start = profileStart();
+		paths[i] = getFullPath(&PATH, command);
+		profileEnd(PHASE_LOOKUP, start);
+		if (paths[i] == NULL) {
+			STATUS = 127;
+			return 1;
+		}
+	}
+
+	if (openRedirections(pipeline, redirIn, redirOut) < 0) {
+		STATUS = 1;
+		return 1;
+	}
+
+	/* A lone builtin runs in the shell itself */
+	if (n == 1 && !pipeline->background && builtins[0] != NULL) {
+		unsigned long long start = profileStart();
+		int ret = runBuiltinRedirected(builtins[0],
+				pipeline->stages[0].args,
+				redirIn[0], redirOut[0]);
+		profileEnd(PHASE_BUILTIN, start);
+
+		closeFd(&redirIn[0]);
+		closeFd(&redirOut[0]);
+		return ret;
+	}
+
+	for (i = 0; i < n; i++) {
+		int fds[3] = { -1, -1, -1 };
+		int p[2];
+
+		if (pipeline->fanout >= 0 && i >= pipeline->fanout) {
+			/* fan-out consumer: fed by the relay */
+			if (pipe2(p, O_CLOEXEC) < 0) {
+				err(strerror(errno));
+				break;
+			}
+			fds[0] = p[0];
+			relayDsts[numDsts++] = p[1];
+
+		} else if (i < n - 1) {
+			if (pipe2(p, O_CLOEXEC) < 0) {
+				err(strerror(errno));
+				break;
+			}
+			fds[0] = prevRead;
+			fds[1] = p[1];
+			prevRead = p[0];
+
+			if (i == pipeline->fanout - 1) {
+				relaySrc = p[0];
+				prevRead = -1;
+			}
+
+		} else {
+			fds[0] = prevRead;
+			prevRead = -1;
+		}
+
+		/* redirections take the place of the pipes */
+		int stdinFd = redirIn[i] >= 0 ? redirIn[i] : fds[0];
+		int stdoutFd = redirOut[i] >= 0 ? redirOut[i] : fds[1];
+		int stageFds[3] = { stdinFd, stdoutFd, -1 };
+
+		pid_t pid;
+		if (builtins[i] != NULL) {
+			unsigned long long start = profileStart();
+			pid = spawnBuiltin(builtins[i], pipeline->stages[i].args,
+					stageFds);
+			profileEnd(PHASE_SPAWN, start);
+		}
+		else
+			pid = spawnProcess(paths[i], pipeline->stages[i].args,
+					stageFds);
+
+		if (pid < 0)
+			err(strerror(errno));
+		else
+			pids[numPids++] = pid;
+
+		/* the children hold their own copies now */
+		closeFd(&fds[0]);
+		closeFd(&fds[1]);
+		closeFd(&redirIn[i]);
+		closeFd(&redirOut[i]);
+
+		if (pid < 0)
+			break;
+	}
+
+	closeFd(&prevRead);
+	for (; i < n; i++) {
+		closeFd(&redirIn[i]);
+		closeFd(&redirOut[i]);
+	}
+
+	if (relaySrc >= 0) {
+		if (numPids < n) {
+			while (numDsts > 0)
+				close(relayDsts[--numDsts]);
+
+		} else if (pipeline->background) {
+			/* relay from a child so the prompt comes back */
+			pid_t pid = spawnRelay(relaySrc, relayDsts, numDsts);
+
+			if (pid < 0) {
+				err(strerror(errno));
+			} else {
+				memmove(pids + 1, pids, sizeof(pid_t) * numPids++);
+				pids[0] = pid;
+			}
+			while (numDsts > 0)
+				close(relayDsts[--numDsts]);
+
+		} else {
+			relayFanout(relaySrc, relayDsts, numDsts);
+		}
+		close(relaySrc);
+	}
+
+	if (numPids > 0) {
+		char command[256];
+
+		describePipeline(pipeline, command, sizeof(command));
+		struct Job *job = addJob(pids, numPids, command,
+				pipeline->background);
+
+		if (pipeline->background) {
+			printf("[%d] %d\n", job->id, pids[numPids - 1]);
+			STATUS = 0;
+		} else {
+			unsigned long long start = profileStart();
+			STATUS = exitStatus(waitJob(job));
+			profileEnd(PHASE_WAIT, start);
+			removeJob(job);
+		}
+	}
+
+	return 1;
+}
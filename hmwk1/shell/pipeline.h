@@ -0,0 +1,54 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include "arena.h"
+#include "tokenizer.h"
+
+#define MAXSTAGES 64
+
+/*
+ * One command of a pipeline: a NULL-terminated argument array and the
+ * files named by its "<", ">" and ">>" redirections (or NULL).
+ */
+struct Stage {
+	char **args;
+	const char *in;
+	const char *out;
+	int append;
+};
+
+/*
+ * A command line split into stages on "|" and "|+".
+ * Stages from fanout onwards (if fanout >= 0) are separated by "|+":
+ * each of them receives a copy of the output of stage fanout - 1,
+ * relayed through the shell.
+ * A pipeline ending in "&" runs in the background.
+ */
+struct Pipeline {
+	int numStages;
+	int fanout;
+	int background;
+	struct Stage stages[MAXSTAGES];
+};
+
+/*
+ * Builds a pipeline from the numTokens tokens in tokens, which must not
+ * include the ";" or "&" that ends it; that token's text is passed as
+ * terminator (NULL at the end of the line) so a syntax error can name
+ * it. Argument arrays come from arena.
+ * Returns 0 on success, -1 after reporting a syntax error.
+ */
+int parsePipeline(struct Arena *arena, const struct Token *tokens,
+		int numTokens, const char *terminator, struct Pipeline *pipeline);
+
+/*
+ * Runs every stage of the pipeline concurrently, connected by pipes.
+ * The stages are entered in the job table as one job. Unless the
+ * pipeline runs in the background, waits for all of them to finish.
+ * Returns 1 if the pipeline has completed.
+ * Returns 0 if the shell's exit command has been called.
+ * Returns -1 if a fatal error has occured.
+ */
+int runPipeline(struct Pipeline *pipeline);
+
+#endif
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "profile.h"
+
+/* 2^SUBBITS buckets per power of two */
+#define SUBBITS 3
+#define SUBBUCKETS (1 << SUBBITS)
+#define NUMBUCKETS ((64 - SUBBITS + 1) * SUBBUCKETS)
+
+struct Histogram {
+	unsigned long long count;
+	unsigned long long total;
+	unsigned long long max;
+	unsigned long long buckets[NUMBUCKETS];
+};
+
+int PROFILING;
+
+static struct Histogram histograms[NUMPHASES];
+
+static const char *phaseNames[NUMPHASES] = {
+	[PHASE_READ] = "readInput",
+	[PHASE_HISTORY] = "history",
+	[PHASE_PARSE] = "parse",
+	[PHASE_BUILTIN] = "builtin",
+	[PHASE_LOOKUP] = "getFullPath",
+	[PHASE_SPAWN] = "spawn",
+	[PHASE_EXEC] = "exec",
+	[PHASE_WAIT] = "wait",
+	[PHASE_COMMAND] = "command",
+};
+
+static unsigned long long now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * Values below SUBBUCKETS get a bucket each. Above that each power of
+ * two is split into SUBBUCKETS buckets by the bits after the top one.
+ */
+static int bucketOf(unsigned long long v)
+{
+	int shift;
+
+	if (v < SUBBUCKETS)
+		return v;
+
+	shift = 63 - __builtin_clzll(v) - SUBBITS;
+	return (shift + 1) * SUBBUCKETS + ((v >> shift) & (SUBBUCKETS - 1));
+}
+
+/*
+ * Returns the midpoint of the values that fall in bucket.
+ */
+static unsigned long long bucketValue(int bucket)
+{
+	int shift;
+
+	if (bucket < SUBBUCKETS)
+		return bucket;
+
+	shift = bucket / SUBBUCKETS - 1;
+	return ((unsigned long long)(SUBBUCKETS + bucket % SUBBUCKETS) << shift) +
+			((1ull << shift) >> 1);
+}
+
+/*
+ * Returns the value below which a fraction p of the samples fall.
+ */
+static unsigned long long percentile(const struct Histogram *h, double p)
+{
+	unsigned long long rank = (unsigned long long)(p * h->count);
+	unsigned long long seen = 0;
+	int i;
+
+	if (rank >= h->count)
+		rank = h->count - 1;
+
+	for (i = 0; i < NUMBUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen > rank)
+			break;
+	}
+
+	/* the exact maximum is better than the middle of its bucket */
+	if (i >= NUMBUCKETS || bucketValue(i) > h->max)
+		return h->max;
+
+	return bucketValue(i);
+}
+
+/*
+ * Turns profiling on or off. The recorded histograms are kept.
+ */
+void setProfiling(int on)
+{
+	PROFILING = on;
+}
+
+/*
+ * Returns the current time in nanoseconds if profiling is on, else 0.
+ */
+unsigned long long profileStart()
+{
+	return PROFILING ? now() : 0;
+}
+
+/*
+ * Records the time since start in the histogram of phase.
+ * Does nothing if start is 0.
+ */
+void profileEnd(enum ProfilePhase phase, unsigned long long start)
+{
+	struct Histogram *h = &histograms[phase];
+	unsigned long long elapsed;
+
+	if (start == 0)
+		return;
+
+	elapsed = now() - start;
+	h->count++;
+	h->total += elapsed;
+	if (elapsed > h->max)
+		h->max = elapsed;
+	h->buckets[bucketOf(elapsed)]++;
+}
+
+/*
+ * Prints the count, p50, p99, max and total time of every phase.
+ */
+void profileReport()
+{
+	int i;
+
+	printf("%-12s %10s %10s %10s %10s %12s\n", "phase", "count",
+			"p50(us)", "p99(us)", "max(us)", "total(ms)");
+
+	for (i = 0; i < NUMPHASES; i++) {
+		const struct Histogram *h = &histograms[i];
+
+		if (h->count == 0)
+			continue;
+
+		printf("%-12s %10llu %10.1f %10.1f %10.1f %12.3f\n",
+				phaseNames[i], h->count,
+				percentile(h, 0.50) / 1e3,
+				percentile(h, 0.99) / 1e3,
+				h->max / 1e3, h->total / 1e6);
+	}
+}
+
+/*
+ * Clears every histogram.
+ */
+void profileReset()
+{
+	memset(histograms, 0, sizeof(histograms));
+}
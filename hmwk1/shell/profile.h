@@ -0,0 +1,52 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+/*
+ * Opt-in latency profiling of the shell's command loop.
+ * Each phase keeps a histogram of its durations with eight buckets per
+ * power of two, so percentiles are reported to within 12.5%.
+ */
+enum ProfilePhase {
+	PHASE_READ,		/* readLine() */
+	PHASE_HISTORY,		/* "!n" expansion and addToHistory() */
+	PHASE_PARSE,		/* parseLine() */
+	PHASE_BUILTIN,		/* a builtin run in the shell itself */
+	PHASE_LOOKUP,		/* getFullPath() */
+	PHASE_SPAWN,		/* fork() or posix_spawn() */
+	PHASE_EXEC,		/* from spawnProcess() returning to the exec */
+	PHASE_WAIT,		/* waiting for a foreground job */
+	PHASE_COMMAND,		/* everything after readLine() for one line */
+	NUMPHASES
+};
+
+/* Set while profiling is on */
+extern int PROFILING;
+
+/*
+ * Turns profiling on or off. The recorded histograms are kept.
+ */
+void setProfiling(int on);
+
+/*
+ * Returns the current time in nanoseconds if profiling is on, else 0.
+ * Pass the result to profileEnd() when the phase is over.
+ */
+unsigned long long profileStart();
+
+/*
+ * Records the time since start in the histogram of phase.
+ * Does nothing if start is 0.
+ */
+void profileEnd(enum ProfilePhase phase, unsigned long long start);
+
+/*
+ * Prints the count, p50, p99, max and total time of every phase.
+ */
+void profileReport();
+
+/*
+ * Clears every histogram.
+ */
+void profileReset();
+
+#endif
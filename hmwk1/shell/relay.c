@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+
+#include "relay.h"
+#include "util.h"
+
+/*
+ * Moves exactly len bytes from the pipe in to out.
+ * Returns 0 on success, -1 if out could not take all of it.
+ */
+static int spliceAll(int in, int out, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = splice(in, NULL, out, NULL, len, SPLICE_F_MOVE);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Throws away len bytes from the front of the pipe in.
+ */
+static void discard(int in, size_t len)
+{
+	int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+	if (devNull < 0 || spliceAll(in, devNull, len) < 0) {
+		/* splice to /dev/null is unavailable; fall back to read() */
+		char buf[4096];
+
+		while (len > 0) {
+			ssize_t n = read(in, buf, len < sizeof(buf) ? len : sizeof(buf));
+
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				break;
+			len -= n;
+		}
+	}
+
+	if (devNull >= 0)
+		close(devNull);
+}
+
+/*
+ * Replaces the scratch pipe with an empty one.
+ * Used after a splice out of it fails part way through.
+ */
+static int resetScratch(int scratch[2])
+{
+	close(scratch[0]);
+	close(scratch[1]);
+
+	if (pipe2(scratch, O_CLOEXEC) < 0) {
+		scratch[0] = scratch[1] = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Copies everything written to the pipe src into each of the numDsts
+ * pipes in dsts, until src reaches end of file.
+ * Data is moved with tee() and splice(), so it is never copied into
+ * the shell's own buffers. A destination whose reader has gone away
+ * is closed and dropped; the others keep receiving data.
+ * Every destination is closed before returning.
+ * Returns 0 on success, -1 if relaying failed.
+ */
+int relayFanout(int src, int dsts[], int numDsts)
+{
+	int scratch[2];
+	int live = numDsts;
+	int ret = 0;
+	int i;
+	struct sigaction ignore, saved;
+
+	/* A consumer exiting early must not kill the shell */
+	memset(&ignore, 0, sizeof(ignore));
+	ignore.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &ignore, &saved);
+
+	if (pipe2(scratch, O_CLOEXEC) < 0) {
+		err(strerror(errno));
+		scratch[0] = scratch[1] = -1;
+		ret = -1;
+		goto out;
+	}
+
+	while (live > 0) {
+		ssize_t len;
+
+		if (live == 1) {
+			/* Nothing to duplicate; move the data straight across */
+			len = splice(src, NULL, dsts[0], NULL, 1 << 16, SPLICE_F_MOVE);
+			if (len < 0 && errno == EINTR)
+				continue;
+			if (len == 0)
+				break;
+			if (len < 0) {
+				close(dsts[0]);
+				live = 0;
+			}
+			continue;
+		}
+
+		/*
+		 * tee() does not consume src, so every destination but the
+		 * last is fed a copy through the (empty) scratch pipe. The last
+		 * one takes the bytes out of src itself. The scratch pipe has
+		 * the same capacity as src, so a copy always fits whole.
+		 */
+		len = tee(src, scratch[1], INT_MAX, 0);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len < 0) {
+			err(strerror(errno));
+			ret = -1;
+			break;
+		}
+		if (len == 0)
+			break;
+
+		for (i = 0; i < live; i++) {
+			if (i == live - 1) {
+				if (spliceAll(src, dsts[i], len) < 0) {
+					discard(src, len);
+					close(dsts[i]);
+					dsts[i] = -1;
+				}
+				break;
+			}
+
+			if (i > 0 && tee(src, scratch[1], len, 0) != len) {
+				err("relay failed");
+				ret = -1;
+				goto out;
+			}
+
+			if (spliceAll(scratch[0], dsts[i], len) < 0) {
+				close(dsts[i]);
+				dsts[i] = -1;
+				if (resetScratch(scratch) < 0) {
+					err(strerror(errno));
+					ret = -1;
+					goto out;
+				}
+			}
+		}
+
+		/* drop consumers that have gone away */
+		int kept = 0;
+		for (i = 0; i < live; i++) {
+			if (dsts[i] >= 0)
+				dsts[kept++] = dsts[i];
+		}
+		live = kept;
+	}
+
+out:
+	for (i = 0; i < live; i++)
+		close(dsts[i]);
+
+	if (scratch[0] >= 0) {
+		close(scratch[0]);
+		close(scratch[1]);
+	}
+	sigaction(SIGPIPE, &saved, NULL);
+
+	return ret;
+}
@@ -0,0 +1,15 @@
+#ifndef _RELAY_H_
+#define _RELAY_H_
+
+/*
+ * Copies everything written to the pipe src into each of the numDsts
+ * pipes in dsts, until src reaches end of file.
+ * Data is moved with tee() and splice(), so it is never copied into
+ * the shell's own buffers. A destination whose reader has gone away
+ * is closed and dropped; the others keep receiving data.
+ * Every destination is closed before returning.
+ * Returns 0 on success, -1 if relaying failed.
+ */
+int relayFanout(int src, int dsts[], int numDsts);
+
+#endif
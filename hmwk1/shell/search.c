@@ -0,0 +1,321 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "list.h"
+#include "hash.h"
+#include "pathindex.h"
+#include "search.h"
+#include "util.h"
+
+/*
+ * Directory descriptors for the entries of the last path list searched,
+ * in list order. Absolute directories are opened once with O_PATH and
+ * kept; relative ones have fd -1 and are opened for every search, since
+ * they depend on the current directory.
+ */
+struct PathDir {
+	const char *name;
+	int fd;
+};
+
+static const struct List *cachedList;
+static struct PathDir *pathDirs;
+static int numPathDirs;
+
+/* set in a forked child, whose directory descriptors are its parent's */
+static int forked;
+
+static void onFork()
+{
+	forked = 1;
+}
+
+/*
+ * Forgets the directories of a forked child's parent without closing
+ * them: a builtin's child has closed every inherited descriptor
+ * (closeInheritedFds()), and the numbers may be in use again.
+ */
+static void forgetInherited()
+{
+	free(pathDirs);
+	pathDirs = NULL;
+	numPathDirs = 0;
+	cachedList = NULL;
+	forked = 0;
+}
+
+/*
+ * Returns 1 if file in the directory dirFd is a regular file that may
+ * be executed, 0 otherwise.
+ */
+int isExecutable(int dirFd, const char *file)
+{
+	struct stat st;
+
+	if (fstatat(dirFd, file, &st, 0) < 0 || !S_ISREG(st.st_mode))
+		return 0;
+
+	return faccessat(dirFd, file, X_OK, AT_EACCESS) == 0;
+}
+
+static int openDir(const char *dir)
+{
+	return open(dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+}
+
+/*
+ * Closes the directories cached for the last path list searched.
+ * Must be called whenever that list changes.
+ */
+void searchInvalidate()
+{
+	int i;
+
+	if (forked)
+		forgetInherited();
+
+	for (i = 0; i < numPathDirs; i++) {
+		if (pathDirs[i].fd >= 0)
+			close(pathDirs[i].fd);
+	}
+
+	free(pathDirs);
+	pathDirs = NULL;
+	numPathDirs = 0;
+	cachedList = NULL;
+	closePathIndex();
+}
+
+/*
+ * Opens the directories of path and loads their index, unless they are
+ * already cached.
+ */
+static void cachePath(const struct List *path)
+{
+	static int atForkSet;
+	struct Node *curNode;
+	int absolute = 1;
+	int i = 0;
+
+	if (forked)
+		forgetInherited();
+	if (cachedList == path)
+		return;
+
+	if (!atForkSet) {
+		pthread_atfork(NULL, NULL, onFork);
+		atForkSet = 1;
+	}
+
+	searchInvalidate();
+	for (curNode = path->head; curNode != NULL; curNode = curNode->next)
+		numPathDirs++;
+
+	pathDirs = malloc(sizeof(*pathDirs) * (numPathDirs + 1));
+	if (pathDirs == NULL)
+		errMalloc();
+
+	for (curNode = path->head; curNode != NULL; curNode = curNode->next) {
+		const char *dir = curNode->data;
+
+		pathDirs[i].name = dir;
+		pathDirs[i].fd = dir[0] == '/' ? openDir(dir) : -1;
+		if (dir[0] != '/')
+			absolute = 0;
+		i++;
+	}
+
+	cachedList = path;
+
+	/* the index cannot follow directories relative to the cwd */
+	if (absolute && numPathDirs > 0) {
+		const char *dirs[numPathDirs];
+		int dirFds[numPathDirs];
+
+		for (i = 0; i < numPathDirs; i++) {
+			dirs[i] = pathDirs[i].name;
+			dirFds[i] = pathDirs[i].fd;
+		}
+		loadPathIndex(dirs, dirFds, numPathDirs);
+	}
+}
+
+/*
+ * Searches in the given path list for file, an executable regular
+ * file. Names in the executable index (pathindex.h) cost two syscalls;
+ * others at most two per directory, however large the directories are.
+ * Returns a pointer to the path in which the file was found.
+ * Returns NULL if the file was not found in any path.
+ */
+char *searchPath(const struct List *path, const char *file)
+{
+	int i;
+
+	cachePath(path);
+
+	/*
+	 * A hit is checked against the directory, and a miss falls back to
+	 * probing every directory, even while they are watched: a saved
+	 * index is only matched against the directories' modification
+	 * times, which a chmod does not change, nor a file created in the
+	 * same tick as the scan.
+	 */
+	i = pathIndexFind(file);
+	if (i >= 0 && pathDirs[i].fd >= 0 && isExecutable(pathDirs[i].fd, file))
+		return (char *)pathDirs[i].name;
+
+	for (i = 0; i < numPathDirs; i++) {
+		struct PathDir *dir = &pathDirs[i];
+		int found;
+
+		if (dir->fd >= 0) {
+			found = isExecutable(dir->fd, file);
+		} else {
+			/* relative, or it did not exist when it was cached */
+			int fd = openDir(dir->name);
+
+			if (fd < 0)
+				continue;
+			found = isExecutable(fd, file);
+			if (dir->name[0] == '/')
+				dir->fd = fd;
+			else
+				close(fd);
+		}
+
+		if (found)
+			return (char *)dir->name;
+	}
+
+	/* File not found */
+	return NULL;
+}
+
+/*
+ * Forgets the remembered locations if path has relative directories,
+ * whose commands depend on the current directory.
+ * Must be called whenever the current directory changes.
+ */
+void searchChdir(const struct List *path)
+{
+	struct Node *curNode;
+
+	for (curNode = path->head; curNode != NULL; curNode = curNode->next) {
+		if (((const char *)curNode->data)[0] != '/') {
+			hashClear();
+			return;
+		}
+	}
+}
+
+struct ExecutableWalk {
+	const struct List *path;
+	void (*fn)(const char *name, void *arg);
+	void *arg;
+};
+
+static void listExecutable(const char *name, int forgotten, void *arg)
+{
+	struct ExecutableWalk *w = arg;
+
+	/* changed since the index was built; it may be gone */
+	if (forgotten && searchPath(w->path, name) == NULL)
+		return;
+
+	w->fn(name, w->arg);
+}
+
+/*
+ * Calls fn with the name of every executable in the path list, using
+ * the executable index. Nothing is listed for a path list with relative
+ * directories, which has no index.
+ */
+void forEachExecutable(const struct List *path,
+		void (*fn)(const char *name, void *arg), void *arg)
+{
+	struct ExecutableWalk w = { path, fn, arg };
+
+	cachePath(path);
+	forEachPathIndexName(listExecutable, &w);
+}
+
+/*
+ * Takes a directory where a file can be found,
+ * places the full path of the file in fullPath.
+ * Returns a pointer to fullPath.
+ */
+char *createFullPath(const char *dir, const char *file, char *fullPath)
+{
+	if (dir == NULL) {
+		/* Just return the file */
+		strcpy(fullPath, file);
+		return fullPath;
+	}
+
+	strcpy(fullPath, dir);
+
+	/* Add in the / before the file name */
+	int dirLen = strlen(dir);
+	if (dirLen == 0 || dir[dirLen - 1] != '/')
+		strcat(fullPath, "/");
+
+	strcat(fullPath, file);
+
+	return fullPath;
+}
+
+/*
+ * Resolves file through the path list and records the result in the
+ * command hash table. A miss is only recorded while every directory is
+ * watched (pathwatch.h), since nothing would forget it otherwise.
+ * Returns the new hash table entry, or NULL for a miss not recorded.
+ */
+struct HashEntry *hashCommand(const struct List *path, const char *file)
+{
+	char *dir = searchPath(path, file);
+	if (dir == NULL)
+		return pathIndexWatched() ? hashInsert(file, NULL) : NULL;
+
+	/* add an extra space in case an extra '/' is needed */
+	char fullPath[strlen(dir) + strlen(file) + 2];
+	createFullPath(dir, file, fullPath);
+
+	return hashInsert(file, fullPath);
+}
+
+/*
+ * Searches for file in each directory in the path list.
+ * Results are remembered in the command hash table, and misses too
+ * while the path list is watched. If found returns a pointer to the
+ * complete path. The string belongs to the hash table (or is file
+ * itself, if file contains a '/') and stays valid until the path list
+ * or, if it has relative directories, the current directory changes.
+ * Returns NULL if the file cannot be found in the path.
+ */
+const char *getFullPath(const struct List *path, const char *file)
+{
+	/* If file contains any / characters, it should be
+	   interpreted as complete path. */
+	if (strchr(file, '/') != NULL)
+		return file;
+
+	struct HashEntry *entry = hashFind(file);
+	if (entry == NULL)
+		entry = hashCommand(path, file);
+
+	if (entry != NULL)
+		entry->hits++;
+	if (entry == NULL || entry->path == NULL) {
+		err("no such file or directory");
+		return NULL;
+	}
+
+	return entry->path;
+}
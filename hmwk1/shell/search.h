@@ -0,0 +1,62 @@
+#ifndef _SEARCH_H_
+#define _SEARCH_H_
+
+#include "list.h"
+#include "hash.h"
+
+/*
+ * Returns 1 if file in the directory dirFd is a regular file that may
+ * be executed, 0 otherwise.
+ */
+int isExecutable(int dirFd, const char *file);
+
+/*
+ * Searches in the given path list for file, an executable regular
+ * file. Names in the executable index (pathindex.h) cost two syscalls;
+ * others at most two per directory, however large the directories are.
+ * Returns a pointer to the path in which the file was found.
+ * Returns NULL if the file was not found in any path.
+ */
+char *searchPath(const struct List *path, const char *file);
+
+/*
+ * Closes the directories cached for the last path list searched.
+ * Must be called whenever that list changes.
+ */
+void searchInvalidate();
+
+/*
+ * Forgets the remembered locations if path has relative directories,
+ * whose commands depend on the current directory.
+ * Must be called whenever the current directory changes.
+ */
+void searchChdir(const struct List *path);
+
+/*
+ * Calls fn with the name of every executable in the path list, using
+ * the executable index. Nothing is listed for a path list with relative
+ * directories, which has no index.
+ */
+void forEachExecutable(const struct List *path,
+		void (*fn)(const char *name, void *arg), void *arg);
+
+/*
+ * Resolves file through the path list and records the result in the
+ * command hash table. A miss is only recorded while every directory is
+ * watched (pathwatch.h), since nothing would forget it otherwise.
+ * Returns the new hash table entry, or NULL for a miss not recorded.
+ */
+struct HashEntry *hashCommand(const struct List *path, const char *file);
+
+/*
+ * Searches for file in each directory in the path list.
+ * Results are remembered in the command hash table, and misses too
+ * while the path list is watched. If found returns a pointer to the
+ * complete path. The string belongs to the hash table (or is file
+ * itself, if file contains a '/') and stays valid until the path list
+ * or, if it has relative directories, the current directory changes.
+ * Returns NULL if the file cannot be found in the path.
+ */
+const char *getFullPath(const struct List *path, const char *file);
+
+#endif
@@ -0,0 +1,474 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "builtin.h"
+#include "events.h"
+#include "jobs.h"
+#include "search.h"
+#include "serve.h"
+#include "util.h"
+
+/* initial size of a session's buffer */
+#define SESSIONBUFSIZE 4096
+
+/*
+ * One connection. buf holds what it has sent from start to len; no
+ * newline comes before scanned. While it has a whole line buffered the
+ * socket is not watched, so a session cannot queue more than a line
+ * ahead of what it has run. A session that fails while another one's
+ * line runs is only marked dead, and closed once the line is done.
+ */
+struct Session {
+	int sock;
+	int cwd;
+	char *buf;
+	size_t start;
+	size_t scanned;
+	size_t len;
+	size_t cap;
+	int eof;
+	int watched;
+	int dead;
+	struct Session *next;
+};
+
+static struct Session *sessions;
+
+/* the session whose working directory the shell is in */
+static struct Session *current;
+
+static int startDir = -1;
+static int devNull = -1;
+static int savedFds[3] = { -1, -1, -1 };
+
+static int stopping;
+
+static void onStop(int sig)
+{
+	stopping = 1;
+}
+
+/*
+ * Writes to a closed session then fail with EPIPE instead of killing
+ * the server. A handler, unlike SIG_IGN, is reset by exec, so commands
+ * still get SIGPIPE.
+ */
+static void onPipe(int sig)
+{
+}
+
+static void installHandlers()
+{
+	struct sigaction sa;
+
+	/* read from the event loop, so a line that is running finishes */
+	watchStopSignal(SIGINT, onStop);
+	watchStopSignal(SIGTERM, onStop);
+
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = onPipe;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGPIPE, &sa, NULL);
+}
+
+/*
+ * Returns 1 if nothing is listening on the socket at addr, 0 otherwise.
+ */
+static int isStale(const struct sockaddr_un *addr)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	int stale;
+
+	if (fd < 0)
+		return 0;
+	stale = connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0 &&
+		errno == ECONNREFUSED;
+	close(fd);
+
+	return stale;
+}
+
+/*
+ * Returns a socket listening on path, or -1 with errno set.
+ */
+static int listenOn(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		int saved = errno;
+
+		/* a server that went away without removing its socket */
+		if (saved != EADDRINUSE || !isStale(&addr) || unlink(path) < 0 ||
+				bind(fd, (struct sockaddr *)&addr,
+					sizeof(addr)) < 0) {
+			close(fd);
+			errno = saved;
+			return -1;
+		}
+	}
+
+	if (listen(fd, SOMAXCONN) < 0) {
+		int saved = errno;
+
+		close(fd);
+		unlink(path);
+		errno = saved;
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * Starts or stops watching s for input.
+ */
+static void watchSession(struct Session *s, int watch)
+{
+	if (s->watched == watch)
+		return;
+
+	if (changeFd(s->sock, watch ? EPOLLIN : 0) == 0)
+		s->watched = watch;
+}
+
+static void onSessionInput(int fd, unsigned int events, void *data);
+
+/*
+ * Accepts a connection on listenFd and starts a session for it, in the
+ * directory the server started in.
+ */
+static void acceptSession(int listenFd, unsigned int events, void *data)
+{
+	struct Session *s;
+	int sock = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+
+	if (sock < 0)
+		return;
+
+	s = calloc(1, sizeof(*s));
+	if (s == NULL)
+		errMalloc();
+	s->sock = sock;
+	s->cwd = fcntl(startDir, F_DUPFD_CLOEXEC, 0);
+	s->cap = SESSIONBUFSIZE;
+	s->buf = malloc(s->cap);
+	if (s->buf == NULL)
+		errMalloc();
+
+	if (s->cwd < 0 || watchFd(sock, EPOLLIN, onSessionInput, s) < 0) {
+		if (s->cwd >= 0)
+			close(s->cwd);
+		close(sock);
+		free(s->buf);
+		free(s);
+		return;
+	}
+
+	s->watched = 1;
+	s->next = sessions;
+	sessions = s;
+}
+
+/*
+ * Ends session s. Background commands may still hold its socket open;
+ * the client sees end of file once they finish.
+ */
+static void closeSession(struct Session *s)
+{
+	struct Session **p;
+
+	for (p = &sessions; *p != s; p = &(*p)->next)
+		;
+	*p = s->next;
+
+	/* the registration outlives the descriptor while commands hold it */
+	unwatchFd(s->sock);
+	close(s->sock);
+	close(s->cwd);
+	if (current == s)
+		current = NULL;
+
+	free(s->buf);
+	free(s);
+}
+
+/*
+ * Returns 1 if s has a line ready to run, 0 otherwise.
+ * A last line without a newline is run at end of file.
+ */
+static int hasLine(struct Session *s)
+{
+	char *nl = memchr(s->buf + s->scanned, '\n', s->len - s->scanned);
+
+	if (nl != NULL)
+		return 1;
+	s->scanned = s->len;
+
+	return s->eof && s->start < s->len;
+}
+
+/*
+ * Reads what s has sent.
+ * Returns 0 on success, -1 if the session should be closed.
+ */
+static int readSession(struct Session *s)
+{
+	ssize_t n;
+
+	/* drop the lines already run */
+	if (s->start > 0) {
+		memmove(s->buf, s->buf + s->start, s->len - s->start);
+		s->len -= s->start;
+		s->scanned -= s->start;
+		s->start = 0;
+	}
+
+	/* one byte is kept for the NUL of a last line without a newline */
+	if (s->len + 1 == s->cap) {
+		if (s->cap > SERVELINEMAX) {
+			dprintf(s->sock, "error: line too long\n");
+			return -1;
+		}
+		s->cap *= 2;
+		s->buf = realloc(s->buf, s->cap);
+		if (s->buf == NULL)
+			errMalloc();
+	}
+
+	n = read(s->sock, s->buf + s->len, s->cap - s->len - 1);
+	if (n < 0)
+		return errno == EINTR || errno == EAGAIN ? 0 : -1;
+
+	if (n == 0) {
+		s->eof = 1;
+		watchSession(s, 0);
+		return s->start < s->len ? 0 : -1;
+	}
+	s->len += n;
+
+	if (hasLine(s))
+		watchSession(s, 0);
+
+	return 0;
+}
+
+static void onSessionInput(int fd, unsigned int events, void *data)
+{
+	struct Session *s = data;
+
+	if (readSession(s) < 0) {
+		s->dead = 1;
+		watchSession(s, 0);
+	}
+}
+
+/*
+ * Makes fds 0, 1 and 2 /dev/null, sock and sock, or puts back the
+ * server's own if sock is -1.
+ */
+static void redirectTo(int sock)
+{
+	int fds[3] = { devNull, sock, sock };
+	int i;
+
+	/* output of the server itself, or of the last line, goes first */
+	fflush(stdout);
+
+	for (i = 0; i < 3; i++) {
+		if (sock >= 0)
+			dup2(fds[i], i);
+		else if (savedFds[i] >= 0)
+			dup2(savedFds[i], i);
+	}
+}
+
+/*
+ * Runs the next line of s with handler in its working directory, with
+ * its output sent to the session, then sends the line's status.
+ * Returns what handler returns, or 0 if the session has gone.
+ */
+static int runSessionLine(struct Session *s, LineHandler handler)
+{
+	char *line = s->buf + s->start;
+	char *nl = memchr(s->buf + s->scanned, '\n', s->len - s->scanned);
+	int cwd;
+	int ret;
+
+	if (nl != NULL) {
+		*nl = '\0';
+		s->start = nl + 1 - s->buf;
+	} else {
+		s->buf[s->len] = '\0';
+		s->start = s->len;
+	}
+	s->scanned = s->start;
+
+	if (current != s) {
+		if (fchdir(s->cwd) < 0) {
+			dprintf(s->sock, "error: %s\n", strerror(errno));
+			return 0;
+		}
+		searchChdir(&PATH);
+	}
+	current = s;
+
+	redirectTo(s->sock);
+	ret = handler(line);
+	redirectTo(-1);
+
+	if (dprintf(s->sock, "%c%d\n", SERVESEP, STATUS) < 0)
+		return 0;
+
+	/* the line may have changed directory */
+	cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (cwd >= 0) {
+		close(s->cwd);
+		s->cwd = cwd;
+	}
+
+	return ret;
+}
+
+/*
+ * Runs one line of every session that has one. Sessions that are done
+ * are closed.
+ * Returns 1 if a line is left to run, 0 if none is, and -1 after a
+ * fatal error.
+ */
+static int runLines(LineHandler handler)
+{
+	struct Session *s = sessions;
+	int more = 0;
+
+	while (s != NULL) {
+		struct Session *next = s->next;
+		int ret;
+
+		if (s->dead || !hasLine(s)) {
+			s = next;
+			continue;
+		}
+
+		ret = runSessionLine(s, handler);
+		if (ret < 0)
+			return -1;
+
+		if (ret == 0 || (s->eof && s->start == s->len))
+			closeSession(s);
+		else if (hasLine(s))
+			more = 1;
+		else
+			watchSession(s, 1);
+
+		s = next;
+	}
+
+	return more;
+}
+
+/*
+ * Closes every session and what the server opened.
+ */
+static void stopServing(const char *path, int listenFd)
+{
+	int i;
+
+	while (sessions != NULL)
+		closeSession(sessions);
+
+	unwatchFd(listenFd);
+	close(listenFd);
+	unlink(path);
+
+	if (startDir >= 0)
+		close(startDir);
+	if (devNull >= 0)
+		close(devNull);
+	for (i = 0; i < 3; i++) {
+		if (savedFds[i] >= 0)
+			close(savedFds[i]);
+		savedFds[i] = -1;
+	}
+	startDir = devNull = -1;
+}
+
+/*
+ * Listens on path, replacing a stale socket left there, and runs the
+ * lines of every session with handler until SIGINT or SIGTERM, or a
+ * fatal error. The socket is removed on return.
+ * Returns 0 on success, -1 with errno set if path cannot be used.
+ */
+int serve(const char *path, LineHandler handler)
+{
+	int listenFd = listenOn(path);
+	int more = 0;
+	int i;
+
+	if (listenFd < 0)
+		return -1;
+
+	startDir = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+	devNull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	if (startDir < 0 || devNull < 0 ||
+			watchFd(listenFd, EPOLLIN, acceptSession, NULL) < 0) {
+		int saved = errno;
+
+		stopServing(path, listenFd);
+		errno = saved;
+		return -1;
+	}
+
+	for (i = 0; i < 3; i++)
+		savedFds[i] = fcntl(i, F_DUPFD_CLOEXEC, 10);
+
+	stopping = 0;
+	installHandlers();
+
+	while (!stopping) {
+		struct Session *s;
+		struct Session *next;
+
+		/* with lines left to run, only look for new input */
+		if (runEvents(more ? 0 : -1) < 0 && errno != EINTR)
+			break;
+
+		notifyJobs();
+
+		for (s = sessions; s != NULL; s = next) {
+			next = s->next;
+			if (s->dead)
+				closeSession(s);
+		}
+
+		more = runLines(handler);
+		if (more < 0)
+			break;
+	}
+
+	stopServing(path, listenFd);
+	return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef _SERVE_H_
+#define _SERVE_H_
+
+/* The longest line a session may send */
+#define SERVELINEMAX (1024 * 1024)
+
+/* Ends the output of every line sent to a server, before its status */
+#define SERVESEP '\036'
+
+/*
+ * Runs one command line.
+ * Returns 1 if the line has completed, 0 if the shell's exit command
+ * has been called, and -1 if a fatal error has occurred.
+ */
+typedef int (*LineHandler)(const char *line);
+
+/*
+ * A shell serving command lines on a Unix domain socket, so a client
+ * need not pay for starting a shell, importing the path and loading
+ * its caches for each batch of commands.
+ *
+ * Every connection is a session: the client sends newline-terminated
+ * lines and gets, for each one, what it wrote to stdout and stderr,
+ * then SERVESEP, its status in decimal and a newline. Commands read
+ * stdin from /dev/null. Each session has its own working directory;
+ * the history, path and job table are shared. "exit" ends the session.
+ *
+ * Sessions are multiplexed on one epoll instance. Lines run one at a
+ * time, taking turns between the sessions that have sent one, so a
+ * session sending a long batch does not hold the others up for more
+ * than a line at a time.
+ */
+
+/*
+ * Listens on path, replacing a stale socket left there, and runs the
+ * lines of every session with handler until SIGINT or SIGTERM, or a
+ * fatal error. The socket is removed on return.
+ * Returns 0 on success, -1 with errno set if path cannot be used.
+ */
+int serve(const char *path, LineHandler handler);
+
+#endif
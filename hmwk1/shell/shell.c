@@ -3,350 +3,315 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <dirent.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
 
+#include "arena.h"
 #include "list.h"
 #include "builtin.h"
+#include "events.h"
+#include "histfile.h"
+#include "input.h"
+#include "jobs.h"
+#include "lineedit.h"
+#include "pathindex.h"
+#include "pathwatch.h"
+#include "pipeline.h"
+#include "profile.h"
+#include "serve.h"
+#include "tokenizer.h"
+#include "util.h"
 
 #define true 1
 #define false 0
-#define MAXARGS 128
 
-void err(const char *err)
-{
-	printf("error: %s\n", err);
-}
-
-void errMalloc()
-{
-	err("malloc failed");
-	exit(EXIT_FAILURE);
-}
-
-
-void cleanArgs(char *args[], const int numArgs)
-{
-	int x;
-	for (x = 0; x < numArgs; x++)
-		free(args[x]);
-}
-
-/*
- * Reallocates memory for buffer, doubling its size.
- * The new size is placed in curBufSize.
- */
-char *increaseBuffer(char *buffer, int *curBufSize)
-{
-	*curBufSize *= 2;
-	buffer = (char *)realloc(buffer, sizeof(char) * *curBufSize);
-	if (buffer == NULL) {
-		err("realloc failed");
-		free(buffer);
-		exit(EXIT_FAILURE);
-	}
-
-	return buffer;
-}
-
-/*
- * Reads input from stdin into a buffer allocated on the heap.
- * Function returns a pointer to this buffer.
- */
-char *readInput()
-{
-	int bufSize = 64;
-	int charCount = 0;
-	char currChar = '\0';
-
-	char *buffer = (char *)malloc(sizeof(char) * bufSize);
-	if (buffer == NULL)
-		errMalloc();
-
-	while (currChar != '\n') {
-		/* if inBuf is full, double the size */
-		if (charCount == bufSize)
-			buffer = increaseBuffer(buffer, &bufSize);
-
-		currChar = getc(stdin);
-		buffer[charCount] = currChar;
-		charCount++;
-	}
-
-	/* remove \n and null terminate the string */
-	buffer[--charCount] = '\0';
-
-	return buffer;
-}
+/* Cache file of the executable index, relative to $HOME */
+#define INDEXFILE ".w4118_sh_index"
 
 /*
  * Parses a line into tokens.
- * A deep copy of each token is created on the heap.
- * Pointers to these strings are placed in the tokens[] array
- * of length len.
+ * The line is copied into arena and tokenized in place; the token
+ * array is allocated from arena too, so everything is released by
+ * resetting it.
+ * Returns 0 on success, -1 after reporting a syntax error.
  */
-int parseLine(const char *inputLine, char *tokens[], const int len)
+int parseLine(struct Arena *arena, const char *inputLine,
+		struct TokenVector *tokens)
 {
+	char *buffer = arenaStrdup(arena, inputLine);
 
-	/* create a local copy of inputLine */
-	char buffer[strlen(inputLine) + 1];
-	strcpy(buffer, inputLine);
-
-	/* Add each token to the end of the tokens list */
-	char *tok = strtok(buffer, " \t");
-	int numArgs = 0;
-	do {
-
-		tokens[numArgs] = (char *)malloc(strlen(tok) + 1);
-		if (tokens[numArgs] == NULL)
-			errMalloc();
-
-		strcpy(tokens[numArgs], tok);
-		numArgs++;
-	} while (((tok = strtok(NULL, " ")) != NULL) && numArgs < len);
-
-
-	return numArgs;
-}
+	if (tokenize(arena, buffer, tokens) < 0) {
+		printf("error: syntax error: %s\n", tokenizeError());
+		STATUS = 2;
+		return -1;
+	}
 
-/*
- * Verifies a file is a file, and not a directory.
- */
-int isFile(const char *file)
-{
-	if (opendir(file) == NULL)
-		return 1;
 	return 0;
 }
 
 /*
- * Search a given DIR * for file.
- * Return 1 if the file was found in the given directory,
- * returns 0 if the file was not found.
+ * Attempts to execute a command line.
+ * tokens holds the tokens of the line, as produced by parseLine().
+ * The line is a list of pipelines separated by ";" or "&"; those
+ * ending in "&" run in the background. Stages separated by "|" are
+ * connected with pipes and run concurrently; stages after a "|+" each
+ * receive a copy of the output of the stage before it. Every pipeline
+ * is parsed before the first one runs, so a line with a syntax error
+ * anywhere runs nothing.
+ * Returns 1 if command has completed.
+ * Returns 0 if shell should be closed.
+ * Returns -1 if fatal error has occured.
  */
-int searchDirectory(DIR *dirStream, const char *file)
+int commandHandler(struct Arena *arena, const struct TokenVector *tokens)
 {
-	int curErrno = errno;
-	struct dirent *dir = readdir(dirStream);
-
-	while ((dir != NULL) || (errno != curErrno)) {
-		if (dir == NULL) {
-			/* Error occured. Ignore and continue */
-			curErrno = errno;
+	struct Pipeline *pipelines;
+	int numPipelines = 1;
+	int start = 0;
+	int n = 0;
+	int i;
 
-		} else if (strcmp(file, dir->d_name) == 0) {
-			if (isFile(file))
-				return 1;
-		}
-		dir = readdir(dirStream);
+	for (i = 0; i < tokens->count; i++) {
+		if (tokens->tokens[i].type == TOK_SEQUENCE ||
+				tokens->tokens[i].type == TOK_BACKGROUND)
+			numPipelines++;
 	}
+	pipelines = arenaAlloc(arena, sizeof(*pipelines) * numPipelines);
 
-	return 0;
-}
+	for (i = 0; i <= tokens->count; i++) {
+		enum TokenType type = TOK_SEQUENCE;
+		const char *terminator = NULL;
 
-/*
- * Searches in the given path list for file.
- * Returns a pointer to the path in which the file was found.
- * Returns NULL if the file was not found in any path.
- */
-char *searchPath(const struct List *path, const char *file)
-{
-	struct Node *curNode = path->head;
+		if (i < tokens->count) {
+			type = tokens->tokens[i].type;
+			if (type != TOK_SEQUENCE && type != TOK_BACKGROUND)
+				continue;
+			terminator = tokens->tokens[i].text;
+		}
 
-	while (curNode != NULL) {
-		char *curDir = curNode->data;
+		/* a trailing ";" ends the line without another command */
+		if (i == start && i == tokens->count && i > 0)
+			break;
 
-		/* Open each directory in the path list */
-		DIR *dirStream = opendir(curDir);
-		if (dirStream == NULL) {
-			curNode = curNode->next;
-			continue;
+		if (parsePipeline(arena, tokens->tokens + start, i - start,
+					terminator, &pipelines[n]) < 0) {
+			STATUS = 2;
+			return 1;
 		}
 
-		if (searchDirectory(dirStream, file)) {
-			/* file found */
-			closedir(dirStream);
-			return curDir;
-		}
+		pipelines[n++].background = (type == TOK_BACKGROUND);
+		start = i + 1;
+	}
+
+	for (i = 0; i < n; i++) {
+		int ret = runPipeline(&pipelines[i]);
 
-		closedir(dirStream);
-		curNode = curNode->next;
+		if (ret <= 0)
+			return ret;
 	}
 
-	/* File not found */
-	return NULL;
+	return 1;
 }
 
 /*
- * Takes a directory where a file can be found,
- * places the full path of the file in fullPath.
- * Returns a pointer to fullPath.
+ * Runs one line read from the user, a script or a session: "!n" is
+ * replaced by the nth command of the history, the line is added to the
+ * history, parsed and run.
+ * Returns 1 if the line has completed (or was empty).
+ * Returns 0 if shell should be closed.
+ * Returns -1 if fatal error has occured.
  */
-char *createFullPath(const char *dir, const char *file, char *fullPath)
+static int handleLine(const char *inputLine)
 {
-	if (dir == NULL) {
-		/* Just return the file */
-		strcpy(fullPath, file);
-		return fullPath;
+	struct TokenVector tokens;
+	unsigned long long start;
+	unsigned long long commandStart;
+	const char *line;
+	char *saved;
+	int ret;
+
+	/* release everything the previous command used */
+	arenaReset(&CMDARENA);
+
+	/* If no input was given, display prompt */
+	if (strlen(inputLine) < 1)
+		return 1;
+
+	commandStart = profileStart();
+	start = commandStart;
+	line = inputLine;
+	if (inputLine[0] == '!') {
+		/* Replace the line with the nth command */
+		line = getHistory(inputLine + 1);
+		if (line == NULL)
+			return 1;
 	}
 
-	strcpy(fullPath, dir);
+	saved = addToHistory(line);
+	if (saved != NULL)
+		line = saved;
+	profileEnd(PHASE_HISTORY, start);
 
-	/* Add in the / before the file name */
-	int dirLen = strlen(dir);
-	if (dir[dirLen] != '/')
-		strcat(fullPath, "/");
+	start = profileStart();
+	if (parseLine(&CMDARENA, line, &tokens) < 0 || tokens.count == 0)
+		return 1;
+	profileEnd(PHASE_PARSE, start);
 
-	strcat(fullPath, file);
+	ret = commandHandler(&CMDARENA, &tokens);
+	if (ret > 0)
+		profileEnd(PHASE_COMMAND, commandStart);
 
-	return fullPath;
+	return ret;
 }
 
 /*
- * Searches for file in each directory in the path list.
- * If found returns a pointer to the complete path (allocated on the heap).
- * Returns NULL if the file cannot be found in the path.
+ * Stops the shell, as the default action of the signal would, but with
+ * the terminal restored and the history file closed. Watched signals
+ * are read by the event loop, so this runs while the shell waits, not
+ * halfway through other work.
  */
-char *getFullPath(const struct List *path, const char *file)
+static void onStop(int sig)
 {
-	char *fullPath;
-
-	/* If file contains any / characters, it should be
-	   interpreted as complete path. */
-	int i;
-	for (i = 0; i < strlen(file); i++) {
-		if (file[i] == '/') {
-			fullPath = (char *)malloc(strlen(file) + 1);
-			if (fullPath == NULL)
-				errMalloc();
-
-			strcpy(fullPath, file);
-			return fullPath;
-		}
-	}
-
-	char *dir = searchPath(path, file);
-	if (dir == NULL) {
-		err("no such file or directory");
-		return NULL;
-	}
-
-	/* malloc an extra space in case an extra '/' is needed */
-	fullPath = (char *)malloc(strlen(dir) + strlen(file) + 2);
-	if (fullPath == NULL)
-		errMalloc();
-
-	createFullPath(dir, file, fullPath);
-	return fullPath;
+	closeLineEditor();
+	cleanup();
+	exit(128 + sig);
 }
 
 /*
- * Attempts to execute command.
- * args is an array of NULL-terminated strings passed to the command.
- * args[0] should point to the name of the command.
- * args must be terminated by a NULL pointer.
- * Returns 1 if command has completed.
- * Returns 0 if shell should be closed.
- * Returns -1 if fatal error has occured.
+ * ^C at a terminal is for the command in the foreground, which is sent
+ * the signal as well; at the prompt, it is read as a key.
  */
-int commandHandler(const char *command, char * const args[])
+static void onInterrupt(int sig)
 {
+}
 
-	if (isBuiltin(command)) {
-		return executeBuiltin(command, args);
+static int usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-P] [-H histfile] [-I indexfile] "
+			"[--serve socket | script]\n", name);
+	return EXIT_FAILURE;
+}
 
-	} else {
-		char *fullPath = getFullPath(&PATH, command);
-		if (fullPath == NULL) {
-			/* If file not found in path, return */
-			free(fullPath);
-			return 1;
+int main(const int argc, const char **argv)
+{
+	static const struct option longOptions[] = {
+		{ "serve", required_argument, NULL, 'S' },
+		{ NULL, 0, NULL, 0 },
+	};
+	int stillRunning = true;
+	struct Input input;
+	char *inputLine;
+	int fd = STDIN_FILENO;
+	const char *histFile = NULL;
+	const char *indexFile = NULL;
+	const char *socketPath = NULL;
+	int opt;
+
+	while ((opt = getopt_long(argc, (char * const *)argv, "H:I:P",
+					longOptions, NULL)) != -1) {
+		switch (opt) {
+		case 'H':
+			histFile = optarg;
+			break;
+		case 'I':
+			indexFile = optarg;
+			break;
+		case 'P':
+			setProfiling(1);
+			break;
+		case 'S':
+			socketPath = optarg;
+			break;
+		default:
+			return usage(argv[0]);
 		}
+	}
 
+	/* a server reads its lines from its sessions only */
+	if (socketPath != NULL && optind < argc)
+		return usage(argv[0]);
 
-		/* fork and execute command */
-		pid_t pid = fork();
-		if (pid == 0) {
-			/* child */
-			execv(fullPath, args);
-
-			free(fullPath);
-			err(strerror(errno));
-			return -1;
-		}
-
-		else if (pid < 0) {
-			err(strerror(errno));
-			return -1;
+	if (optind < argc) {
+		/* run a script instead of reading from stdin */
+		fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			printf("error: %s: %s\n", argv[optind], strerror(errno));
+			return EXIT_FAILURE;
 		}
+	}
 
-		else {
-			/* parent */
-			free(fullPath);
-			wait(NULL);
-			return 1;
-		}
+	if (histFile != NULL && openHistoryFile(histFile) < 0) {
+		printf("error: %s: %s\n", histFile, strerror(errno));
+		return EXIT_FAILURE;
 	}
-}
 
-int main(const int argc, const char **argv)
-{
-	int stillRunning = true;
-	char *inputLine;
-	char *command;
-	int numArgs;
+	/* only show a prompt to a person at a terminal */
+	int interactive = (fd == STDIN_FILENO && isatty(fd));
 
 	initLists();
 
-	while (stillRunning) {
-		char *args[MAXARGS + 1] = {0};
+	/* -I "" keeps the index in memory only */
+	if (indexFile == NULL && getenv("HOME") != NULL) {
+		const char *home = getenv("HOME");
+		char defaultFile[strlen(home) + sizeof(INDEXFILE) + 1];
 
-		printf("$ ");
+		sprintf(defaultFile, "%s/%s", home, INDEXFILE);
+		setPathIndexFile(defaultFile);
+	} else if (indexFile != NULL && indexFile[0] != '\0') {
+		setPathIndexFile(indexFile);
+	}
+	importPath(getenv("PATH"));
+	if (interactive || socketPath != NULL)
+		startPathWatch();
+
+	if (socketPath != NULL) {
+		/* a server lives long enough for the path to change under it */
+		if (serve(socketPath, handleLine) < 0)
+			printf("error: %s: %s\n", socketPath, strerror(errno));
+		cleanup();
+		return STATUS;
+	}
 
-		inputLine = readInput();
-		if (inputLine == NULL) {
-			err("Error reading input");
-			free(inputLine);
-			continue;
-		}
-		/* If no input was given, display prompt */
-		if (strlen(inputLine) < 1) {
-			free(inputLine);
-			continue;
-		}
+	/*
+	 * A script redirected to stdin is mapped, so its file offset can be
+	 * kept in step with the lines consumed for commands that read stdin.
+	 * Script files given by name are read in blocks, which is faster
+	 * because lines are terminated in place (see bench/inputbench).
+	 */
+	openInput(&input, fd, fd == STDIN_FILENO);
 
-		if (inputLine[0] == '!') {
-			/* Replace inputLine with the nth command */
-			char *temp = getHistory(inputLine + 1);
-			free(inputLine);
+	watchStopSignal(SIGTERM, onStop);
+	watchStopSignal(SIGINT, interactive ? onInterrupt : onStop);
 
-			if (temp == NULL)
-				continue;
+	while (stillRunning) {
+		unsigned long long start;
 
-			inputLine = (char *)malloc(strlen(temp) + 1);
-			if (inputLine == NULL)
-				errMalloc();
-			strcpy(inputLine, temp);
+		notifyJobs();
 
+		/* a person at a terminal gets the line editor */
+		start = profileStart();
+		if (interactive)
+			inputLine = editLine(fd, "$ ");
+		else
+			inputLine = readLine(&input);
+		profileEnd(PHASE_READ, start);
+		if (inputLine == NULL) {
+			/* end of input */
+			break;
 		}
 
-		addToHistory(inputLine);
-
-		numArgs = parseLine(inputLine, args, MAXARGS);
-		command = args[0];
-
-		if (commandHandler(command, args) <= 0) {
+		if (handleLine(inputLine) <= 0) {
 			/* Exit Shell */
 			stillRunning = false;
-			cleanArgs(args, numArgs);
 			break;
 		}
-
-		cleanArgs(args, numArgs);
-
 	}
 
+	closeInput(&input);
+	closeLineEditor();
+	if (fd != STDIN_FILENO)
+		close(fd);
+
 	cleanup();
-	return 0;
+	return STATUS;
 }
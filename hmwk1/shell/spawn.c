@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/syscall.h>
+
+#include "events.h"
+#include "profile.h"
+#include "spawn.h"
+#include "trace.h"
+#include "util.h"
+#include "zygote.h"
+
+extern char **environ;
+
+static enum SpawnMode spawnMode = SPAWN_POSIX;
+
+/*
+ * Selects the engine used by spawnProcess(), starting or stopping the
+ * zygote as needed.
+ * Returns 0 on success, -1 if the zygote could not be started.
+ */
+int setSpawnMode(enum SpawnMode mode)
+{
+	if (mode == SPAWN_ZYGOTE && startZygote() < 0)
+		return -1;
+	if (mode != SPAWN_ZYGOTE)
+		stopZygote();
+
+	spawnMode = mode;
+	return 0;
+}
+
+enum SpawnMode getSpawnMode()
+{
+	return spawnMode;
+}
+
+/*
+ * Returns the name of a spawn mode ("posix", "fork" or "zygote").
+ */
+const char *spawnModeName(enum SpawnMode mode)
+{
+	if (mode == SPAWN_ZYGOTE)
+		return "zygote";
+
+	return (mode == SPAWN_POSIX) ? "posix" : "fork";
+}
+
+/*
+ * Parses a spawn mode name.
+ * Returns 0 on success, -1 if name is not a known mode.
+ */
+int parseSpawnMode(const char *name, enum SpawnMode *mode)
+{
+	if (strcmp(name, "posix") == 0)
+		*mode = SPAWN_POSIX;
+	else if (strcmp(name, "fork") == 0)
+		*mode = SPAWN_FORK;
+	else if (strcmp(name, "zygote") == 0)
+		*mode = SPAWN_ZYGOTE;
+	else
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Installs fds[] as the calling process's stdin, stdout and stderr.
+ * Entries of -1 are left alone.
+ * Returns 0 on success, -1 on failure.
+ */
+int installFds(const int fds[3])
+{
+	int i;
+
+	if (fds == NULL)
+		return 0;
+
+	for (i = 0; i < 3; i++) {
+		if (fds[i] >= 0 && fds[i] != i && dup2(fds[i], i) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Closes every descriptor above stderr. A forked child that does not
+ * call exec must, or it keeps the shell's pipes open, O_CLOEXEC or not,
+ * and the other ends never see end of file.
+ */
+void closeInheritedFds()
+{
+	long max;
+	int fd;
+
+#ifdef SYS_close_range
+	if (syscall(SYS_close_range, 3, ~0U, 0) == 0)
+		return;
+#endif
+	max = sysconf(_SC_OPEN_MAX);
+	for (fd = 3; fd < max; fd++)
+		close(fd);
+}
+
+/*
+ * fork() + execv() engine.
+ * The child reports exec failures itself and exits.
+ */
+static pid_t forkProcess(const char *path, char * const args[],
+		const int fds[3])
+{
+	pid_t pid = fork();
+	if (pid == 0) {
+		/* child; the signals the shell reads from its loop are blocked */
+		sigprocmask(SIG_SETMASK, originalSignalMask(), NULL);
+		if (installFds(fds) == 0)
+			execv(path, args);
+
+		err(strerror(errno));
+		fflush(stdout);
+		_exit(127);
+	}
+
+	return pid;
+}
+
+/*
+ * Starts the executable at path with the selected engine. execFd is
+ * the descriptor to keep open until exec, which a helper of the zygote
+ * has to be sent; the other engines inherit it.
+ */
+static pid_t startProcess(const char *path, char * const args[],
+		const int fds[3], int execFd)
+{
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	pid_t pid;
+	int ret = 0;
+	int i;
+
+	/* Anything still buffered would otherwise be written by the child too */
+	fflush(stdout);
+
+	if (spawnMode == SPAWN_FORK)
+		return forkProcess(path, args, fds);
+
+	if (spawnMode == SPAWN_ZYGOTE) {
+		pid = zygoteSpawn(path, args, fds, execFd);
+		if (pid > 0)
+			return pid;
+
+		/* the zygote has gone; carry on without it */
+		if (!zygoteRunning())
+			spawnMode = SPAWN_POSIX;
+	}
+
+	posix_spawn_file_actions_init(&actions);
+	for (i = 0; fds != NULL && i < 3 && ret == 0; i++) {
+		if (fds[i] >= 0 && fds[i] != i)
+			ret = posix_spawn_file_actions_adddup2(&actions, fds[i], i);
+	}
+
+	/* the command gets the signal mask the shell started with */
+	posix_spawnattr_init(&attr);
+	if (ret == 0)
+		ret = posix_spawnattr_setsigmask(&attr, originalSignalMask());
+	if (ret == 0)
+		ret = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+	if (ret == 0)
+		ret = posix_spawn(&pid, path, &actions, &attr, args, environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	if (ret == 0)
+		return pid;
+
+	if (ret == ENOSYS) {
+		/* No vfork-style clone on this system; stop trying */
+		spawnMode = SPAWN_FORK;
+		return forkProcess(path, args, fds);
+	}
+
+	errno = ret;
+	return -1;
+}
+
+/*
+ * Starts the executable at path with the given NULL-terminated args.
+ * Returns the pid of the new process, or -1 with errno set on failure.
+ * If the posix_spawn engine is unusable the fork engine is used instead;
+ * if the zygote cannot take a command it is started with posix_spawn.
+ */
+pid_t spawnProcess(const char *path, char * const args[], const int fds[3])
+{
+	unsigned long long start = profileStart();
+	int execPipe[2] = { -1, -1 };
+	pid_t pid;
+	char c;
+
+	/*
+	 * When profiling, the child holds the write end of a close-on-exec
+	 * pipe, so reading it returns once the child has called exec.
+	 */
+	if (start != 0 && pipe2(execPipe, O_CLOEXEC) < 0)
+		execPipe[0] = execPipe[1] = -1;
+
+	pid = startProcess(path, args, fds, execPipe[1]);
+	profileEnd(PHASE_SPAWN, start);
+	if (pid > 0)
+		traceStart(pid, args[0]);
+
+	if (execPipe[0] >= 0) {
+		start = profileStart();
+		close(execPipe[1]);
+		if (pid > 0) {
+			while (read(execPipe[0], &c, 1) < 0 && errno == EINTR)
+				;
+			profileEnd(PHASE_EXEC, start);
+		}
+		close(execPipe[0]);
+	}
+
+	return pid;
+}
@@ -0,0 +1,63 @@
+#ifndef _SPAWN_H_
+#define _SPAWN_H_
+
+#include <sys/types.h>
+
+/*
+ * Ways of starting an external command.
+ * SPAWN_POSIX uses posix_spawn(), which glibc implements with
+ * clone(CLONE_VM | CLONE_VFORK) so the shell's page tables are never
+ * copied. SPAWN_FORK is the classic fork() + execv() path.
+ * SPAWN_ZYGOTE hands the command to a pre-forked helper (zygote.h).
+ */
+enum SpawnMode {
+	SPAWN_POSIX,
+	SPAWN_FORK,
+	SPAWN_ZYGOTE,
+};
+
+/*
+ * Selects the engine used by spawnProcess(), starting or stopping the
+ * zygote as needed.
+ * Returns 0 on success, -1 if the zygote could not be started.
+ */
+int setSpawnMode(enum SpawnMode mode);
+
+enum SpawnMode getSpawnMode();
+
+/*
+ * Returns the name of a spawn mode ("posix", "fork" or "zygote").
+ */
+const char *spawnModeName(enum SpawnMode mode);
+
+/*
+ * Parses a spawn mode name.
+ * Returns 0 on success, -1 if name is not a known mode.
+ */
+int parseSpawnMode(const char *name, enum SpawnMode *mode);
+
+/*
+ * Installs fds[] as the calling process's stdin, stdout and stderr.
+ * Entries of -1 are left alone.
+ * Returns 0 on success, -1 on failure.
+ */
+int installFds(const int fds[3]);
+
+/*
+ * Closes every descriptor above stderr. A forked child that does not
+ * call exec must, or it keeps the shell's pipes open, O_CLOEXEC or not,
+ * and the other ends never see end of file.
+ */
+void closeInheritedFds();
+
+/*
+ * Starts the executable at path with the given NULL-terminated args.
+ * fds gives the descriptors to install as the child's stdin, stdout
+ * and stderr; an entry of -1 (or a NULL fds) inherits the shell's own.
+ * Returns the pid of the new process, or -1 with errno set on failure.
+ * If the posix_spawn engine is unusable the fork engine is used instead;
+ * if the zygote cannot take a command it is started with posix_spawn.
+ */
+pid_t spawnProcess(const char *path, char * const args[], const int fds[3]);
+
+#endif
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+
+#include "builtin.h"
+#include "dispatch.h"
+#include "events.h"
+#include "jobs.h"
+#include "profile.h"
+#include "search.h"
+#include "spawn.h"
+#include "timeout.h"
+#include "util.h"
+
+#define TIMEDOUT 124
+#define TIMEOUTFAILED 125
+
+/* the command being timed, shared by the timers' handlers */
+struct Timed {
+	pid_t pid;
+	double killAfter;
+	int timedOut;
+	int killed;
+	struct Timer timer;
+};
+
+static void onKillAfter(struct Timer *timer)
+{
+	struct Timed *t = timer->data;
+
+	t->killed = 1;
+	kill(t->pid, SIGKILL);
+}
+
+static void onTimeout(struct Timer *timer)
+{
+	struct Timed *t = timer->data;
+
+	t->timedOut = 1;
+	kill(t->pid, SIGTERM);
+
+	if (t->killAfter > 0)
+		startTimer(&t->timer, t->killAfter, onKillAfter, t);
+}
+
+/*
+ * Parses a duration such as "10", "1.5s", "2m", "1h" or "1d" into
+ * seconds.
+ * Returns 0 on success, -1 if s is not a duration.
+ */
+static int parseDuration(const char *s, double *seconds)
+{
+	char *end;
+	double value = strtod(s, &end);
+
+	if (end == s || value < 0)
+		return -1;
+
+	switch (*end) {
+	case '\0':
+	case 's':
+		break;
+	case 'm':
+		value *= 60;
+		break;
+	case 'h':
+		value *= 60 * 60;
+		break;
+	case 'd':
+		value *= 24 * 60 * 60;
+		break;
+	default:
+		return -1;
+	}
+	if (*end != '\0' && end[1] != '\0')
+		return -1;
+
+	*seconds = value;
+	return 0;
+}
+
+static int usage()
+{
+	err("usage: timeout [-k duration] duration command [arg ...]");
+	STATUS = TIMEOUTFAILED;
+	return 1;
+}
+
+int runTimeout(int argc, char * const args[])
+{
+	const struct Builtin *builtin;
+	const char *path = NULL;
+	struct Timed t;
+	struct Job *job;
+	double duration;
+	int i = 1;
+
+	memset(&t, 0, sizeof(t));
+
+	if (args[i] != NULL && strcmp(args[i], "-k") == 0) {
+		if (args[i + 1] == NULL ||
+				parseDuration(args[i + 1], &t.killAfter) < 0)
+			return usage();
+		i += 2;
+	}
+
+	if (args[i] == NULL || parseDuration(args[i], &duration) < 0 ||
+			args[i + 1] == NULL)
+		return usage();
+	args += i + 1;
+
+	builtin = findBuiltin(args[0]);
+	if (builtin == NULL) {
+		unsigned long long start = profileStart();
+		path = getFullPath(&PATH, args[0]);
+		profileEnd(PHASE_LOOKUP, start);
+		if (path == NULL) {
+			STATUS = 127;
+			return 1;
+		}
+	}
+
+	/* a builtin is forked, so there is a process to signal */
+	if (builtin != NULL)
+		t.pid = spawnBuiltin(builtin, args, NULL);
+	else
+		t.pid = spawnProcess(path, args, NULL);
+	if (t.pid < 0) {
+		err(strerror(errno));
+		STATUS = TIMEOUTFAILED;
+		return 1;
+	}
+
+	job = addJob(&t.pid, 1, args[0], 0);
+	if (duration > 0)
+		startTimer(&t.timer, duration, onTimeout, &t);
+
+	STATUS = exitStatus(waitJob(job));
+	stopTimer(&t.timer);
+	removeJob(job);
+
+	if (t.killed)
+		STATUS = 128 + SIGKILL;
+	else if (t.timedOut)
+		STATUS = TIMEDOUT;
+
+	return 1;
+}
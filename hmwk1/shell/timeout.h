@@ -0,0 +1,24 @@
+#ifndef _TIMEOUT_H_
+#define _TIMEOUT_H_
+
+/*
+ * Runs the builtin timeout function:
+ *
+ *	timeout [-k kill-after] duration command [arg ...]
+ *
+ * Runs command in the foreground and sends it SIGTERM if it is still
+ * running after duration, then SIGKILL kill-after later if -k is given.
+ * Durations are in seconds, with an optional fraction and a suffix of
+ * s, m, h or d; a duration of 0 never expires.
+ *
+ * The command is resolved with getFullPath() and started by
+ * spawnProcess(), or forked if it is a builtin. The deadline is a timer
+ * of the event loop (events.h), so nothing is polled while it waits.
+ *
+ * The exit status is the command's, or 124 if it timed out (137 if it
+ * had to be killed with SIGKILL), 125 if timeout itself failed and 127
+ * if the command was not found.
+ */
+int runTimeout(int argc, char * const args[]);
+
+#endif
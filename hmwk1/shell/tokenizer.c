@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "tokenizer.h"
+
+#define INITIALTOKENS 32
+
+static const char *lastError = "";
+
+static char *operatorText[] = {
+	[TOK_WORD] = "",
+	[TOK_PIPE] = "|",
+	[TOK_FANOUT] = "|+",
+	[TOK_IN] = "<",
+	[TOK_OUT] = ">",
+	[TOK_APPEND] = ">>",
+	[TOK_BACKGROUND] = "&",
+	[TOK_SEQUENCE] = ";",
+};
+
+/* character classes, so the word loop does one lookup per character */
+#define CPLAIN		0
+#define CBLANK		1
+#define COPERATOR	2
+#define CSPECIAL	3	/* quotes, backslash and NUL */
+
+static const unsigned char charClass[256] = {
+	['\0'] = CSPECIAL,
+	[' '] = CBLANK, ['\t'] = CBLANK, ['\r'] = CBLANK, ['\n'] = CBLANK,
+	['|'] = COPERATOR, ['>'] = COPERATOR, ['<'] = COPERATOR,
+	['&'] = COPERATOR, [';'] = COPERATOR,
+	['\''] = CSPECIAL, ['"'] = CSPECIAL, ['\\'] = CSPECIAL,
+};
+
+#define CLASS(c)	charClass[(unsigned char)(c)]
+
+static int isBlank(char c)
+{
+	return CLASS(c) == CBLANK;
+}
+
+/*
+ * Returns the operator starting at s, placing its length in len.
+ * Returns TOK_WORD if s does not start with an operator.
+ */
+static enum TokenType operatorAt(const char *s, int *len)
+{
+	*len = 1;
+
+	switch (s[0]) {
+	case '|':
+		if (s[1] == '+') {
+			*len = 2;
+			return TOK_FANOUT;
+		}
+		return TOK_PIPE;
+	case '>':
+		if (s[1] == '>') {
+			*len = 2;
+			return TOK_APPEND;
+		}
+		return TOK_OUT;
+	case '<':
+		return TOK_IN;
+	case '&':
+		return TOK_BACKGROUND;
+	case ';':
+		return TOK_SEQUENCE;
+	default:
+		*len = 0;
+		return TOK_WORD;
+	}
+}
+
+static void pushToken(struct Arena *arena, struct TokenVector *vec,
+		enum TokenType type, char *text)
+{
+	if (vec->count == vec->capacity) {
+		/* the old array is released with the rest of the arena */
+		int capacity = vec->capacity ? vec->capacity * 2 : INITIALTOKENS;
+		struct Token *tokens = arenaAlloc(arena, sizeof(*tokens) * capacity);
+
+		if (vec->count > 0)
+			memcpy(tokens, vec->tokens, sizeof(*tokens) * vec->count);
+		vec->tokens = tokens;
+		vec->capacity = capacity;
+	}
+
+	vec->tokens[vec->count].type = type;
+	vec->tokens[vec->count].text = text;
+	vec->count++;
+}
+
+/*
+ * Splits line into tokens in a single pass, modifying it in place.
+ * See tokenizer.h for the syntax.
+ * Returns 0 on success, -1 (with vec->count tokens) on a syntax error.
+ */
+int tokenize(struct Arena *arena, char *line, struct TokenVector *vec)
+{
+	/* r reads the line; w writes unquoted text, never ahead of r */
+	char *r = line;
+	char *w = line;
+
+	vec->tokens = NULL;
+	vec->count = 0;
+	vec->capacity = 0;
+
+	while (1) {
+		enum TokenType op;
+		int len;
+
+		while (isBlank(*r))
+			r++;
+
+		if (*r == '\0' || *r == '#')
+			return 0;
+
+		op = operatorAt(r, &len);
+		if (op != TOK_WORD) {
+			pushToken(arena, vec, op, operatorText[op]);
+			r += len;
+			continue;
+		}
+
+		char *word = w;
+		while (1) {
+			if (CLASS(*r) == CPLAIN) {
+				/* copying is only needed once something was unquoted */
+				if (w == r) {
+					do
+						r++;
+					while (CLASS(*r) == CPLAIN);
+					w = r;
+				} else {
+					do
+						*w++ = *r++;
+					while (CLASS(*r) == CPLAIN);
+				}
+				continue;
+			}
+			if (*r == '\0' || CLASS(*r) != CSPECIAL)
+				break;
+
+			if (*r == '\'') {
+				for (r++; *r != '\'' && *r != '\0'; )
+					*w++ = *r++;
+				if (*r == '\0') {
+					lastError = "unterminated single quote";
+					return -1;
+				}
+				r++;
+
+			} else if (*r == '"') {
+				for (r++; *r != '"' && *r != '\0'; ) {
+					if (*r == '\\' && r[1] != '\0' &&
+							strchr("\"\\$`", r[1]) != NULL)
+						r++;
+					*w++ = *r++;
+				}
+				if (*r == '\0') {
+					lastError = "unterminated double quote";
+					return -1;
+				}
+				r++;
+
+			} else if (*r == '\\') {
+				if (r[1] == '\0') {
+					r++;
+					break;
+				}
+				r++;
+				*w++ = *r++;
+			}
+		}
+
+		/*
+		 * Terminating the word may overwrite the character at r when
+		 * nothing was unquoted, so look at the delimiter first.
+		 */
+		op = operatorAt(r, &len);
+		char delim = *r;
+
+		*w++ = '\0';
+		pushToken(arena, vec, TOK_WORD, word);
+
+		if (op != TOK_WORD) {
+			pushToken(arena, vec, op, operatorText[op]);
+			r += len;
+		} else if (delim != '\0') {
+			r++;
+		} else {
+			return 0;
+		}
+
+		if (w > r)
+			w = r;
+	}
+}
+
+/*
+ * Returns a description of the last error reported by tokenize().
+ */
+const char *tokenizeError()
+{
+	return lastError;
+}
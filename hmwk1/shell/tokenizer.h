@@ -0,0 +1,54 @@
+#ifndef _TOKENIZER_H_
+#define _TOKENIZER_H_
+
+#include "arena.h"
+
+enum TokenType {
+	TOK_WORD,
+	TOK_PIPE,		/* | */
+	TOK_FANOUT,		/* |+ */
+	TOK_IN,			/* < */
+	TOK_OUT,		/* > */
+	TOK_APPEND,		/* >> */
+	TOK_BACKGROUND,		/* & */
+	TOK_SEQUENCE,		/* ; */
+};
+
+/*
+ * text points at the (NUL-terminated) word for TOK_WORD tokens and at
+ * the operator's spelling for every other type.
+ */
+struct Token {
+	enum TokenType type;
+	char *text;
+};
+
+struct TokenVector {
+	struct Token *tokens;
+	int count;
+	int capacity;
+};
+
+/*
+ * Splits line into tokens in a single pass, modifying it in place.
+ *
+ * Words are separated by blanks and by the operators | |+ < > >> & ;
+ * which need no surrounding spaces. Inside single quotes every
+ * character is literal. Inside double quotes a backslash escapes
+ * " \ $ and `. Elsewhere a backslash makes the next character literal.
+ * A word starting with # begins a comment that runs to the end of the
+ * line.
+ *
+ * The word text is unquoted in place within line; no memory is
+ * allocated per token. The token array comes from arena and grows as
+ * needed.
+ * Returns 0 on success, -1 (with vec->count tokens) on a syntax error.
+ */
+int tokenize(struct Arena *arena, char *line, struct TokenVector *vec);
+
+/*
+ * Returns a description of the last error reported by tokenize().
+ */
+const char *tokenizeError();
+
+#endif
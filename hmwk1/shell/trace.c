@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "jobs.h"
+#include "trace.h"
+
+/*
+ * The ring is a fixed array, so recording an event never allocates.
+ * head counts every event ever started; event n lives in slot
+ * n % TRACECAPACITY.
+ */
+static struct TraceEvent events[TRACECAPACITY];
+static unsigned long head;
+static unsigned long first;
+static int tracing = 1;
+
+static unsigned long long now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * Turns recording on or off. Recording is on by default.
+ */
+void setTracing(int on)
+{
+	tracing = on;
+}
+
+/*
+ * Returns 1 if events are being recorded, 0 if not.
+ */
+int tracingEnabled()
+{
+	return tracing;
+}
+
+/*
+ * Records that the process pid running name has just been started.
+ */
+void traceStart(pid_t pid, const char *name)
+{
+	struct TraceEvent *event;
+
+	if (!tracing)
+		return;
+
+	event = &events[head % TRACECAPACITY];
+	memset(event, 0, sizeof(*event));
+	event->pid = pid;
+	event->start = now();
+	snprintf(event->name, sizeof(event->name), "%s", name);
+
+	head++;
+	if (head - first > TRACECAPACITY)
+		first = head - TRACECAPACITY;
+}
+
+/*
+ * Completes the newest event for pid with its wait status and usage.
+ * The search runs back from the newest event, and a process is
+ * usually reaped soon after it starts, so it is short in practice.
+ */
+void traceEnd(pid_t pid, int status, const struct rusage *usage)
+{
+	unsigned long n;
+
+	for (n = head; n > first; n--) {
+		struct TraceEvent *event = &events[(n - 1) % TRACECAPACITY];
+
+		if (event->pid != pid)
+			continue;
+
+		if (event->end == 0) {
+			event->end = now();
+			event->status = status;
+			event->usage = *usage;
+		}
+		return;
+	}
+}
+
+/*
+ * Prints how many events are held and how many were overwritten.
+ */
+void traceSummary()
+{
+	printf("tracing %s, %lu events recorded, %lu overwritten\n",
+			tracing ? "on" : "off", head - first, first);
+}
+
+/*
+ * Forgets every recorded event.
+ */
+void traceClear()
+{
+	head = 0;
+	first = 0;
+}
+
+static void writeJsonString(FILE *out, const char *s)
+{
+	putc('"', out);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(out, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(out, "\\u%04x", *s);
+		else
+			putc(*s, out);
+	}
+	putc('"', out);
+}
+
+static double timevalUs(const struct timeval *tv)
+{
+	return tv->tv_sec * 1e6 + tv->tv_usec;
+}
+
+/*
+ * Writes the recorded events to the file path in the Chrome trace
+ * event format. Timestamps are in microseconds.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+int traceDump(const char *path)
+{
+	unsigned long long dumpTime = now();
+	FILE *out = fopen(path, "w");
+	int shell = getpid();
+	unsigned long n;
+
+	if (out == NULL)
+		return -1;
+
+	fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+			"\"args\":{\"name\":\"w4118_sh\"}}", shell);
+
+	for (n = first; n < head; n++) {
+		const struct TraceEvent *event = &events[n % TRACECAPACITY];
+		const struct rusage *ru = &event->usage;
+		unsigned long long end = event->end ? event->end : dumpTime;
+
+		/* name the process's track after it */
+		fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+				"\"tid\":%d,\"args\":{\"name\":", shell, event->pid);
+		writeJsonString(out, event->name);
+		fprintf(out, "}}");
+
+		fprintf(out, ",\n{\"name\":");
+		writeJsonString(out, event->name);
+		fprintf(out, ",\"cat\":\"command\",\"ph\":\"X\",\"pid\":%d,"
+				"\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+				shell, event->pid, event->start / 1e3,
+				(end - event->start) / 1e3);
+
+		if (event->end == 0) {
+			fprintf(out, "\"running\":true}}");
+			continue;
+		}
+
+		fprintf(out, "\"status\":%d,\"utime_us\":%.0f,\"stime_us\":%.0f,"
+				"\"maxrss_kb\":%ld,\"minflt\":%ld,\"majflt\":%ld,"
+				"\"nvcsw\":%ld,\"nivcsw\":%ld}}",
+				exitStatus(event->status), timevalUs(&ru->ru_utime),
+				timevalUs(&ru->ru_stime), ru->ru_maxrss,
+				ru->ru_minflt, ru->ru_majflt, ru->ru_nvcsw,
+				ru->ru_nivcsw);
+	}
+
+	fprintf(out, "\n]}\n");
+
+	if (ferror(out)) {
+		fclose(out);
+		return -1;
+	}
+
+	return fclose(out) == EOF ? -1 : 0;
+}
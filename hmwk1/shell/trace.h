@@ -0,0 +1,66 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/* Number of events kept; older ones are overwritten */
+#define TRACECAPACITY 4096
+#define TRACENAMELEN 32
+
+/*
+ * One launched process: when it was started and when it was reaped
+ * (CLOCK_MONOTONIC nanoseconds), its wait status and the resources
+ * wait4() reported for it. end is 0 while it is running.
+ */
+struct TraceEvent {
+	pid_t pid;
+	int status;
+	unsigned long long start;
+	unsigned long long end;
+	struct rusage usage;
+	char name[TRACENAMELEN];
+};
+
+/*
+ * Turns recording on or off. Recording is on by default.
+ */
+void setTracing(int on);
+
+/*
+ * Returns 1 if events are being recorded, 0 if not.
+ */
+int tracingEnabled();
+
+/*
+ * Records that the process pid running name (an argv[0], possibly
+ * truncated) has just been started.
+ */
+void traceStart(pid_t pid, const char *name);
+
+/*
+ * Completes the newest event for pid with its wait status and usage.
+ * Does nothing if pid has no running event, e.g. because the ring has
+ * wrapped since it started.
+ */
+void traceEnd(pid_t pid, int status, const struct rusage *usage);
+
+/*
+ * Prints how many events are held and how many were overwritten.
+ */
+void traceSummary();
+
+/*
+ * Forgets every recorded event.
+ */
+void traceClear();
+
+/*
+ * Writes the recorded events to the file path in the Chrome trace
+ * event format, which chrome://tracing and Perfetto load. Each process
+ * is a complete ("X") event on a track of its own, named by its pid.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+int traceDump(const char *path);
+
+#endif
@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "trie.h"
+
+#define TRIECHUNK (64 * 1024)
+
+/* the longest name trieList() can visit */
+#define TRIEMAXNAME 1024
+
+/*
+ * Prepares an empty trie.
+ */
+void initTrie(struct Trie *trie)
+{
+	memset(&trie->root, 0, sizeof(trie->root));
+	trie->root.label = "";
+	initArena(&trie->arena, TRIECHUNK);
+}
+
+/*
+ * Returns the number of leading characters label and s have in common,
+ * at most len.
+ */
+static unsigned int commonLength(const char *label, unsigned int len,
+		const char *s)
+{
+	unsigned int i = 0;
+
+	while (i < len && label[i] == s[i])
+		i++;
+
+	return i;
+}
+
+/*
+ * Returns the child of node whose label starts with c, or NULL.
+ * If prev is not NULL it is set to the link to that child, or to the
+ * link where a child starting with c belongs.
+ */
+static struct TrieNode *findChild(const struct TrieNode *node, char c,
+		struct TrieNode ***prev)
+{
+	struct TrieNode **link = (struct TrieNode **)&node->child;
+
+	while (*link != NULL && (unsigned char)(*link)->label[0] <
+			(unsigned char)c)
+		link = &(*link)->next;
+
+	if (prev != NULL)
+		*prev = link;
+
+	return *link != NULL && (*link)->label[0] == c ? *link : NULL;
+}
+
+/*
+ * Returns 1 if name is in the trie, 0 otherwise.
+ */
+static int trieContains(const struct Trie *trie, const char *name)
+{
+	const struct TrieNode *node = &trie->root;
+
+	while (*name != '\0') {
+		node = findChild(node, *name, NULL);
+		if (node == NULL ||
+				commonLength(node->label, node->len, name) < node->len)
+			return 0;
+		name += node->len;
+	}
+
+	return node->terminal;
+}
+
+/*
+ * Adds name. Adding a name twice has no effect.
+ */
+void trieInsert(struct Trie *trie, const char *name)
+{
+	struct TrieNode *node = &trie->root;
+
+	if (trieContains(trie, name))
+		return;
+
+	while (1) {
+		struct TrieNode **link;
+		struct TrieNode *child;
+		unsigned int k;
+
+		node->count++;
+		if (*name == '\0') {
+			node->terminal = 1;
+			return;
+		}
+
+		child = findChild(node, *name, &link);
+		if (child == NULL) {
+			/* the rest of the name becomes a new leaf */
+			child = arenaAlloc(&trie->arena, sizeof(*child));
+			child->label = arenaStrdup(&trie->arena, name);
+			child->len = strlen(name);
+			child->count = 1;
+			child->terminal = 1;
+			child->child = NULL;
+			child->next = *link;
+			*link = child;
+			return;
+		}
+
+		k = commonLength(child->label, child->len, name);
+		if (k < child->len) {
+			/* split the edge where name leaves it */
+			struct TrieNode *mid = arenaAlloc(&trie->arena,
+					sizeof(*mid));
+
+			mid->label = child->label;
+			mid->len = k;
+			mid->count = child->count;
+			mid->terminal = 0;
+			mid->child = child;
+			mid->next = child->next;
+			*link = mid;
+
+			child->label += k;
+			child->len -= k;
+			child->next = NULL;
+			child = mid;
+		}
+
+		node = child;
+		name += k;
+	}
+}
+
+/*
+ * Returns the node below which the names starting with prefix are, or
+ * NULL if there are none. *used is set to the number of characters of
+ * the node's label that the prefix covers.
+ */
+static const struct TrieNode *findPrefix(const struct Trie *trie,
+		const char *prefix, unsigned int *used)
+{
+	const struct TrieNode *node = &trie->root;
+
+	*used = 0;
+	while (*prefix != '\0') {
+		unsigned int k;
+
+		node = findChild(node, *prefix, NULL);
+		if (node == NULL)
+			return NULL;
+
+		k = commonLength(node->label, node->len, prefix);
+		if (prefix[k] == '\0') {
+			*used = k;
+			return node;
+		}
+		if (k < node->len)
+			return NULL;
+		prefix += k;
+	}
+
+	*used = node->len;
+	return node;
+}
+
+/*
+ * Appends len characters of s to the string in buf, which holds size
+ * bytes, as far as they fit.
+ */
+static void append(char *buf, size_t size, const char *s, size_t len)
+{
+	size_t used = strlen(buf);
+
+	if (used + len >= size)
+		len = size - used - 1;
+	memcpy(buf + used, s, len);
+	buf[used + len] = '\0';
+}
+
+/*
+ * Finds the names starting with prefix and copies the longest prefix
+ * they all share into common, which holds size bytes. A longer common
+ * prefix is cut short.
+ * Returns the number of names starting with prefix.
+ */
+unsigned int triePrefix(const struct Trie *trie, const char *prefix,
+		char *common, size_t size)
+{
+	const struct TrieNode *found;
+	const struct TrieNode *node;
+	unsigned int used;
+
+	if (size == 0)
+		return 0;
+	common[0] = '\0';
+	append(common, size, prefix, strlen(prefix));
+
+	found = findPrefix(trie, prefix, &used);
+	if (found == NULL)
+		return 0;
+	node = found;
+
+	/* names go on past the prefix as long as there is one way to go */
+	append(common, size, node->label + used, node->len - used);
+	while (!node->terminal && node->child != NULL &&
+			node->child->next == NULL) {
+		node = node->child;
+		append(common, size, node->label, node->len);
+	}
+
+	return found->count;
+}
+
+struct TrieWalk {
+	char name[TRIEMAXNAME];
+	size_t len;
+	unsigned int left;
+	void (*fn)(const char *name, void *arg);
+	void *arg;
+};
+
+/*
+ * Visits the names at and below node, whose label has already been
+ * added to walk->name.
+ */
+static void walk(const struct TrieNode *node, struct TrieWalk *w)
+{
+	const struct TrieNode *child;
+
+	if (node->terminal && w->left > 0) {
+		w->fn(w->name, w->arg);
+		w->left--;
+	}
+
+	for (child = node->child; child != NULL && w->left > 0;
+			child = child->next) {
+		size_t len = w->len;
+
+		if (len + child->len >= sizeof(w->name))
+			continue;
+
+		memcpy(w->name + len, child->label, child->len);
+		w->len += child->len;
+		w->name[w->len] = '\0';
+		walk(child, w);
+		w->len = len;
+		w->name[len] = '\0';
+	}
+}
+
+/*
+ * Calls fn for every name starting with prefix, in sorted order, until
+ * max names have been visited.
+ * Returns the number of names visited.
+ */
+unsigned int trieList(const struct Trie *trie, const char *prefix,
+		unsigned int max, void (*fn)(const char *name, void *arg),
+		void *arg)
+{
+	const struct TrieNode *node;
+	struct TrieWalk w;
+	unsigned int used;
+
+	node = findPrefix(trie, prefix, &used);
+	if (node == NULL)
+		return 0;
+
+	w.name[0] = '\0';
+	append(w.name, sizeof(w.name), prefix, strlen(prefix));
+	append(w.name, sizeof(w.name), node->label + used, node->len - used);
+	w.len = strlen(w.name);
+	w.left = max;
+	w.fn = fn;
+	w.arg = arg;
+
+	walk(node, &w);
+
+	return max - w.left;
+}
+
+/*
+ * Releases every node of the trie, leaving it empty.
+ */
+void freeTrie(struct Trie *trie)
+{
+	freeArena(&trie->arena);
+	initTrie(trie);
+}
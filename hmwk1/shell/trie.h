@@ -0,0 +1,64 @@
+#ifndef _TRIE_H_
+#define _TRIE_H_
+
+#include "arena.h"
+
+/*
+ * A compressed (radix) trie of names. An edge holds a run of characters
+ * rather than one, so a chain of single-child nodes is a single node,
+ * and every node counts the names below it. Finding the names with a
+ * prefix, their number and their longest common prefix costs time
+ * proportional to the length of the prefix, not to the number of names.
+ *
+ * Children are kept in a list sorted by their first character, so
+ * names are visited in strcmp() order. Nodes and labels come from the
+ * trie's arena and are all released together.
+ */
+struct TrieNode {
+	const char *label;	/* the edge into this node, not terminated */
+	unsigned int len;
+	unsigned int count;	/* names ending here or below */
+	int terminal;		/* a name ends here */
+	struct TrieNode *child;
+	struct TrieNode *next;
+};
+
+struct Trie {
+	struct TrieNode root;
+	struct Arena arena;
+};
+
+/*
+ * Prepares an empty trie.
+ */
+void initTrie(struct Trie *trie);
+
+/*
+ * Adds name. Adding a name twice has no effect.
+ */
+void trieInsert(struct Trie *trie, const char *name);
+
+/*
+ * Finds the names starting with prefix and copies the longest prefix
+ * they all share into common, which holds size bytes. A longer common
+ * prefix is cut short.
+ * Returns the number of names starting with prefix.
+ */
+unsigned int triePrefix(const struct Trie *trie, const char *prefix,
+		char *common, size_t size);
+
+/*
+ * Calls fn for every name starting with prefix, in sorted order, until
+ * max names have been visited.
+ * Returns the number of names visited.
+ */
+unsigned int trieList(const struct Trie *trie, const char *prefix,
+		unsigned int max, void (*fn)(const char *name, void *arg),
+		void *arg);
+
+/*
+ * Releases every node of the trie, leaving it empty.
+ */
+void freeTrie(struct Trie *trie);
+
+#endif
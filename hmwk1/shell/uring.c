@@ -0,0 +1,395 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "uring.h"
+
+/* a read and a write in flight, with room to spare */
+#define URINGENTRIES 8
+
+/* what a completion is for; the low bits are the buffer's index */
+#define OPREAD 0x100
+#define OPWRITE 0x200
+#define OPINDEX 0xff
+
+struct Ring {
+	int fd;
+	int fixed;
+	void *rings;
+	size_t ringsLen;
+	struct io_uring_sqe *sqes;
+	size_t sqesLen;
+	unsigned int *sqTail;
+	unsigned int *sqMask;
+	unsigned int *sqArray;
+	unsigned int *cqHead;
+	unsigned int *cqTail;
+	unsigned int *cqMask;
+	struct io_uring_cqe *cqes;
+	unsigned int toSubmit;
+};
+
+static struct Ring ring = { .fd = -1 };
+
+/* URINGBUFS buffers of URINGBUFSIZE bytes, not inherited by children */
+static char *bufs;
+
+/* set once io_uring turned out not to be usable */
+static int unavailable;
+
+static void unmapRing()
+{
+	if (ring.rings != NULL)
+		munmap(ring.rings, ring.ringsLen);
+	if (ring.sqes != NULL)
+		munmap(ring.sqes, ring.sqesLen);
+	if (ring.fd >= 0)
+		close(ring.fd);
+
+	memset(&ring, 0, sizeof(ring));
+	ring.fd = -1;
+}
+
+/*
+ * A forked child closes its parent's ring at once, before it can close
+ * every inherited descriptor (closeInheritedFds()) and reuse their
+ * numbers, and sets up its own when it needs one.
+ */
+static void onFork()
+{
+	unmapRing();
+
+	/* the parent's buffers are not mapped here */
+	bufs = NULL;
+}
+
+/*
+ * Maps the buffers and registers them with the ring. Unregistered
+ * buffers still work, with plain reads and writes.
+ * Returns 0 on success, -1 if they could not be mapped.
+ */
+static int mapBuffers()
+{
+	struct iovec iov[URINGBUFS];
+	int i;
+
+	if (bufs == NULL) {
+		bufs = mmap(NULL, URINGBUFS * URINGBUFSIZE,
+				PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (bufs == MAP_FAILED) {
+			bufs = NULL;
+			return -1;
+		}
+
+		/* a child would otherwise copy pages the ring has pinned */
+		madvise(bufs, URINGBUFS * URINGBUFSIZE, MADV_DONTFORK);
+	}
+
+	for (i = 0; i < URINGBUFS; i++) {
+		iov[i].iov_base = bufs + i * URINGBUFSIZE;
+		iov[i].iov_len = URINGBUFSIZE;
+	}
+	ring.fixed = syscall(SYS_io_uring_register, ring.fd,
+			IORING_REGISTER_BUFFERS, iov, URINGBUFS) == 0;
+
+	return 0;
+}
+
+/*
+ * Sets up the ring, unless it is already set up.
+ * Returns 0 on success, -1 if io_uring cannot be used.
+ */
+static int openRing()
+{
+	static int atForkSet;
+	struct io_uring_params p;
+	size_t sqLen, cqLen;
+	char *rings;
+
+	if (ring.fd >= 0)
+		return 0;
+	if (unavailable)
+		return -1;
+
+	if (!atForkSet) {
+		pthread_atfork(NULL, NULL, onFork);
+		atForkSet = 1;
+	}
+
+	memset(&p, 0, sizeof(p));
+	ring.fd = syscall(SYS_io_uring_setup, URINGENTRIES, &p);
+
+	/* reads and writes at the file position need Linux 5.6 */
+	if (ring.fd < 0 || !(p.features & IORING_FEAT_RW_CUR_POS) ||
+			!(p.features & IORING_FEAT_SINGLE_MMAP))
+		goto fail;
+
+	sqLen = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cqLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ring.ringsLen = sqLen > cqLen ? sqLen : cqLen;
+	rings = mmap(NULL, ring.ringsLen, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+	if (rings == MAP_FAILED)
+		goto fail;
+	ring.rings = rings;
+
+	ring.sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring.sqes = mmap(NULL, ring.sqesLen, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+	if (ring.sqes == MAP_FAILED) {
+		ring.sqes = NULL;
+		goto fail;
+	}
+
+	ring.sqTail = (unsigned int *)(rings + p.sq_off.tail);
+	ring.sqMask = (unsigned int *)(rings + p.sq_off.ring_mask);
+	ring.sqArray = (unsigned int *)(rings + p.sq_off.array);
+	ring.cqHead = (unsigned int *)(rings + p.cq_off.head);
+	ring.cqTail = (unsigned int *)(rings + p.cq_off.tail);
+	ring.cqMask = (unsigned int *)(rings + p.cq_off.ring_mask);
+	ring.cqes = (struct io_uring_cqe *)(rings + p.cq_off.cqes);
+
+	if (mapBuffers() < 0)
+		goto fail;
+
+	return 0;
+
+fail:
+	unmapRing();
+	unavailable = 1;
+	return -1;
+}
+
+/*
+ * Queues a read into, or a write from, the buffer index, starting
+ * offset bytes into it, at the file position of fd.
+ */
+static void queue(int op, int fd, int index, size_t offset, size_t len)
+{
+	unsigned int tail = *ring.sqTail;
+	unsigned int i = tail & *ring.sqMask;
+	struct io_uring_sqe *sqe = &ring.sqes[i];
+
+	memset(sqe, 0, sizeof(*sqe));
+	if (op == OPREAD)
+		sqe->opcode = ring.fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	else
+		sqe->opcode = ring.fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->fd = fd;
+	sqe->off = (__u64)-1;
+	sqe->addr = (unsigned long)(bufs + index * URINGBUFSIZE + offset);
+	sqe->len = len;
+	sqe->buf_index = index;
+	sqe->user_data = op | index;
+
+	ring.sqArray[i] = i;
+	__atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+	ring.toSubmit++;
+}
+
+/*
+ * Submits what is queued and waits for at least one completion, in
+ * one system call.
+ * Returns 0 on success, -1 with errno set on failure.
+ */
+static int submitAndWait()
+{
+	int n = syscall(SYS_io_uring_enter, ring.fd, ring.toSubmit, 1,
+			IORING_ENTER_GETEVENTS, NULL, 0);
+
+	if (n < 0)
+		return -1;
+
+	ring.toSubmit -= n;
+	return 0;
+}
+
+/*
+ * Takes the next completion, if there is one.
+ * Returns 1 with *data and *res set, or 0 if there is none.
+ */
+static int nextCompletion(unsigned long long *data, int *res)
+{
+	unsigned int head = *ring.cqHead;
+	struct io_uring_cqe *cqe;
+
+	if (head == __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE))
+		return 0;
+
+	cqe = &ring.cqes[head & *ring.cqMask];
+	*data = cqe->user_data;
+	*res = cqe->res;
+	__atomic_store_n(ring.cqHead, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/*
+ * Returns 1 if a request failing with res means that io_uring cannot
+ * read or write the descriptor, 0 otherwise.
+ */
+static int unsupported(int res)
+{
+	return res == -EINVAL || res == -EOPNOTSUPP;
+}
+
+/*
+ * Writes all len bytes of buf to fd with write().
+ * Returns 0 on success, -1 on failure.
+ */
+static int writeAll(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Copies everything left in in to out.
+ * Returns 0 on success, 1 if io_uring cannot be used for in and out
+ * and nothing was copied, -1 if reading in failed and -2 if writing
+ * out failed, with errno set.
+ */
+int uringCopy(int in, int out)
+{
+	size_t len[URINGBUFS];
+	size_t done[URINGBUFS];
+	unsigned int readIndex = 0;
+	unsigned int writeIndex = 0;
+	unsigned int filled = 0;
+	int reading = 0;
+	int writing = 0;
+	int eof = 0;
+	int copied = 0;
+	int ret = 0;
+	int error = 0;
+	int readError = 0;
+
+	if (openRing() < 0)
+		return 1;
+
+	while (1) {
+		unsigned long long data;
+		int res;
+
+		/* after a failure, only wait for what is in flight */
+		if (ret == 0 && !reading && !eof && filled < URINGBUFS) {
+			queue(OPREAD, in, readIndex, 0, URINGBUFSIZE);
+			reading = 1;
+		}
+		if (ret == 0 && !writing && filled > 0) {
+			queue(OPWRITE, out, writeIndex, done[writeIndex],
+					len[writeIndex] - done[writeIndex]);
+			writing = 1;
+		}
+		if (!reading && !writing)
+			break;
+
+		if (submitAndWait() < 0) {
+			if (errno == EINTR)
+				continue;
+
+			/* closing the ring cancels what is in flight */
+			error = errno;
+			unmapRing();
+			unavailable = 1;
+			if (copied || filled > 0) {
+				errno = error;
+				return -1;
+			}
+			return 1;
+		}
+
+		while (nextCompletion(&data, &res)) {
+			unsigned int index = data & OPINDEX;
+
+			if (data & OPREAD) {
+				reading = 0;
+				if (res == -EINTR)
+					continue;
+
+				/* what was read before an error is written out */
+				if (res < 0) {
+					eof = 1;
+					readError = -res;
+					if (!copied && filled == 0 &&
+							unsupported(res))
+						ret = 1;
+				} else if (res == 0) {
+					eof = 1;
+				} else {
+					len[index] = res;
+					done[index] = 0;
+					filled++;
+					readIndex = (readIndex + 1) % URINGBUFS;
+				}
+			} else {
+				writing = 0;
+				if (res == -EINTR)
+					continue;
+
+				if (res <= 0 && ret == 0) {
+					ret = !copied && unsupported(res) ? 1 : -2;
+					error = res < 0 ? -res : EIO;
+				} else if (res > 0) {
+					copied = 1;
+					done[index] += res;
+					if (done[index] == len[index]) {
+						filled--;
+						writeIndex = (writeIndex + 1) %
+							URINGBUFS;
+					}
+				}
+			}
+		}
+	}
+
+	/* what was read before falling back must still be written */
+	while (ret == 1 && filled > 0) {
+		if (writeAll(out, bufs + writeIndex * URINGBUFSIZE +
+					done[writeIndex],
+					len[writeIndex] - done[writeIndex]) < 0)
+			return -2;
+		filled--;
+		writeIndex = (writeIndex + 1) % URINGBUFS;
+	}
+
+	if (ret == 0 && readError != 0) {
+		ret = -1;
+		error = readError;
+	}
+
+	if (ret < 0)
+		errno = error;
+	return ret;
+}
+
+/*
+ * Frees the ring, if there is one.
+ */
+void closeUring()
+{
+	unmapRing();
+	if (bufs != NULL)
+		munmap(bufs, URINGBUFS * URINGBUFSIZE);
+	bufs = NULL;
+}
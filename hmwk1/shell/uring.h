@@ -0,0 +1,39 @@
+#ifndef _URING_H_
+#define _URING_H_
+
+/* The buffers registered with the ring, and the size of each */
+#define URINGBUFS 4
+#define URINGBUFSIZE (128 * 1024)
+
+/*
+ * Copies data that has to pass through the shell's memory with
+ * io_uring, for inputs that copy_file_range() and sendfile() cannot
+ * take, such as pipes and sockets.
+ *
+ * One ring is set up on first use, with URINGBUFS buffers registered
+ * so the kernel does not map them for every request. A read into one
+ * buffer is in flight while another is written out, and each step
+ * submits the next requests and waits for a completion with one
+ * io_uring_enter() call, where a read()/write() loop makes two calls
+ * and does not overlap them. Reads and writes use the descriptors'
+ * file positions, as read() and write() do.
+ *
+ * The ring is made with raw system calls, so there is no library to
+ * link. A forked child sets up its own ring when it needs one; the
+ * buffers are not inherited.
+ */
+
+/*
+ * Copies everything left in in to out.
+ * Returns 0 on success, 1 if io_uring cannot be used for in and out
+ * and nothing was copied, -1 if reading in failed and -2 if writing
+ * out failed, with errno set.
+ */
+int uringCopy(int in, int out);
+
+/*
+ * Frees the ring, if there is one.
+ */
+void closeUring();
+
+#endif
@@ -0,0 +1,21 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "util.h"
+
+/*
+ * Prints an error message of the form "error: <err>".
+ */
+void err(const char *err)
+{
+	printf("error: %s\n", err);
+}
+
+/*
+ * Reports a failed malloc and exits the shell.
+ */
+void errMalloc()
+{
+	err("malloc failed");
+	exit(EXIT_FAILURE);
+}
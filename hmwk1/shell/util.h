@@ -0,0 +1,14 @@
+#ifndef _UTIL_H_
+#define _UTIL_H_
+
+/*
+ * Prints an error message of the form "error: <err>".
+ */
+void err(const char *err);
+
+/*
+ * Reports a failed malloc and exits the shell.
+ */
+void errMalloc();
+
+#endif
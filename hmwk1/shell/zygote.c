@@ -0,0 +1,488 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "events.h"
+#include "jobs.h"
+#include "spawn.h"
+#include "util.h"
+#include "zygote.h"
+
+/* descriptors sent with a command: stdin, stdout, stderr, cwd, exec */
+#define MAXSENTFDS 5
+
+/* descriptors above this are closed one by one without close_range() */
+#define MAXINHERITEDFD 1024
+
+/* argv[0] of the zygote, which runs the shell's binary afresh */
+#define ZYGOTENAME "w4118_sh-zygote"
+
+/* where the zygote finds its socket */
+#define ZYGOTEFD 3
+
+extern char **environ;
+
+/* a helper ready to start a command */
+struct Helper {
+	pid_t pid;
+	int sock;
+};
+
+static int zygoteSock = -1;
+static pid_t zygotePid = -1;
+
+/* the process that started the zygote, and whose children it makes */
+static pid_t zygoteParent = -1;
+
+static struct Helper idle[ZYGOTEHELPERS];
+static int numIdle;
+
+/* helpers asked for and not received yet */
+static int numRequested;
+
+/*
+ * Sends len bytes of data with the descriptors fds over sock.
+ * Returns 0 on success, -1 on failure.
+ */
+static int sendFds(int sock, const void *data, size_t len, const int *fds,
+		int numFds)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * MAXSENTFDS)];
+		struct cmsghdr align;
+	} control;
+	struct iovec iov = { (void *)data, len };
+	struct msghdr msg;
+	ssize_t n;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (numFds > 0) {
+		struct cmsghdr *cmsg;
+
+		memset(&control, 0, sizeof(control));
+		msg.msg_control = control.buf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * numFds);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * numFds);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * numFds);
+	}
+
+	/* a closed peer is an error, not a SIGPIPE */
+	do {
+		n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+	} while (n < 0 && errno == EINTR);
+
+	return n < 0 ? -1 : 0;
+}
+
+/*
+ * Receives a message of at most size bytes into data from sock, and the
+ * descriptors sent with it, which are close-on-exec, into fds.
+ * *numFds is set to their number.
+ * Returns the length of the message, 0 at end of file, or -1 on
+ * failure.
+ */
+static ssize_t receiveFds(int sock, void *data, size_t size, int *fds,
+		int *numFds, int flags)
+{
+	union {
+		char buf[CMSG_SPACE(sizeof(int) * MAXSENTFDS)];
+		struct cmsghdr align;
+	} control;
+	struct iovec iov = { data, size };
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	ssize_t n;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	do {
+		n = recvmsg(sock, &msg, flags | MSG_CMSG_CLOEXEC);
+	} while (n < 0 && errno == EINTR);
+
+	*numFds = 0;
+	if (n < 0)
+		return -1;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+			cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+				cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		*numFds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * *numFds);
+	}
+
+	return n;
+}
+
+/*
+ * Waits for one command and execs it. The message holds the path and
+ * then each argument, each ending with a NUL; it comes with the
+ * descriptors for stdin, stdout, stderr and the working directory,
+ * and possibly one to hold open until exec.
+ */
+static void runHelper(int sock)
+{
+	static char buf[ZYGOTEMSGMAX];
+	static char *args[ZYGOTEMSGMAX / 2 + 1];
+	int fds[MAXSENTFDS];
+	int numFds;
+	ssize_t len = receiveFds(sock, buf, sizeof(buf), fds, &numFds, 0);
+	char *p;
+	int numArgs = 0;
+
+	/* the shell closed the socket: the pool is being stopped */
+	if (len <= 0 || numFds < 4 || buf[len - 1] != '\0')
+		_exit(0);
+
+	/* the first string is the path, the rest are the arguments */
+	for (p = buf + strlen(buf) + 1; p < buf + len; p += strlen(p) + 1)
+		args[numArgs++] = p;
+	args[numArgs] = NULL;
+
+	if (fchdir(fds[3]) == 0 && installFds(fds) == 0)
+		execv(buf, args);
+
+	err(strerror(errno));
+	fflush(stdout);
+	_exit(127);
+}
+
+/*
+ * Closes every descriptor the zygote inherited except sock, which is
+ * moved to ZYGOTEFD and kept open across exec. stdin, stdout and stderr
+ * become /dev/null: helpers are sent their own, and whatever the shell
+ * had there, such as a session's socket, must not be held open.
+ */
+static void closeInherited(int sock)
+{
+	int null = open("/dev/null", O_RDWR | O_CLOEXEC);
+	int fd;
+
+	for (fd = 0; fd < 3 && null >= 0; fd++) {
+		if (fd != sock)
+			dup2(null, fd);
+	}
+
+	if (sock != ZYGOTEFD) {
+		if (dup2(sock, ZYGOTEFD) < 0)
+			_exit(1);
+	} else {
+		fcntl(sock, F_SETFD, 0);
+	}
+
+#ifdef SYS_close_range
+	if (syscall(SYS_close_range, ZYGOTEFD + 1, ~0U, 0) == 0)
+		return;
+#endif
+	for (fd = ZYGOTEFD + 1; fd < MAXINHERITEDFD; fd++)
+		close(fd);
+}
+
+/*
+ * Creates a helper and sends the shell its pid and its end of the
+ * helper's socket over sock.
+ */
+static void createHelper(int sock)
+{
+	int pair[2];
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) < 0)
+		_exit(1);
+
+	/* the helper is the shell's child, not the zygote's */
+	pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, 0);
+	if (pid == 0) {
+		close(pair[0]);
+		close(sock);
+		runHelper(pair[1]);
+	}
+
+	if (pid > 0)
+		sendFds(sock, &pid, sizeof(pid), &pair[0], 1);
+	close(pair[0]);
+	close(pair[1]);
+	if (pid < 0)
+		_exit(1);
+}
+
+/*
+ * The zygote: creates a helper for every byte of every request read
+ * from sock. Exits when the shell closes sock.
+ */
+static void runZygote(int sock)
+{
+	char buf[ZYGOTEHELPERS];
+	ssize_t n;
+
+	/* commands must not inherit it */
+	fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+	while ((n = read(sock, buf, sizeof(buf))) > 0) {
+		while (n-- > 0)
+			createHelper(sock);
+	}
+
+	_exit(0);
+}
+
+/*
+ * Runs before main(): a process started as the zygote never gets there.
+ * glibc passes constructors the program's arguments.
+ */
+__attribute__((constructor))
+static void zygoteMain(int argc, char **argv, char **envp)
+{
+	if (argc == 1 && strcmp(argv[0], ZYGOTENAME) == 0)
+		runZygote(ZYGOTEFD);
+}
+
+/*
+ * Asks the zygote for n more helpers.
+ */
+static void requestHelpers(int n)
+{
+	char buf[ZYGOTEHELPERS];
+
+	memset(buf, 0, sizeof(buf));
+	if (n > 0 && write(zygoteSock, buf, n) == n)
+		numRequested += n;
+}
+
+/*
+ * Adds the helpers the zygote has sent to the idle ones, waiting for
+ * one if there are none.
+ * Returns 0 on success, -1 if the zygote has gone.
+ */
+static int receiveHelpers()
+{
+	while (numRequested > 0) {
+		struct Helper *h = &idle[numIdle];
+		int numFds;
+		ssize_t n = receiveFds(zygoteSock, &h->pid, sizeof(h->pid),
+				&h->sock, &numFds, numIdle > 0 ? MSG_DONTWAIT : 0);
+
+		if (n < 0 && numIdle > 0 &&
+				(errno == EAGAIN || errno == EWOULDBLOCK))
+			return 0;
+		if (n != sizeof(h->pid) || numFds != 1)
+			return -1;
+
+		numRequested--;
+		numIdle++;
+	}
+
+	return numIdle > 0 ? 0 : -1;
+}
+
+/*
+ * Starts the zygote and asks it for ZYGOTEHELPERS helpers.
+ * Does nothing if it is already running.
+ * Returns 0 on success, -1 on failure.
+ */
+int startZygote()
+{
+	int pair[2];
+	pid_t pid;
+
+	if (zygoteSock >= 0)
+		return 0;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) < 0)
+		return -1;
+
+	/* anything still buffered would otherwise be written twice */
+	fflush(stdout);
+
+	pid = fork();
+	if (pid < 0) {
+		close(pair[0]);
+		close(pair[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		char *args[] = { ZYGOTENAME, NULL };
+
+		/*
+		 * A fresh image holds nothing of the shell's memory, so the
+		 * helpers it creates are cheap to create whatever the size
+		 * of the shell. If it cannot be run, the copy will do. It and
+		 * the helpers get the signal mask the shell started with.
+		 */
+		close(pair[0]);
+		closeInherited(pair[1]);
+		sigprocmask(SIG_SETMASK, originalSignalMask(), NULL);
+		execve("/proc/self/exe", args, environ);
+		runZygote(ZYGOTEFD);
+	}
+
+	close(pair[1]);
+	zygoteSock = pair[0];
+	zygotePid = pid;
+	zygoteParent = getpid();
+	numIdle = 0;
+	numRequested = 0;
+	requestHelpers(ZYGOTEHELPERS);
+
+	return 0;
+}
+
+/*
+ * Returns 1 if the zygote is running, 0 otherwise.
+ */
+int zygoteRunning()
+{
+	return zygoteSock >= 0;
+}
+
+/*
+ * Builds the message for path and args in buf, which holds size bytes.
+ * Returns its length, or 0 if it does not fit.
+ */
+static size_t buildMessage(char *buf, size_t size, const char *path,
+		char * const args[])
+{
+	size_t len = strlen(path) + 1;
+	int i;
+
+	if (len > size)
+		return 0;
+	memcpy(buf, path, len);
+
+	for (i = 0; args[i] != NULL; i++) {
+		size_t argLen = strlen(args[i]) + 1;
+
+		if (len + argLen > size)
+			return 0;
+		memcpy(buf + len, args[i], argLen);
+		len += argLen;
+	}
+
+	return len;
+}
+
+/*
+ * Starts the executable at path with the given NULL-terminated args in
+ * a helper. fds are as for spawnProcess(). execFd, if not -1, is kept
+ * open in the helper until it calls exec.
+ * Returns the pid of the new process, or -1 with errno set on failure;
+ * E2BIG if the arguments do not fit in a message. If the zygote has
+ * gone it is stopped.
+ */
+pid_t zygoteSpawn(const char *path, char * const args[], const int fds[3],
+		int execFd)
+{
+	static char buf[ZYGOTEMSGMAX];
+	size_t len = buildMessage(buf, sizeof(buf), path, args);
+	int sent[MAXSENTFDS];
+	int numSent = 4;
+	int i;
+
+	if (len == 0) {
+		errno = E2BIG;
+		return -1;
+	}
+
+	/* its helpers would be the shell's children, not this process's */
+	if (zygoteParent != getpid()) {
+		stopZygote();
+		errno = ECHILD;
+		return -1;
+	}
+
+	/* the helper runs in the zygote's directory unless told otherwise */
+	sent[3] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (sent[3] < 0)
+		return -1;
+	for (i = 0; i < 3; i++)
+		sent[i] = fds != NULL && fds[i] >= 0 ? fds[i] : i;
+	if (execFd >= 0)
+		sent[numSent++] = execFd;
+
+	while (1) {
+		struct Helper h;
+
+		if (receiveHelpers() < 0) {
+			close(sent[3]);
+			stopZygote();
+			errno = ECHILD;
+			return -1;
+		}
+
+		h = idle[--numIdle];
+		requestHelpers(1);
+
+		if (sendFds(h.sock, buf, len, sent, numSent) == 0) {
+			close(h.sock);
+			close(sent[3]);
+			return h.pid;
+		}
+
+		/* the helper has died; try another */
+		close(h.sock);
+		disownChild(h.pid);
+	}
+}
+
+/*
+ * Stops the zygote and every idle helper, which exit when their
+ * sockets are closed. They are the shell's children, so they are
+ * reaped by the event loop like those of jobs.
+ */
+void stopZygote()
+{
+	/*
+	 * A forked builtin has closed the sockets it inherited, and the
+	 * numbers may be in use again; the shell's zygote keeps working.
+	 */
+	if (zygoteParent != getpid()) {
+		numIdle = 0;
+	} else if (zygoteSock >= 0) {
+		/* it exits once it has sent the helpers still asked for */
+		shutdown(zygoteSock, SHUT_WR);
+		while (numRequested > 0 && numIdle < ZYGOTEHELPERS) {
+			struct Helper *h = &idle[numIdle];
+			int numFds;
+
+			if (receiveFds(zygoteSock, &h->pid, sizeof(h->pid),
+						&h->sock, &numFds, 0) !=
+					sizeof(h->pid) || numFds != 1)
+				break;
+			numRequested--;
+			numIdle++;
+		}
+
+		close(zygoteSock);
+		disownChild(zygotePid);
+	}
+
+	while (numIdle > 0) {
+		/* they are the shell's children, not the zygote's */
+		numIdle--;
+		close(idle[numIdle].sock);
+		disownChild(idle[numIdle].pid);
+	}
+
+	zygoteSock = -1;
+	zygotePid = -1;
+	numRequested = 0;
+}
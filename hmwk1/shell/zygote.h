@@ -0,0 +1,58 @@
+#ifndef _ZYGOTE_H_
+#define _ZYGOTE_H_
+
+#include <sys/types.h>
+
+/* The number of helpers kept ready */
+#define ZYGOTEHELPERS 4
+
+/* The longest path and argument list a helper can be sent */
+#define ZYGOTEMSGMAX (64 * 1024)
+
+/*
+ * A pool of pre-forked helper processes that start commands.
+ *
+ * A zygote process is started once, by running the shell's binary
+ * afresh, so it holds none of the shell's memory. On request it creates
+ * helper processes with clone(CLONE_PARENT), which makes them children
+ * of the shell rather than of the zygote, and hands the shell one end
+ * of a socketpair connected to each. To start a command the shell sends
+ * an idle helper the path, the arguments and, with SCM_RIGHTS, the
+ * descriptors for its stdin, stdout and stderr and its working
+ * directory; the helper installs them and execs at once. Its pid is the
+ * command's pid, so jobs are waited for as usual. The zygote is then
+ * asked for a replacement, so creating processes happens in another
+ * process, off the shell's path from reading a command to running it,
+ * and costs the same however large the shell has grown.
+ */
+
+/*
+ * Starts the zygote and asks it for ZYGOTEHELPERS helpers.
+ * Does nothing if it is already running.
+ * Returns 0 on success, -1 on failure.
+ */
+int startZygote();
+
+/*
+ * Returns 1 if the zygote is running, 0 otherwise.
+ */
+int zygoteRunning();
+
+/*
+ * Starts the executable at path with the given NULL-terminated args in
+ * a helper. fds are as for spawnProcess(). execFd, if not -1, is kept
+ * open in the helper until it calls exec.
+ * Returns the pid of the new process, or -1 with errno set on failure;
+ * E2BIG if the arguments do not fit in a message. If the zygote has
+ * gone it is stopped.
+ */
+pid_t zygoteSpawn(const char *path, char * const args[], const int fds[3],
+		int execFd);
+
+/*
+ * Stops the zygote and every idle helper, which exit when their
+ * sockets are closed.
+ */
+void stopZygote();
+
+#endif